@@ -0,0 +1,120 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <3dgl/CommandList.h>
+#include <3dgl/RenderQueue.h>
+
+using namespace _3dgl;
+
+/*********************************************************************************
+** class C3dglCommandList
+*/
+
+void C3dglCommandList::record(const C3dglVertexAttrObject* pVAO, const C3dglMaterial* pMaterial, glm::mat4 matrix, float depth, GLsizei instances, C3dglProgram* pProgram, unsigned pass)
+{
+	if (!pVAO) return;
+	m_commands.push_back({ pVAO, pMaterial, pProgram, matrix, depth, instances, pass });
+}
+
+void C3dglCommandList::record(const C3dglVertexAttrObject* pVAO, const C3dglMaterial* pMaterial, glm::mat4 matrix, GLsizei instances, C3dglProgram* pProgram, unsigned pass)
+{
+	record(pVAO, pMaterial, matrix, -matrix[3][2], instances, pProgram, pass);
+}
+
+/*********************************************************************************
+** class C3dglCommandRecorder
+*/
+
+void C3dglCommandRecorder::create(unsigned nThreads)
+{
+	destroy();
+	if (nThreads == 0)
+	{
+		unsigned n = std::thread::hardware_concurrency();
+		nThreads = n > 1 ? n - 1 : 0;
+	}
+	// the workers start at the current generation - it is not reset by destroy
+	m_bQuit = false;
+	for (unsigned i = 0; i < nThreads; i++)
+		m_threads.push_back(std::thread(&C3dglCommandRecorder::worker, this, m_generation));
+}
+
+void C3dglCommandRecorder::destroy()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bQuit = true;
+	}
+	m_cvWork.notify_all();
+	for (std::thread& thread : m_threads)
+		thread.join();
+	m_threads.clear();
+}
+
+void C3dglCommandRecorder::record(size_t nJobs, JOB job)
+{
+	if (m_lists.size() < nJobs)
+		m_lists.resize(nJobs);
+	for (size_t i = 0; i < nJobs; i++)
+		m_lists[i].clear();
+
+	// start a new generation
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_job = job;
+		m_nJobs = nJobs;
+		m_nextJob = 0;
+		m_nBusy = (unsigned)m_threads.size();
+		m_generation++;
+	}
+	m_cvWork.notify_all();
+
+	// take part, then wait for the workers
+	work();
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_cvDone.wait(lock, [this] { return m_nBusy == 0; });
+	m_job = nullptr;
+}
+
+void C3dglCommandRecorder::submit(C3dglRenderQueue& queue) const
+{
+	for (size_t i = 0; i < m_nJobs; i++)
+		queue.submit(m_lists[i]);
+}
+
+size_t C3dglCommandRecorder::getCommandCount() const
+{
+	size_t n = 0;
+	for (size_t i = 0; i < m_nJobs; i++)
+		n += m_lists[i].getSize();
+	return n;
+}
+
+void C3dglCommandRecorder::worker(unsigned generation)
+{
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cvWork.wait(lock, [&] { return m_bQuit || m_generation != generation; });
+			if (m_bQuit) return;
+			generation = m_generation;
+		}
+
+		work();
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (--m_nBusy == 0)
+			m_cvDone.notify_one();
+	}
+}
+
+void C3dglCommandRecorder::work()
+{
+	// jobs are taken one by one - the costly ones do not hold the others up
+	for (size_t i = m_nextJob++; i < m_nJobs; i = m_nextJob++)
+		m_job(i, m_lists[i]);
+}
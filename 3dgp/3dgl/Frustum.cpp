@@ -0,0 +1,114 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <3dgl/Frustum.h>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#define M3DGL_FRUSTUM_SSE
+#include <xmmintrin.h>
+#endif
+
+using namespace _3dgl;
+
+/*********************************************************************************
+** class C3dglFrustum
+*/
+
+C3dglFrustum::C3dglFrustum()
+{
+	// an infinite frustum - everything is visible
+	for (glm::vec4& plane : m_planes)
+		plane = glm::vec4(0, 0, 0, 1);
+	for (int i = 0; i < 8; i++)
+		for (int j = 0; j < 4; j++)
+			m_soa[j][i] = m_planes[std::min(i, 5)][j];
+}
+
+void C3dglFrustum::set(glm::mat4 matrix)
+{
+	// Gribb & Hartmann: planes are sums and differences of the matrix rows
+	glm::mat4 t = glm::transpose(matrix);
+	m_planes[0] = t[3] + t[0];
+	m_planes[1] = t[3] - t[0];
+	m_planes[2] = t[3] + t[1];
+	m_planes[3] = t[3] - t[1];
+	m_planes[4] = t[3] + t[2];
+	m_planes[5] = t[3] - t[2];
+	for (glm::vec4& plane : m_planes)
+		plane /= glm::length(glm::vec3(plane));
+
+	for (int i = 0; i < 8; i++)
+		for (int j = 0; j < 4; j++)
+			m_soa[j][i] = m_planes[std::min(i, 5)][j];
+}
+
+bool C3dglFrustum::isVisible(glm::vec3 point) const
+{
+	return classify(point, glm::vec3(0), 0) != OUTSIDE;
+}
+
+bool C3dglFrustum::isVisible(glm::vec3 centre, float radius) const
+{
+	return classify(centre, glm::vec3(0), radius) != OUTSIDE;
+}
+
+bool C3dglFrustum::isVisible(const glm::vec3 aabb[2]) const
+{
+	return classify((aabb[0] + aabb[1]) * 0.5f, (aabb[1] - aabb[0]) * 0.5f, 0) != OUTSIDE;
+}
+
+C3dglFrustum::CLASS C3dglFrustum::classify(glm::vec3 centre, float radius) const
+{
+	return classify(centre, glm::vec3(0), radius);
+}
+
+C3dglFrustum::CLASS C3dglFrustum::classify(const glm::vec3 aabb[2]) const
+{
+	return classify((aabb[0] + aabb[1]) * 0.5f, (aabb[1] - aabb[0]) * 0.5f, 0);
+}
+
+C3dglFrustum::CLASS C3dglFrustum::classify(const glm::vec3 aabb[2], glm::vec3 centre, float radius) const
+{
+	CLASS c = classify(centre, glm::vec3(0), radius);
+	return c == INTERSECT ? classify(aabb) : c;
+}
+
+C3dglFrustum::CLASS C3dglFrustum::classify(glm::vec3 centre, glm::vec3 extent, float radius) const
+{
+	// signed distance of the centre from each plane: d = dot(n, c) + w; the projected radius of the box: r = dot(|n|, e) + radius.
+	// Outside if d < -r for any plane; inside if d >= r for all planes
+#ifdef M3DGL_FRUSTUM_SSE
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	__m128 cx = _mm_set1_ps(centre.x), cy = _mm_set1_ps(centre.y), cz = _mm_set1_ps(centre.z);
+	__m128 ex = _mm_set1_ps(extent.x), ey = _mm_set1_ps(extent.y), ez = _mm_set1_ps(extent.z);
+	__m128 rad = _mm_set1_ps(radius);
+	int outside = 0, crossing = 0;
+	for (int i = 0; i < 8; i += 4)
+	{
+		__m128 nx = _mm_loadu_ps(&m_soa[0][i]), ny = _mm_loadu_ps(&m_soa[1][i]), nz = _mm_loadu_ps(&m_soa[2][i]), w = _mm_loadu_ps(&m_soa[3][i]);
+		__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)), _mm_add_ps(_mm_mul_ps(nz, cz), w));
+		__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, nx), ex), _mm_mul_ps(_mm_andnot_ps(signMask, ny), ey)),
+			_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, nz), ez), rad));
+		outside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+		crossing |= _mm_movemask_ps(_mm_cmplt_ps(d, r));
+	}
+	if (outside) return OUTSIDE;
+	return crossing ? INTERSECT : INSIDE;
+#else
+	CLASS c = INSIDE;
+	for (const glm::vec4& plane : m_planes)
+	{
+		float d = glm::dot(glm::vec3(plane), centre) + plane.w;
+		float r = glm::dot(glm::abs(glm::vec3(plane)), extent) + radius;
+		if (d < -r)
+			return OUTSIDE;
+		if (d < r)
+			c = INTERSECT;
+	}
+	return c;
+#endif
+}
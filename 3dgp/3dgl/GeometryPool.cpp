@@ -0,0 +1,214 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <3dgl/GeometryPool.h>
+#include <3dgl/State.h>
+
+using namespace _3dgl;
+
+/*********************************************************************************
+** class C3dglGeometryPool
+*/
+
+C3dglGeometryPool::C3dglGeometryPool(size_t initVertices, size_t initIndices) : C3dglObject(), m_initVertices(initVertices), m_initIndices(initIndices)
+{
+}
+
+void C3dglGeometryPool::destroy()
+{
+	for (ARENA& arena : m_arenas)
+	{
+		C3dglState::deleteVertexArrays(1, &arena.idVAO);
+		C3dglState::deleteBuffers(1, &arena.idVertex);
+		C3dglState::deleteBuffers(1, &arena.idIndex);
+	}
+	m_arenas.clear();
+}
+
+bool C3dglGeometryPool::allocate(const VERTEX_FORMAT& format, const void* vertexData, size_t nVertices, const void* indexData, GLenum indexType, size_t nIndices,
+	unsigned& iArena, GLint& baseVertex, GLuint& firstIndex)
+{
+	if (format.stride == 0 || nVertices == 0 || nIndices == 0)
+		return false;
+
+	iArena = findOrAddArena(format, indexType);
+	ARENA& arena = m_arenas[iArena];
+
+	size_t first;
+	while (!allocBlock(arena.freeVertices, nVertices, first))
+		growVertices(arena, arena.vertexCapacity + nVertices);
+	baseVertex = (GLint)first;
+	while (!allocBlock(arena.freeIndices, nIndices, first))
+		growIndices(arena, arena.indexCapacity + nIndices);
+	firstIndex = (GLuint)first;
+
+	size_t indSize = C3dglVertexAttrObject::getIndexSize(indexType);
+	if (C3dglState::isDSA())
+	{
+		glNamedBufferSubData(arena.idVertex, baseVertex * format.stride, nVertices * format.stride, vertexData);
+		glNamedBufferSubData(arena.idIndex, firstIndex * indSize, nIndices * indSize, indexData);
+		return true;
+	}
+	C3dglState::bindBuffer(GL_COPY_WRITE_BUFFER, arena.idVertex);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, baseVertex * format.stride, nVertices * format.stride, vertexData);
+	C3dglState::bindBuffer(GL_COPY_WRITE_BUFFER, arena.idIndex);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, firstIndex * indSize, nIndices * indSize, indexData);
+	C3dglState::bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return true;
+}
+
+void C3dglGeometryPool::free(unsigned iArena, GLint baseVertex, size_t nVertices, GLuint firstIndex, size_t nIndices)
+{
+	if (iArena >= m_arenas.size()) return;
+	freeBlock(m_arenas[iArena].freeVertices, baseVertex, nVertices);
+	freeBlock(m_arenas[iArena].freeIndices, firstIndex, nIndices);
+}
+
+size_t C3dglGeometryPool::getFreeVertices(unsigned iArena) const
+{
+	size_t n = 0;
+	for (auto& block : m_arenas[iArena].freeVertices)
+		n += block.second;
+	return n;
+}
+
+size_t C3dglGeometryPool::getFreeIndices(unsigned iArena) const
+{
+	size_t n = 0;
+	for (auto& block : m_arenas[iArena].freeIndices)
+		n += block.second;
+	return n;
+}
+
+unsigned C3dglGeometryPool::findOrAddArena(const VERTEX_FORMAT& format, GLenum indexType)
+{
+	for (unsigned i = 0; i < m_arenas.size(); i++)
+		if (m_arenas[i].format == format && m_arenas[i].indexType == indexType)
+			return i;
+
+	m_arenas.push_back(ARENA());
+	ARENA& arena = m_arenas.back();
+	arena.format = format;
+	arena.indexType = indexType;
+	if (C3dglState::isDSA())
+		glCreateVertexArrays(1, &arena.idVAO);
+	else
+		glGenVertexArrays(1, &arena.idVAO);
+	growVertices(arena, m_initVertices);
+	growIndices(arena, m_initIndices);
+	return (unsigned)m_arenas.size() - 1;
+}
+
+void C3dglGeometryPool::growVertices(ARENA& arena, size_t minCapacity)
+{
+	size_t capacity = std::max(minCapacity, arena.vertexCapacity * 2);
+	arena.idVertex = growBuffer(arena.idVertex, arena.vertexCapacity * arena.format.stride, capacity * arena.format.stride);
+	freeBlock(arena.freeVertices, arena.vertexCapacity, capacity - arena.vertexCapacity);
+	arena.vertexCapacity = capacity;
+
+	// re-point the attributes at the new buffer
+	if (C3dglState::isDSA())
+	{
+		arena.format.setAttribFormat(arena.idVAO, arena.idVertex);
+		return;
+	}
+	GLuint prevVAO = C3dglState::getVertexArray();
+	C3dglState::bindVertexArray(arena.idVAO);
+	C3dglState::bindBuffer(GL_ARRAY_BUFFER, arena.idVertex);
+	arena.format.setAttribPointers();
+	C3dglState::bindVertexArray(prevVAO);
+	C3dglState::bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void C3dglGeometryPool::growIndices(ARENA& arena, size_t minCapacity)
+{
+	size_t capacity = std::max(minCapacity, arena.indexCapacity * 2);
+	size_t indSize = C3dglVertexAttrObject::getIndexSize(arena.indexType);
+	arena.idIndex = growBuffer(arena.idIndex, arena.indexCapacity * indSize, capacity * indSize);
+	freeBlock(arena.freeIndices, arena.indexCapacity, capacity - arena.indexCapacity);
+	arena.indexCapacity = capacity;
+
+	// the index buffer binding is a part of the VAO state
+	if (C3dglState::isDSA())
+	{
+		glVertexArrayElementBuffer(arena.idVAO, arena.idIndex);
+		return;
+	}
+	GLuint prevVAO = C3dglState::getVertexArray();
+	C3dglState::bindVertexArray(arena.idVAO);
+	C3dglState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena.idIndex);
+	C3dglState::bindVertexArray(prevVAO);
+}
+
+GLuint C3dglGeometryPool::growBuffer(GLuint idOld, size_t oldSize, size_t newSize)
+{
+	GLuint idNew;
+	if (C3dglState::isDSA())
+	{
+		glCreateBuffers(1, &idNew);
+		glNamedBufferData(idNew, newSize, NULL, GL_STATIC_DRAW);
+		if (idOld)
+		{
+			glCopyNamedBufferSubData(idOld, idNew, 0, 0, oldSize);
+			C3dglState::deleteBuffers(1, &idOld);
+		}
+		return idNew;
+	}
+	glGenBuffers(1, &idNew);
+	C3dglState::bindBuffer(GL_COPY_WRITE_BUFFER, idNew);
+	glBufferData(GL_COPY_WRITE_BUFFER, newSize, NULL, GL_STATIC_DRAW);
+	if (idOld)
+	{
+		C3dglState::bindBuffer(GL_COPY_READ_BUFFER, idOld);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldSize);
+		C3dglState::bindBuffer(GL_COPY_READ_BUFFER, 0);
+		C3dglState::deleteBuffers(1, &idOld);
+	}
+	C3dglState::bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return idNew;
+}
+
+bool C3dglGeometryPool::allocBlock(FREE_LIST& freeList, size_t count, size_t& first)
+{
+	// first fit
+	for (auto it = freeList.begin(); it != freeList.end(); it++)
+		if (it->second >= count)
+		{
+			first = it->first;
+			size_t remaining = it->second - count;
+			freeList.erase(it);
+			if (remaining)
+				freeList[first + count] = remaining;
+			return true;
+		}
+	return false;
+}
+
+void C3dglGeometryPool::freeBlock(FREE_LIST& freeList, size_t first, size_t count)
+{
+	if (count == 0) return;
+
+	// merge with the following block
+	auto next = freeList.find(first + count);
+	if (next != freeList.end())
+	{
+		count += next->second;
+		freeList.erase(next);
+	}
+
+	// merge with the preceding block
+	auto it = freeList.lower_bound(first);
+	if (it != freeList.begin())
+	{
+		auto prev = std::prev(it);
+		if (prev->first + prev->second == first)
+		{
+			prev->second += count;
+			return;
+		}
+	}
+	freeList[first] = count;
+}
@@ -0,0 +1,131 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <3dgl/Headless.h>
+#include <3dgl/State.h>
+
+#ifdef M3DGL_HEADLESS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+using namespace _3dgl;
+
+/*********************************************************************************
+** class C3dglHeadless
+*/
+
+bool C3dglHeadless::create(GLsizei width, GLsizei height)
+{
+	destroy();
+#ifndef M3DGL_HEADLESS
+	(void)width; (void)height;
+	return log(M3DGL_ERROR_HEADLESS_CONTEXT, "not available in this build (M3DGL_HEADLESS not defined)");
+#else
+	// the surfaceless platform needs no display server nor GPU; the default display otherwise
+	EGLDisplay display = EGL_NO_DISPLAY;
+	PFNEGLGETPLATFORMDISPLAYEXTPROC pGetPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (pGetPlatformDisplay)
+		display = pGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	if (display == EGL_NO_DISPLAY)
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+		return log(M3DGL_ERROR_HEADLESS_CONTEXT, "no EGL display");
+	m_display = display;
+	if (!eglBindAPI(EGL_OPENGL_API))
+	{
+		destroy();
+		return log(M3DGL_ERROR_HEADLESS_CONTEXT, "desktop OpenGL not supported by EGL");
+	}
+
+	// compatibility profile - some of the library (e.g. the fixed pipeline fallbacks) needs it; no config, as there is no surface
+	const EGLint attribs[] = { EGL_CONTEXT_MAJOR_VERSION, 4, EGL_CONTEXT_MINOR_VERSION, 5,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT, EGL_NONE };
+	EGLContext context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attribs);
+	if (context == EGL_NO_CONTEXT)
+		context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, NULL);		// any version
+	if (context == EGL_NO_CONTEXT)
+	{
+		destroy();
+		return log(M3DGL_ERROR_HEADLESS_CONTEXT, "EGL context not created (EGL_KHR_no_config_context required)");
+	}
+	m_context = context;
+	if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+	{
+		destroy();
+		return log(M3DGL_ERROR_HEADLESS_CONTEXT, "EGL context cannot be made current (EGL_KHR_surfaceless_context required)");
+	}
+
+	// with no GLX display GLEW reports an error - but still initialises the core functions and extensions
+	GLenum err = glewInit();
+	if (err != GLEW_OK && err != GLEW_ERROR_NO_GLX_DISPLAY)
+	{
+		destroy();
+		return log(M3DGL_ERROR_HEADLESS_CONTEXT, (const char*)glewGetErrorString(err));
+	}
+	C3dglState::invalidate();
+
+	// framebuffer - it takes place of the default one
+	m_width = width;
+	m_height = height;
+	glGenRenderbuffers(1, &m_idColor);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_idColor);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glGenRenderbuffers(1, &m_idDepth);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_idDepth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &m_idFBO);
+	C3dglState::bindFramebuffer(m_idFBO);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_idColor);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_idDepth);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		destroy();
+		return log(M3DGL_ERROR_FRAMEBUFFER_INCOMPLETE, status);
+	}
+	C3dglState::viewport(0, 0, width, height);
+	return true;
+#endif
+}
+
+void C3dglHeadless::destroy()
+{
+#ifdef M3DGL_HEADLESS
+	if (m_context)
+	{
+		if (m_idFBO) C3dglState::deleteFramebuffers(1, &m_idFBO);
+		if (m_idColor) glDeleteRenderbuffers(1, &m_idColor);
+		if (m_idDepth) glDeleteRenderbuffers(1, &m_idDepth);
+		eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(m_display, m_context);
+		C3dglState::invalidate();
+	}
+	if (m_display)
+		eglTerminate(m_display);
+#endif
+	m_display = m_context = NULL;
+	m_idFBO = m_idColor = m_idDepth = 0;
+	m_width = m_height = 0;
+}
+
+void C3dglHeadless::finish() const
+{
+	glFinish();
+}
+
+void C3dglHeadless::readPixels(void* pixels) const
+{
+	if (!isCreated()) return;
+	GLuint prevFBO = C3dglState::getFramebuffer();
+	C3dglState::bindFramebuffer(m_idFBO);
+	C3dglState::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	C3dglState::bindFramebuffer(prevFBO);
+}
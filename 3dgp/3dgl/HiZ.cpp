@@ -0,0 +1,589 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <3dgl/HiZ.h>
+#include <3dgl/Model.h>
+#include <3dgl/Tools.h>
+#include <3dgl/State.h>
+
+using namespace _3dgl;
+
+/*********************************************************************************
+** Embedded shaders
+*/
+
+// full-screen triangle - no vertex attributes needed
+static const char* c_srcFullScreenVert = R"(
+#version 330
+void main()
+{
+	vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+// one step of the pyramid reduction: the farthest depth of the 2x2 footprint (3x3 at the edges of odd-sized levels)
+static const char* c_srcReduceFrag = R"(
+#version 330
+uniform sampler2D source;		// the previous level - the only one accessible - or the depth texture
+uniform bool bCopy;				// true for level 0: straight copy of the depth texture
+out float outDepth;
+void main()
+{
+	ivec2 size = textureSize(source, 0);
+	ivec2 p = ivec2(gl_FragCoord.xy);
+	if (bCopy)
+	{
+		outDepth = texelFetch(source, p, 0).r;
+		return;
+	}
+	p *= 2;
+	ivec2 q = min(p + 1, size - 1);
+	float d = max(max(texelFetch(source, p, 0).r, texelFetch(source, ivec2(q.x, p.y), 0).r),
+	              max(texelFetch(source, ivec2(p.x, q.y), 0).r, texelFetch(source, q, 0).r));
+
+	bool bOddX = (size.x & 1) != 0 && p.x == size.x - 3;
+	bool bOddY = (size.y & 1) != 0 && p.y == size.y - 3;
+	if (bOddX)
+		d = max(d, max(texelFetch(source, ivec2(p.x + 2, p.y), 0).r, texelFetch(source, ivec2(p.x + 2, q.y), 0).r));
+	if (bOddY)
+		d = max(d, max(texelFetch(source, ivec2(p.x, p.y + 2), 0).r, texelFetch(source, ivec2(q.x, p.y + 2), 0).r));
+	if (bOddX && bOddY)
+		d = max(d, texelFetch(source, p + 2, 0).r);
+	outDepth = d;
+}
+)";
+
+// instance culling: frustum test, then Hi-Z test; visible instances are appended to the output buffer
+static const char* c_srcCullComp = R"(
+#version 430
+layout(local_size_x = 64) in;
+layout(std430, binding = 0) readonly buffer Src { float src[]; };
+layout(std430, binding = 1) writeonly buffer Dst { float dst[]; };
+layout(std430, binding = 2) buffer Cmd { uint cmd[]; };		// the first DrawElementsIndirectCommand
+
+uniform uint nInstances;
+uniform mat4 matrixViewProj;	// current view - for frustum culling
+uniform mat4 matrixHiZ;			// the view the pyramid was built from - for occlusion culling
+uniform vec3 aabbMin;			// world bounding box of the model at the origin
+uniform vec3 aabbMax;
+uniform sampler2D pyramid;
+uniform bool bOcclusion;
+
+void main()
+{
+	uint i = gl_GlobalInvocationID.x;
+	if (i >= nInstances) return;
+	vec3 offset = vec3(src[3 * i], src[3 * i + 1], src[3 * i + 2]);
+	vec3 bb[2] = vec3[2](aabbMin + offset, aabbMax + offset);
+
+	// frustum: reject if all corners are outside of any of the planes
+	ivec3 outMin = ivec3(0), outMax = ivec3(0);
+	for (int c = 0; c < 8; c++)
+	{
+		vec4 clip = matrixViewProj * vec4(bb[c & 1].x, bb[(c >> 1) & 1].y, bb[(c >> 2) & 1].z, 1.0);
+		outMin += ivec3(lessThan(clip.xyz, -clip.www));
+		outMax += ivec3(greaterThan(clip.xyz, clip.www));
+	}
+	if (any(equal(outMin, ivec3(8))) || any(equal(outMax, ivec3(8)))) return;
+
+	// occlusion: screen rectangle and nearest depth of the box, in the pyramid's view
+	bool bVisible = true;
+	if (bOcclusion)
+	{
+		vec3 ndcMin = vec3(1.0), ndcMax = vec3(-1.0);
+		bool bNear = false;
+		for (int c = 0; c < 8; c++)
+		{
+			vec4 clip = matrixHiZ * vec4(bb[c & 1].x, bb[(c >> 1) & 1].y, bb[(c >> 2) & 1].z, 1.0);
+			if (clip.w <= 0.0) { bNear = true; break; }
+			ndcMin = min(ndcMin, clip.xyz / clip.w);
+			ndcMax = max(ndcMax, clip.xyz / clip.w);
+		}
+		if (!bNear)
+		{
+			float z = ndcMin.z * 0.5 + 0.5;
+
+			// level 0 pixels covered by the rectangle, and the level at which they span at most 2x2 texels
+			ivec2 size = textureSize(pyramid, 0);
+			ivec2 pMin = clamp(ivec2(floor((ndcMin.xy * 0.5 + 0.5) * vec2(size))), ivec2(0), size - 1);
+			ivec2 pMax = clamp(ivec2(floor((ndcMax.xy * 0.5 + 0.5) * vec2(size))), ivec2(0), size - 1);
+			ivec2 extent = pMax - pMin;
+			int level = min(findMSB(max(extent.x, extent.y)) + 1, textureQueryLevels(pyramid) - 1);
+
+			// level sizes are rounded down, so pixel p lies in texel p >> level - or in the last one, which absorbs the odd remainders
+			ivec2 last = textureSize(pyramid, level) - 1;
+			ivec2 tMin = min(pMin >> level, last);
+			ivec2 tMax = min(pMax >> level, last);
+			float d = max(max(texelFetch(pyramid, tMin, level).r, texelFetch(pyramid, ivec2(tMax.x, tMin.y), level).r),
+			              max(texelFetch(pyramid, ivec2(tMin.x, tMax.y), level).r, texelFetch(pyramid, tMax, level).r));
+			bVisible = z <= d;
+		}
+	}
+	if (!bVisible) return;
+
+	uint j = atomicAdd(cmd[1], 1u);
+	dst[3 * j] = offset.x;
+	dst[3 * j + 1] = offset.y;
+	dst[3 * j + 2] = offset.z;
+}
+)";
+
+// size of the CPU readback level: the first level not exceeding this size in either dimension
+static const int c_readbackSize = 128;
+
+/*********************************************************************************
+** class C3dglHiZ
+*/
+
+C3dglHiZ::C3dglHiZ() : C3dglObject(), m_matrixViewProj(1), m_matrixReadback(1)
+{
+	m_matrixPBO[0] = m_matrixPBO[1] = glm::mat4(1);
+}
+
+bool C3dglHiZ::create(int width, int height)
+{
+	destroy();
+
+	// shader programs - compiled once
+	if (m_progReduce.getId() == 0)
+	{
+		C3dglShader vert, frag;
+		if (!vert.create(GL_VERTEX_SHADER) || !vert.load(c_srcFullScreenVert) || !vert.compile()) return false;
+		if (!frag.create(GL_FRAGMENT_SHADER) || !frag.load(c_srcReduceFrag) || !frag.compile()) return false;
+		if (!m_progReduce.create() || !m_progReduce.attach(vert) || !m_progReduce.attach(frag) || !m_progReduce.link()) return false;
+
+		m_bCompute = GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object;
+		if (m_bCompute)
+		{
+			C3dglShader comp;
+			if (!comp.create(GL_COMPUTE_SHADER) || !comp.load(c_srcCullComp) || !comp.compile()) return false;
+			if (!m_progCull.create() || !m_progCull.attach(comp) || !m_progCull.link()) return false;
+		}
+		else
+			log(M3DGL_WARNING_COMPUTE_SHADERS_NOT_SUPPORTED);
+	}
+
+	m_width = width;
+	m_height = height;
+	m_nLevels = 1;
+	while ((std::max(m_width, m_height) >> m_nLevels) > 0)
+		m_nLevels++;
+
+	GLenum prevActiveTexture = C3dglState::getActiveTexture();
+	GLuint prevTexture = C3dglState::getTexture(GL_TEXTURE0, GL_TEXTURE_2D);
+	GLuint prevFBO = C3dglState::getFramebuffer();
+
+	// depth texture & occluder pre-pass framebuffer
+	glGenTextures(1, &m_idDepth);
+	C3dglState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, m_idDepth);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, m_width, m_height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+	glGenFramebuffers(1, &m_idFBODepth);
+	C3dglState::bindFramebuffer(m_idFBODepth);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_idDepth, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+	// the pyramid & its framebuffer
+	glGenTextures(1, &m_idPyramid);
+	C3dglState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, m_idPyramid);
+	glTexStorage2D(GL_TEXTURE_2D, m_nLevels, GL_R32F, m_width, m_height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenFramebuffers(1, &m_idFBO);
+	glGenVertexArrays(1, &m_idVAO);
+
+	// readback buffers
+	m_readLevel = 0;
+	while ((m_width >> m_readLevel) > c_readbackSize || (m_height >> m_readLevel) > c_readbackSize)
+		m_readLevel++;
+	m_readWidth = std::max(1, m_width >> m_readLevel);
+	m_readHeight = std::max(1, m_height >> m_readLevel);
+	glGenBuffers(2, m_idPBO);
+	for (GLuint id : m_idPBO)
+	{
+		C3dglState::bindBuffer(GL_PIXEL_PACK_BUFFER, id);
+		glBufferData(GL_PIXEL_PACK_BUFFER, m_readWidth * m_readHeight * sizeof(float), NULL, GL_STREAM_READ);
+	}
+	C3dglState::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	C3dglState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, prevTexture);
+	C3dglState::activeTexture(prevActiveTexture);
+	C3dglState::bindFramebuffer(prevFBO);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+		return log(M3DGL_ERROR_FRAMEBUFFER_INCOMPLETE, status);
+	return true;
+}
+
+void C3dglHiZ::destroy()
+{
+	for (GLsync& fence : m_fences)
+	{
+		if (fence) glDeleteSync(fence);
+		fence = NULL;
+	}
+	if (m_idPBO[0]) C3dglState::deleteBuffers(2, m_idPBO);
+	m_idPBO[0] = m_idPBO[1] = 0;
+	if (m_idVAO) C3dglState::deleteVertexArrays(1, &m_idVAO);
+	if (m_idFBO) C3dglState::deleteFramebuffers(1, &m_idFBO);
+	if (m_idFBODepth) C3dglState::deleteFramebuffers(1, &m_idFBODepth);
+	if (m_idPyramid) C3dglState::deleteTextures(1, &m_idPyramid);
+	if (m_idDepth) C3dglState::deleteTextures(1, &m_idDepth);
+	m_idVAO = m_idFBO = m_idFBODepth = m_idPyramid = m_idDepth = 0;
+	m_width = m_height = m_nLevels = 0;
+	m_bBuilt = false;
+	m_readback.clear();
+}
+
+void C3dglHiZ::copyDepth()
+{
+	if (m_idDepth == 0) return;
+	GLenum prevActiveTexture = C3dglState::getActiveTexture();
+	GLuint prevTexture = C3dglState::getTexture(GL_TEXTURE0, GL_TEXTURE_2D);
+	C3dglState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, m_idDepth);
+	glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, m_width, m_height);
+	C3dglState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, prevTexture);
+	C3dglState::activeTexture(prevActiveTexture);
+}
+
+void C3dglHiZ::beginOccluders()
+{
+	if (m_idFBODepth == 0) return;
+	m_prevFBO = C3dglState::getFramebuffer();
+	C3dglState::getViewport(m_prevViewport);
+	C3dglState::bindFramebuffer(m_idFBODepth);
+	C3dglState::viewport(0, 0, m_width, m_height);
+	glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void C3dglHiZ::endOccluders()
+{
+	if (m_idFBODepth == 0) return;
+	C3dglState::bindFramebuffer(m_prevFBO);
+	C3dglState::viewport(m_prevViewport[0], m_prevViewport[1], m_prevViewport[2], m_prevViewport[3]);
+}
+
+void C3dglHiZ::build(glm::mat4 matrixViewProj)
+{
+	if (m_idPyramid == 0) return;
+	m_matrixViewProj = matrixViewProj;
+	m_bBuilt = true;
+
+	// save the state
+	GLuint prevFBO = C3dglState::getFramebuffer();
+	GLuint prevVAO = C3dglState::getVertexArray();
+	GLint prevViewport[4];
+	C3dglState::getViewport(prevViewport);
+	GLenum prevActiveTexture = C3dglState::getActiveTexture();
+	GLuint prevTexture = C3dglState::getTexture(GL_TEXTURE0, GL_TEXTURE_2D);
+	bool bDepthTest = C3dglState::isEnabled(GL_DEPTH_TEST);
+	bool bBlend = C3dglState::isEnabled(GL_BLEND);
+	C3dglProgram* pPrevProgram = C3dglProgram::getCurrentProgram();
+
+	C3dglState::disable(GL_DEPTH_TEST);
+	C3dglState::disable(GL_BLEND);
+	C3dglState::bindFramebuffer(m_idFBO);
+	C3dglState::bindVertexArray(m_idVAO);
+	m_progReduce.sendUniform("source", 0);
+
+	// level 0 is a copy of the depth texture, each next level reduces the previous one
+	int w = m_width, h = m_height;
+	for (int level = 0; level < m_nLevels; level++)
+	{
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_idPyramid, level);
+		C3dglState::viewport(0, 0, w, h);
+		if (level == 0)
+		{
+			C3dglState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, m_idDepth);
+			m_progReduce.sendUniform("bCopy", true);
+		}
+		else
+		{
+			// restrict access to the source level, so that the level being rendered is never sampled
+			C3dglState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, m_idPyramid);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+			if (level == 1)
+				m_progReduce.sendUniform("bCopy", false);
+		}
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		w = std::max(1, w / 2);
+		h = std::max(1, h / 2);
+	}
+	C3dglState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, m_idPyramid);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, m_nLevels - 1);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+
+	if (m_bReadback)
+		readback();
+
+	// restore the state
+	C3dglState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, prevTexture);
+	C3dglState::activeTexture(prevActiveTexture);
+	C3dglState::bindVertexArray(prevVAO);
+	C3dglState::bindFramebuffer(prevFBO);
+	C3dglState::viewport(prevViewport[0], prevViewport[1], prevViewport[2], prevViewport[3]);
+	C3dglState::enable(GL_DEPTH_TEST, bDepthTest);
+	C3dglState::enable(GL_BLEND, bBlend);
+	if (pPrevProgram) pPrevProgram->use();
+}
+
+void C3dglHiZ::readback()
+{
+	// expects the pyramid to be bound
+	// collect the download issued in one of the previous frames - if ready, never waiting for it
+	int iPrev = 1 - m_iPBO;
+	if (m_fences[iPrev])
+	{
+		GLenum res = glClientWaitSync(m_fences[iPrev], 0, 0);
+		if (res == GL_ALREADY_SIGNALED || res == GL_CONDITION_SATISFIED)
+		{
+			glDeleteSync(m_fences[iPrev]);
+			m_fences[iPrev] = NULL;
+			C3dglState::bindBuffer(GL_PIXEL_PACK_BUFFER, m_idPBO[iPrev]);
+			size_t size = m_readWidth * m_readHeight;
+			const float* p = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size * sizeof(float), GL_MAP_READ_BIT);
+			if (p)
+			{
+				m_readback.assign(p, p + size);
+				m_matrixReadback = m_matrixPBO[iPrev];
+			}
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+	}
+
+	// schedule the next download, unless the buffer is still busy
+	if (m_fences[m_iPBO] == NULL)
+	{
+		C3dglState::bindBuffer(GL_PIXEL_PACK_BUFFER, m_idPBO[m_iPBO]);
+		glGetTexImage(GL_TEXTURE_2D, m_readLevel, GL_RED, GL_FLOAT, NULL);
+		m_fences[m_iPBO] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		m_matrixPBO[m_iPBO] = m_matrixViewProj;
+		m_iPBO = iPrev;
+	}
+	C3dglState::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+bool C3dglHiZ::isVisible(const glm::vec3 aabb[2], glm::mat4 matrixModel) const
+{
+	if (m_readback.empty())
+		return true;
+
+	glm::mat4 m = m_matrixReadback * matrixModel;
+	glm::vec3 ndcMin(1), ndcMax(-1);
+	glm::ivec3 outMin(0), outMax(0);
+	bool bNear = false;
+	for (int c = 0; c < 8; c++)
+	{
+		glm::vec4 clip = m * glm::vec4(aabb[c & 1].x, aabb[(c >> 1) & 1].y, aabb[(c >> 2) & 1].z, 1);
+		outMin += glm::ivec3(glm::lessThan(glm::vec3(clip), -glm::vec3(clip.w)));
+		outMax += glm::ivec3(glm::greaterThan(glm::vec3(clip), glm::vec3(clip.w)));
+		if (clip.w <= 0)
+			bNear = true;
+		else
+		{
+			ndcMin = glm::min(ndcMin, glm::vec3(clip) / clip.w);
+			ndcMax = glm::max(ndcMax, glm::vec3(clip) / clip.w);
+		}
+	}
+
+	// outside the frustum
+	if (glm::any(glm::equal(outMin, glm::ivec3(8))) || glm::any(glm::equal(outMax, glm::ivec3(8))))
+		return false;
+	// crossing the near plane
+	if (bNear)
+		return true;
+
+	// visible if any texel covered by the box is farther than the box's nearest point
+	// level 0 pixels covered by the box, mapped to the readback level the same way as in the GPU test:
+	// level sizes are rounded down, so pixel p lies in texel p >> m_readLevel - or in the last one, which absorbs the odd remainders
+	float z = ndcMin.z * 0.5f + 0.5f;
+	int x0 = std::min(glm::clamp((int)floor((ndcMin.x * 0.5f + 0.5f) * m_width), 0, m_width - 1) >> m_readLevel, m_readWidth - 1);
+	int x1 = std::min(glm::clamp((int)floor((ndcMax.x * 0.5f + 0.5f) * m_width), 0, m_width - 1) >> m_readLevel, m_readWidth - 1);
+	int y0 = std::min(glm::clamp((int)floor((ndcMin.y * 0.5f + 0.5f) * m_height), 0, m_height - 1) >> m_readLevel, m_readHeight - 1);
+	int y1 = std::min(glm::clamp((int)floor((ndcMax.y * 0.5f + 0.5f) * m_height), 0, m_height - 1) >> m_readLevel, m_readHeight - 1);
+	for (int y = y0; y <= y1; y++)
+		for (int x = x0; x <= x1; x++)
+			if (z <= m_readback[y * m_readWidth + x])
+				return true;
+	return false;
+}
+
+void C3dglHiZ::cullInstances(GLuint idSrc, GLuint idDst, size_t nInstances, GLuint idIndirect, size_t nCommands, const glm::vec3 aabb[2], glm::mat4 matrixViewProj)
+{
+	if (nCommands == 0) return;
+	const size_t stride = sizeof(DRAW_ELEMENTS_INDIRECT_COMMAND);
+	const GLintptr offsetCount = offsetof(DRAW_ELEMENTS_INDIRECT_COMMAND, instanceCount);
+
+	GLuint nVisible = 0;
+	if (!m_bCompute)
+	{
+		// no culling available: render all
+		C3dglState::bindBuffer(GL_COPY_READ_BUFFER, idSrc);
+		C3dglState::bindBuffer(GL_COPY_WRITE_BUFFER, idDst);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, nInstances * sizeof(glm::vec3));
+		C3dglState::bindBuffer(GL_COPY_READ_BUFFER, 0);
+		nVisible = (GLuint)nInstances;
+	}
+	C3dglState::bindBuffer(GL_COPY_WRITE_BUFFER, idIndirect);
+	for (size_t i = 0; i < nCommands; i++)
+		glBufferSubData(GL_COPY_WRITE_BUFFER, i * stride + offsetCount, sizeof(GLuint), &nVisible);
+	C3dglState::bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	if (!m_bCompute)
+		return;
+
+	GLenum prevActiveTexture = C3dglState::getActiveTexture();
+	GLuint prevTexture = C3dglState::getTexture(GL_TEXTURE0, GL_TEXTURE_2D);
+	C3dglState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, m_idPyramid);
+	C3dglProgram* pPrevProgram = C3dglProgram::getCurrentProgram();
+
+	m_progCull.sendUniform("nInstances", (GLuint)nInstances);
+	m_progCull.sendUniform("matrixViewProj", matrixViewProj);
+	m_progCull.sendUniform("matrixHiZ", m_matrixViewProj);
+	m_progCull.sendUniform("aabbMin", aabb[0]);
+	m_progCull.sendUniform("aabbMax", aabb[1]);
+	m_progCull.sendUniform("pyramid", 0);
+	m_progCull.sendUniform("bOcclusion", m_bBuilt);
+
+	C3dglState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, idSrc);
+	C3dglState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, idDst);
+	C3dglState::bindBufferRange(GL_SHADER_STORAGE_BUFFER, 2, idIndirect, 0, stride);
+	glDispatchCompute((GLuint)((nInstances + 63) / 64), 1, 1);
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+	for (GLuint i = 0; i < 3; i++)
+		C3dglState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, i, 0);
+
+	// all meshes share the same instances: propagate the count from the first command
+	C3dglState::bindBuffer(GL_COPY_READ_BUFFER, idIndirect);
+	C3dglState::bindBuffer(GL_COPY_WRITE_BUFFER, idIndirect);
+	for (size_t i = 1; i < nCommands; i++)
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offsetCount, i * stride + offsetCount, sizeof(GLuint));
+	C3dglState::bindBuffer(GL_COPY_READ_BUFFER, 0);
+	C3dglState::bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	C3dglState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, prevTexture);
+	C3dglState::activeTexture(prevActiveTexture);
+	if (pPrevProgram) pPrevProgram->use();
+}
+
+/*********************************************************************************
+** class C3dglHiZInstances
+*/
+
+bool C3dglHiZInstances::create(C3dglModel* pModel, GLint attrLocation, size_t instances, const glm::vec3* data)
+{
+	destroy();
+	if (attrLocation == -1)
+		return log(M3DGL_ERROR_ATTRIBUTE_NOT_FOUND);
+
+	m_pModel = pModel;
+	m_nInstances = instances;
+	m_positions.assign(data, data + instances);
+
+	// source and destination buffers; initially all instances are visible
+	glGenBuffers(1, &m_idSrc);
+	C3dglState::bindBuffer(GL_ARRAY_BUFFER, m_idSrc);
+	glBufferData(GL_ARRAY_BUFFER, instances * sizeof(glm::vec3), data, GL_STATIC_DRAW);
+	glGenBuffers(1, &m_idDst);
+	C3dglState::bindBuffer(GL_ARRAY_BUFFER, m_idDst);
+	glBufferData(GL_ARRAY_BUFFER, instances * sizeof(glm::vec3), data, GL_DYNAMIC_COPY);
+	C3dglState::bindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// indirect draw commands: one per mesh
+	std::vector<DRAW_ELEMENTS_INDIRECT_COMMAND> commands;
+	for (size_t i = 0; i < pModel->getMeshCount(); i++)
+	{
+		const C3dglMesh* pMesh = pModel->getMesh(i);
+		commands.push_back({ (GLuint)pMesh->getIndexCount(), (GLuint)instances, pMesh->getFirstIndex(), pMesh->getBaseVertex(), 0 });
+	}
+	glGenBuffers(1, &m_idIndirect);
+	C3dglState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, m_idIndirect);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DRAW_ELEMENTS_INDIRECT_COMMAND), commands.data(), GL_DYNAMIC_DRAW);
+	C3dglState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	for (size_t i = 0; i < pModel->getMeshCount(); i++)
+		pModel->getMesh(i)->addAttribPointer(attrLocation, m_idDst, instances, 3, 0, 0, 1);
+	return true;
+}
+
+void C3dglHiZInstances::destroy()
+{
+	if (m_idSrc) C3dglState::deleteBuffers(1, &m_idSrc);
+	if (m_idDst) C3dglState::deleteBuffers(1, &m_idDst);
+	if (m_idIndirect) C3dglState::deleteBuffers(1, &m_idIndirect);
+	m_idSrc = m_idDst = m_idIndirect = 0;
+	m_nInstances = 0;
+	m_positions.clear();
+	m_order.clear();
+	m_sortEye = glm::vec3(FLT_MAX);
+	m_pModel = NULL;
+}
+
+void C3dglHiZInstances::update(size_t first, size_t count, const glm::vec3* data)
+{
+	if (first + count > m_nInstances)
+	{
+		log(M3DGL_ERROR_BUFFER_OVERFLOW, first + count, m_nInstances);
+		return;
+	}
+	std::copy(data, data + count, m_positions.begin() + first);
+	if (!m_order.empty())
+	{
+		// sorted: the instances are scattered in the buffer - re-sort from the same eye position
+		glm::vec3 eye = m_sortEye;
+		m_sortEye = glm::vec3(FLT_MAX);
+		sort(eye);
+		return;
+	}
+	C3dglState::bindBuffer(GL_ARRAY_BUFFER, m_idSrc);
+	glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(glm::vec3), count * sizeof(glm::vec3), data);
+	C3dglState::bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+bool C3dglHiZInstances::sort(glm::vec3 eye, float minMove)
+{
+	if (m_positions.empty() || glm::distance(eye, m_sortEye) < minMove)
+		return false;
+	m_sortEye = eye;
+
+	m_order.resize(m_nInstances);
+	sortFrontToBack(m_positions.data(), m_nInstances, eye, m_order.data());
+	std::vector<glm::vec3> sorted(m_nInstances);
+	for (size_t i = 0; i < m_nInstances; i++)
+		sorted[i] = m_positions[m_order[i]];
+
+	C3dglState::bindBuffer(GL_ARRAY_BUFFER, m_idSrc);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, m_nInstances * sizeof(glm::vec3), sorted.data());
+	C3dglState::bindBuffer(GL_ARRAY_BUFFER, 0);
+	return true;
+}
+
+void C3dglHiZInstances::cull(C3dglHiZ& hiz, glm::mat4 matrixModel, glm::mat4 matrixViewProj)
+{
+	if (!m_pModel) return;
+
+	// world bounding box of the model at the origin
+	glm::vec3 aabb[2];
+	m_pModel->getAABB(aabb, matrixModel);
+
+	hiz.cullInstances(m_idSrc, m_idDst, m_nInstances, m_idIndirect, m_pModel->getMeshCount(), aabb, matrixViewProj);
+}
+
+void C3dglHiZInstances::render(glm::mat4 matrix, C3dglProgram* pProgram) const
+{
+	if (m_pModel)
+		m_pModel->renderIndirect(matrix, m_idIndirect, pProgram);
+}
@@ -12,7 +12,15 @@ Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
 #include <map>
 #include <set>
 
-#include <GL/glut.h>
+// console colours
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cstdio>
+#include <unistd.h>
+#endif
 
 using namespace _3dgl;
 
@@ -32,6 +40,7 @@ C3dglLogger::C3dglLogger()
 	operator[](M3DGL_SUCCESS_VERIFICATION) = "verification result: {}.";
 	operator[](M3DGL_SUCCESS_LOADED) = "loaded from: {}.";
 	operator[](M3DGL_SUCCESS_LOADED_FROM_EMBED_FILE) = "loaded from embedded file: {}.";
+	operator[](M3DGL_SUCCESS_UNIFORM_BLOCK_FOUND) = "uniform block found: {} at binding point {}.";
 
 	operator[](M3DGL_WARNING_GENERIC) = "{}";
 	operator[](M3DGL_WARNING_UNIFORM_NOT_FOUND) = "uniform location not found: {}.";
@@ -78,6 +87,11 @@ C3dglLogger::C3dglLogger()
 	operator[](M3DGL_WARNING_CANNOT_LOAD) = "couldn't load from: {}.";
 	operator[](M3DGL_WARNING_CANNOT_LOAD_FROM_EMBED_FILE) = "couldn't load from embedded file: {}.";
 	operator[](M3DGL_WARNING_EMBED_FILE_UNKNOWN_FORMAT) = "encountered unknown file format {} in embedded file: {}.";
+	operator[](M3DGL_WARNING_PERSISTENT_BUFFERS_NOT_SUPPORTED) = "cannot create a ring buffer: persistent mapped buffers (GL_ARB_buffer_storage) are not supported. A dynamic buffer will be used instead.";
+	operator[](M3DGL_WARNING_COMPUTE_SHADERS_NOT_SUPPORTED) = "GPU culling requires compute shaders (GL_ARB_compute_shader) and storage buffers (GL_ARB_shader_storage_buffer_object). Instances will be rendered without culling.";
+	operator[](M3DGL_WARNING_GEOMETRY_POOL_NOT_USED) = "cannot store the object in the geometry pool (16 or 32-bit indices and the programmable pipeline required). Separate buffers will be used.";
+	operator[](M3DGL_WARNING_BATCH_NOT_AVAILABLE) = "multi-draw batch not created: all meshes must be stored in the same arena of a geometry pool, and GL_ARB_multi_draw_indirect, GL_ARB_shader_storage_buffer_object and GL_ARB_shader_draw_parameters (or GL 4.6) are required.";
+	operator[](M3DGL_WARNING_TIMER_QUERIES_NOT_SUPPORTED) = "GPU profiling requires timer queries (GL_ARB_timer_query). No GPU times will be measured.";
 
 	operator[](M3DGL_ERROR_GENERIC) = "{}";
 	operator[](M3DGL_ERROR_TYPE_MISMATCH) = "type mismatch in uniform: {}: sending value of {} but {} was expected.";
@@ -95,6 +109,12 @@ C3dglLogger::C3dglLogger()
 	operator[](M3DGL_ERROR_UNKNOWN_LINKING_ERROR) = "unknown linking error";
 
 	operator[](M3DGL_INTERNAL_ERROR) = "INTERNAL ERROR";
+
+	operator[](M3DGL_ERROR_BUFFER_NOT_FOUND) = "buffer update failed. No buffer created for the attribute location {}.";
+	operator[](M3DGL_ERROR_BUFFER_OVERFLOW) = "buffer update failed. Elements up to {} requested but the buffer only holds {}.";
+	operator[](M3DGL_ERROR_POOLED_VERTEX_BUFFER) = "vertex buffers cannot be added to an object stored in a geometry pool - the pool's VAO is shared with other objects.";
+	operator[](M3DGL_ERROR_FRAMEBUFFER_INCOMPLETE) = "framebuffer incomplete, status: {:#x}.";
+	operator[](M3DGL_ERROR_HEADLESS_CONTEXT) = "cannot create a headless OpenGL context: {}.";
 }
 
 C3dglLogger& C3dglLogger::getInstance()
@@ -137,6 +157,7 @@ bool C3dglLogger::_log(unsigned nCode, std::string name, std::string message)
 
 	if (bFirstTimeSeen || (getOptions() & LOGGER_COLLAPSE_MESSAGES) == 0)
 	{
+#ifdef _WIN32
 		CONSOLE_SCREEN_BUFFER_INFO Info;
 		GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &Info);
 		switch (nSeverity)
@@ -146,6 +167,16 @@ bool C3dglLogger::_log(unsigned nCode, std::string name, std::string message)
 		}
 		log(msg);
 		SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), Info.wAttributes);
+#else
+		// ANSI escape sequences: yellow and bright red - only if the output is a terminal, not redirected to a file
+		static const bool bTerminal = isatty(fileno(stdout)) != 0;
+		static const char* colours[] = { "", "\033[33m", "\033[1;31m" };
+		if (bTerminal && nSeverity)
+			std::cout << colours[nSeverity];
+		log(msg);
+		if (bTerminal && nSeverity)
+			std::cout << "\033[0m" << std::flush;
+#endif
 	}
 	return (nSeverity <= 1);
 }
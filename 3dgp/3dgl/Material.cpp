@@ -9,6 +9,8 @@ Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
 #include <3dgl/Bitmap.h>
 #include <3dgl/Model.h>
 #include <3dgl/Shader.h>
+#include <3dgl/State.h>
+#include <3dgl/Tools.h>
 
 // assimp include file
 #include <assimp/scene.h>
@@ -20,6 +22,8 @@ unsigned C3dglMaterial::c_idTexBlank = 0xFFFFFFFF;
 C3dglMaterial::C3dglMaterial(C3dglModel* pOwner) : m_pOwner(pOwner)
 {
 	memset(m_idTexture, 0xFFFFFFFF, sizeof(m_idTexture));
+	memset(m_idTexArray, 0, sizeof(m_idTexArray));
+	memset(m_texLayer, 0xFF, sizeof(m_texLayer));
 	m_bAmb = m_bDiff = m_bSpec = m_bEmiss = m_bShininess = false;
 
 	memset(&m_amb, 0, sizeof(m_amb));
@@ -59,21 +63,15 @@ void C3dglMaterial::destroy()
 {
 	for (unsigned& idTexture : m_idTexture)
 		if (idTexture != 0xffffffff)
-			glDeleteTextures(1, &idTexture);
+			C3dglState::deleteTextures(1, &idTexture);
 }
 
 void C3dglMaterial::render(C3dglProgram *pProgram) const
 {
+	// back up the current state - see postRender
 	for (unsigned texUnit = GL_TEXTURE0; texUnit <= GL_TEXTURE31; texUnit++)
-	{
-		unsigned idTex;
-		if (getTexture(texUnit, idTex))
-		{
-			glGetIntegerv(GL_TEXTURE_BINDING_2D, (GLint*) & m_back_idTexture[texUnit - GL_TEXTURE0]);
-			glActiveTexture(texUnit);
-			glBindTexture(GL_TEXTURE_2D, idTex);
-		}
-	}
+		if (getTexture(texUnit))
+			m_back_idTexture[texUnit - GL_TEXTURE0] = C3dglState::getTexture(texUnit, GL_TEXTURE_2D);
 
 	if (!pProgram)
 		pProgram = C3dglProgram::getCurrentProgram();
@@ -85,7 +83,25 @@ void C3dglMaterial::render(C3dglProgram *pProgram) const
 		if (getSpecular()) pProgram->retrieveUniform(UNI_MAT_SPECULAR, m_back_spec);
 		if (getEmissive()) pProgram->retrieveUniform(UNI_MAT_EMISSIVE, m_back_emiss);
 		if (getShininess()) pProgram->retrieveUniform(UNI_MAT_SHININESS, m_back_shininess);
+	}
+
+	bind(pProgram);
+}
+
+void C3dglMaterial::bind(C3dglProgram* pProgram) const
+{
+	for (unsigned texUnit = GL_TEXTURE0; texUnit <= GL_TEXTURE31; texUnit++)
+	{
+		unsigned idTex;
+		if (getTexture(texUnit, idTex))
+			C3dglState::bindTexture(texUnit, GL_TEXTURE_2D, idTex);
+	}
 
+	if (!pProgram)
+		pProgram = C3dglProgram::getCurrentProgram();
+
+	if (pProgram)
+	{
 		glm::vec3 vec;
 		if (getAmbient(vec)) pProgram->sendUniform(UNI_MAT_AMBIENT, vec);
 		if (getDiffuse(vec)) pProgram->sendUniform(UNI_MAT_DIFFUSE, vec);
@@ -102,8 +118,7 @@ void C3dglMaterial::postRender(C3dglProgram* pProgram) const
 	{
 		if (getTexture(texUnit))
 		{
-			glActiveTexture(texUnit);
-			glBindTexture(GL_TEXTURE_2D, m_back_idTexture[texUnit - GL_TEXTURE0]);
+			C3dglState::bindTexture(texUnit, GL_TEXTURE_2D, m_back_idTexture[texUnit - GL_TEXTURE0]);
 		}
 	}
 
@@ -156,15 +171,7 @@ void C3dglMaterial::loadTexture(GLenum texUnit, std::string strPath)
 	C3dglBitmap bm;
 	if (bm.load(strPath, GL_RGBA))
 	{
-		// generate texture id
-		glGenTextures(1, &m_idTexture[texUnit - GL_TEXTURE0]);
-
-		// load texture
-		glActiveTexture(texUnit);
-		glBindTexture(GL_TEXTURE_2D, m_idTexture[texUnit - GL_TEXTURE0]);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, bm.getWidth(), bm.getHeight(), 0, GL_RGBA, GL_UNSIGNED_BYTE, bm.getBits());
+		m_idTexture[texUnit - GL_TEXTURE0] = createTexture2D(bm.getWidth(), abs(bm.getHeight()), GL_RGBA, bm.getBits(), GL_REPEAT, texUnit);
 	}
 }
 
@@ -174,15 +181,7 @@ void C3dglMaterial::loadTexture(GLenum texUnit, const aiTexture* pTexture)
 	C3dglBitmap bm;
 	if (bm.load(pTexture, GL_RGBA))
 	{
-		// generate texture id
-		glGenTextures(1, &m_idTexture[texUnit - GL_TEXTURE0]);
-
-		// load texture
-		glActiveTexture(texUnit);
-		glBindTexture(GL_TEXTURE_2D, m_idTexture[texUnit - GL_TEXTURE0]);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, bm.getWidth(), bm.getHeight(), 0, GL_RGBA, GL_UNSIGNED_BYTE, bm.getBits());
+		m_idTexture[texUnit - GL_TEXTURE0] = createTexture2D(bm.getWidth(), abs(bm.getHeight()), GL_RGBA, bm.getBits(), GL_REPEAT, texUnit);
 	}
 }
 
@@ -190,12 +189,8 @@ void C3dglMaterial::loadTexture(GLenum texUnit)
 {
 	if (c_idTexBlank == 0xffffffff)
 	{
-		glGenTextures(1, &c_idTexBlank);
-		glActiveTexture(texUnit);
-		glBindTexture(GL_TEXTURE_2D, c_idTexBlank);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		unsigned char bytes[] = { 255, 255, 255 };
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_BGR, GL_UNSIGNED_BYTE, &bytes);
+		unsigned char bytes[] = { 255, 255, 255, 255 };
+		c_idTexBlank = createTexture2D(1, 1, GL_RGBA, bytes, GL_REPEAT, texUnit);
 	}
 	m_idTexture[texUnit - GL_TEXTURE0] = c_idTexBlank;
 }
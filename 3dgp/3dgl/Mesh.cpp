@@ -5,6 +5,7 @@ Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
 *********************************************************************************/
 #include "pch.h"
 #include <iostream>
+#include <algorithm>
 #include <3dgl/Mesh.h>
 #include <3dgl/Model.h>
 #include <3dgl/Shader.h>
@@ -14,6 +15,7 @@ Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
 
 // GLM include files
 #include "../glm/gtc/type_ptr.hpp"
+#include "../glm/gtc/packing.hpp"
 
 using namespace _3dgl;
 
@@ -27,7 +29,7 @@ C3dglMesh::C3dglMesh(C3dglModel* pOwner) : C3dglVertexAttrObject(ATTR_COUNT), m_
 	m_matIndex = 0;
 }
 
-size_t C3dglMesh::getBuffers(const aiMesh* pMesh, const GLint* attrId, size_t attrCount, void** attrData, size_t* attrSize) const
+size_t C3dglMesh::getBuffers(const aiMesh* pMesh, const GLint* attrId, size_t attrCount, void** attrData, size_t* attrSize, bool bQuantized, unsigned* pQuantized) const
 {
 	// initialise outputs
 	std::fill(attrData, attrData + attrCount, (void*)NULL);
@@ -110,11 +112,16 @@ size_t C3dglMesh::getBuffers(const aiMesh* pMesh, const GLint* attrId, size_t at
 	size_t _size[] = { sizeof(pMesh->mVertices[0]), sizeof(pMesh->mNormals[0]), sizeof(pTexCoords[0]) * nUVComponents,
 		sizeof(pMesh->mTangents[0]), sizeof(pMesh->mBitangents[0]), sizeof(pMesh->mColors[0][0]), sizeof(pBoneIds[0]) * MAX_BONES_PER_VERTEX, sizeof(pBoneWeights[0]) * MAX_BONES_PER_VERTEX };
 
+	// Quantized formats - the full precision buffers created above are converted and released
+	unsigned quantized = bQuantized ? quantize(pMesh, attrId, attrCount, _data, _size) : 0;
+	bool bQuantizedTangents = (quantized & (1 << ATTR_TANGENT)) != 0;
+	if (pQuantized) *pQuantized = quantized;
+
 	// collect the actual buffer data
 	for (unsigned attr = 0; attr < attrCount; attr++)
 		if (attrId[attr] != -1)
 		{
-			if (!_data[attr])
+			if (!_data[attr] && !(attr == ATTR_BITANGENT && bQuantizedTangents))	// quantized bitangents are rebuilt by the shader
 				log(M3DGL_WARNING_VERTEX_BUFFER_MISSING + attr);
 			attrData[attr] = _data[attr];
 			attrSize[attr] = _size[attr];
@@ -123,6 +130,108 @@ size_t C3dglMesh::getBuffers(const aiMesh* pMesh, const GLint* attrId, size_t at
 	return nVertices;
 }
 
+unsigned C3dglMesh::quantize(const aiMesh* pMesh, const GLint* attrId, size_t attrCount, void** _data, size_t* _size) const
+{
+	size_t nVertices = pMesh->mNumVertices;
+	unsigned quantized = 0;
+	auto required = [&](unsigned attr) { return attrCount > attr && attrId[attr] != -1 && _data[attr] != NULL; };
+
+	// normals: 10_10_10_2 signed normalized
+	if (required(ATTR_NORMAL))
+	{
+		GLuint* pNormals = new GLuint[nVertices];
+		for (size_t i = 0; i < nVertices; i++)
+			pNormals[i] = glm::packSnorm3x10_1x2(glm::vec4(glm::make_vec3(&pMesh->mNormals[i].x), 0));
+		_data[ATTR_NORMAL] = pNormals;
+		_size[ATTR_NORMAL] = sizeof(GLuint);
+		quantized |= 1 << ATTR_NORMAL;
+	}
+
+	// texture coords: half floats
+	if (required(ATTR_TEXCOORD))
+	{
+		GLfloat* pTexCoords = (GLfloat*)_data[ATTR_TEXCOORD];
+		GLuint* pHalfCoords = new GLuint[nVertices];
+		for (size_t i = 0; i < nVertices; i++)
+			pHalfCoords[i] = glm::packHalf2x16(glm::make_vec2(&pTexCoords[i * 2]));
+		delete[] pTexCoords;
+		_data[ATTR_TEXCOORD] = pHalfCoords;
+		_size[ATTR_TEXCOORD] = sizeof(GLuint);
+		quantized |= 1 << ATTR_TEXCOORD;
+	}
+
+	// tangents: 10_10_10_2 signed normalized, w = handedness; the bitangent is not stored: bitangent = cross(normal, tangent.xyz) * tangent.w
+	if (required(ATTR_TANGENT) && pMesh->mNormals)
+	{
+		GLuint* pTangents = new GLuint[nVertices];
+		for (size_t i = 0; i < nVertices; i++)
+		{
+			glm::vec3 normal = glm::make_vec3(&pMesh->mNormals[i].x);
+			glm::vec3 tangent = glm::make_vec3(&pMesh->mTangents[i].x);
+			float w = 1;
+			if (pMesh->mBitangents && glm::dot(glm::cross(normal, tangent), glm::make_vec3(&pMesh->mBitangents[i].x)) < 0)
+				w = -1;
+			pTangents[i] = glm::packSnorm3x10_1x2(glm::vec4(tangent, w));
+		}
+		_data[ATTR_TANGENT] = pTangents;
+		_size[ATTR_TANGENT] = sizeof(GLuint);
+		_data[ATTR_BITANGENT] = NULL;
+		quantized |= 1 << ATTR_TANGENT;
+	}
+
+	// colours: unsigned normalized bytes
+	if (required(ATTR_COLOR))
+	{
+		GLuint* pColors = new GLuint[nVertices];
+		for (size_t i = 0; i < nVertices; i++)
+			pColors[i] = glm::packUnorm4x8(glm::make_vec4(&pMesh->mColors[0][i].r));
+		_data[ATTR_COLOR] = pColors;
+		_size[ATTR_COLOR] = sizeof(GLuint);
+		quantized |= 1 << ATTR_COLOR;
+	}
+
+	// bone ids: bytes - if all the ids fit
+	if (required(ATTR_BONE_ID))
+	{
+		unsigned* pBoneIds = (unsigned*)_data[ATTR_BONE_ID];
+		if (*std::max_element(pBoneIds, pBoneIds + nVertices * MAX_BONES_PER_VERTEX) <= 255)
+		{
+			GLubyte* pByteIds = new GLubyte[nVertices * MAX_BONES_PER_VERTEX];
+			std::copy(pBoneIds, pBoneIds + nVertices * MAX_BONES_PER_VERTEX, pByteIds);
+			delete[] pBoneIds;
+			_data[ATTR_BONE_ID] = pByteIds;
+			_size[ATTR_BONE_ID] = sizeof(GLubyte) * MAX_BONES_PER_VERTEX;
+			quantized |= 1 << ATTR_BONE_ID;
+		}
+	}
+
+	// bone weights: unsigned normalized bytes; the rounding error goes to the largest weight, so that the weights still sum up to 1
+	if (required(ATTR_BONE_WEIGHT))
+	{
+		float* pBoneWeights = (float*)_data[ATTR_BONE_WEIGHT];
+		GLubyte* pByteWeights = new GLubyte[nVertices * MAX_BONES_PER_VERTEX];
+		for (size_t i = 0; i < nVertices * MAX_BONES_PER_VERTEX; i += MAX_BONES_PER_VERTEX)
+		{
+			int total = 0;
+			unsigned jMax = 0;
+			for (unsigned j = 0; j < MAX_BONES_PER_VERTEX; j++)
+			{
+				pByteWeights[i + j] = pBoneWeights[i + j] > 0 ? glm::packUnorm1x8(pBoneWeights[i + j]) : 0;	// also filters out NaNs
+				total += pByteWeights[i + j];
+				if (pByteWeights[i + j] > pByteWeights[i + jMax]) jMax = j;
+			}
+			if (total > 0)
+				pByteWeights[i + jMax] = (GLubyte)glm::clamp(pByteWeights[i + jMax] + 255 - total, 0, 255);
+		}
+		delete[] pBoneWeights;
+		_data[ATTR_BONE_WEIGHT] = pByteWeights;
+		_size[ATTR_BONE_WEIGHT] = sizeof(GLubyte) * MAX_BONES_PER_VERTEX;
+		quantized |= 1 << ATTR_BONE_WEIGHT;
+	}
+
+	return quantized;
+}
+
 size_t C3dglMesh::getIndexBuffer(const aiMesh* pMesh, void** indexData, size_t* indSize) const
 {
 	*indexData = NULL;
@@ -144,10 +253,15 @@ size_t C3dglMesh::getIndexBuffer(const aiMesh* pMesh, void** indexData, size_t*
 	return nIndices * nVertPerFace;
 }
 
-void C3dglMesh::cleanUp(size_t attrCount, void** attrData, void *indexData) const
+void C3dglMesh::cleanUp(size_t attrCount, void** attrData, void *indexData, unsigned quantized) const
 {
 	if (!attrCount) attrCount = ATTR_COUNT_BASIC; // defaults for the fixed pipeline (== 3)
 
+	// quantized normals, tangents and colours are converted copies of the ASSIMP data - only those actually converted are ours to release
+	if ((quantized & (1 << ATTR_NORMAL)) && attrData && attrCount > ATTR_NORMAL && attrData[ATTR_NORMAL]) delete[] (GLuint*)attrData[ATTR_NORMAL];
+	if ((quantized & (1 << ATTR_TANGENT)) && attrData && attrCount > ATTR_TANGENT && attrData[ATTR_TANGENT]) delete[] (GLuint*)attrData[ATTR_TANGENT];
+	if ((quantized & (1 << ATTR_COLOR)) && attrData && attrCount > ATTR_COLOR && attrData[ATTR_COLOR]) delete[] (GLuint*)attrData[ATTR_COLOR];
+
 	if (attrData && attrCount > ATTR_TEXCOORD && attrData[ATTR_TEXCOORD]) delete[] attrData[ATTR_TEXCOORD];
 	if (attrData && attrCount > ATTR_BONE_ID && attrData[ATTR_BONE_ID]) delete[] attrData[ATTR_BONE_ID];
 	if (attrData && attrCount > ATTR_BONE_WEIGHT && attrData[ATTR_BONE_WEIGHT]) delete[] attrData[ATTR_BONE_WEIGHT];
@@ -169,7 +283,7 @@ void C3dglMesh::getBoundingVolume(const aiMesh* pMesh, size_t nVertices, glm::ve
 	}
 }
 
-void C3dglMesh::create(const aiMesh* pMesh, C3dglProgram* pProgram)
+void C3dglMesh::create(const aiMesh* pMesh, C3dglProgram* pProgram, bool bInterleaved, C3dglGeometryPool* pPool, bool bQuantized)
 {
 	if (!pMesh) return;
 
@@ -193,16 +307,18 @@ void C3dglMesh::create(const aiMesh* pMesh, C3dglProgram* pProgram)
 	// collect buffered attribute data
 	void* attrData[ATTR_COUNT];
 	size_t attrSize[ATTR_COUNT];
-	size_t nVertices = getBuffers(pMesh, attrId, attrCount, attrData, attrSize);
+	bQuantized = bQuantized && pProgram;	// no quantized formats in the fixed pipeline
+	unsigned quantized = 0;
+	size_t nVertices = getBuffers(pMesh, attrId, attrCount, attrData, attrSize, bQuantized, &quantized);
 
 	// collect index buffer data
 	void* indexData;
 	size_t indSize;
 	size_t nIndices = getIndexBuffer(pMesh, &indexData, &indSize);
 
-	C3dglVertexAttrObject::create(attrCount, nVertices, attrData, attrSize, nIndices, indexData, indSize, pProgram);
+	C3dglVertexAttrObject::create(attrCount, nVertices, attrData, attrSize, nIndices, indexData, indSize, pProgram, bInterleaved, pPool);
 
-	cleanUp(attrCount, attrData, indexData);
+	cleanUp(attrCount, attrData, indexData, quantized);
 
 	// Additional data...
 	getBoundingVolume(pMesh, nVertices, m_aabb[0], m_aabb[1]);
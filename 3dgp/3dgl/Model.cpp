@@ -7,6 +7,10 @@ Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
 #include <iostream>
 #include <3dgl/Model.h>
 #include <3dgl/Shader.h>
+#include <3dgl/Tools.h>
+#include <3dgl/State.h>
+#include <3dgl/RenderQueue.h>
+#include <3dgl/CommandList.h>
 
 // assimp include file
 #include "assimp/scene.h"
@@ -22,10 +26,16 @@ Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
 
 using namespace _3dgl;
 
-C3dglModel::C3dglModel() : C3dglObject(), m_globInvT(1)
+C3dglModel::C3dglModel() : C3dglObject(), m_globInvT(1), m_sortEye(FLT_MAX)
 { 
 	m_pScene = NULL; 
 	m_bFBXImportPreservePivots = false;
+	m_bInterleaved = false;
+	m_pPool = NULL;
+	m_bQuantized = false;
+	m_bCullingSphere = true;
+	m_pQueue = NULL;
+	m_queuePass = 0;
 }
 
 bool C3dglModel::load(const char* filename, unsigned int flags, C3dglProgram* pProgram)
@@ -64,7 +74,90 @@ void C3dglModel::create(const aiScene* pScene, C3dglProgram *pProgram)
 	m_meshes.resize(m_pScene->mNumMeshes, C3dglMesh(this));
 	aiMesh** ppMesh = m_pScene->mMeshes;
 	for (C3dglMesh& mesh : m_meshes)
-		mesh.create(*ppMesh++, pProgram);
+		mesh.create(*ppMesh++, pProgram, m_bInterleaved, m_pPool, m_bQuantized);
+	flattenNodes();
+}
+
+void C3dglModel::flattenNodes()
+{
+	m_nodes.clear();
+	m_nodeMeshes.clear();
+	m_mainNodes.clear();
+	if (!m_pScene || !m_pScene->mRootNode)
+		return;
+
+	// depth-first; children pushed in reverse, so that they are visited in their original order
+	std::vector<std::pair<const aiNode*, int> > stack = { { m_pScene->mRootNode, -1 } };
+	while (!stack.empty())
+	{
+		const aiNode* pNode = stack.back().first;
+		int parent = stack.back().second;
+		stack.pop_back();
+
+		NODE node;
+		node.pNode = pNode;
+		node.global = glm::transpose(glm::make_mat4((GLfloat*)&pNode->mTransformation));
+		if (parent >= 0)
+			node.global = m_nodes[parent].global * node.global;
+		node.parent = parent;
+		node.end = 0;
+		node.firstMesh = (unsigned)m_nodeMeshes.size();
+		node.nMeshes = pNode->mNumMeshes;
+		m_nodeMeshes.insert(m_nodeMeshes.end(), pNode->mMeshes, pNode->mMeshes + pNode->mNumMeshes);
+
+		// bounds of the node's own meshes - for frustum culling
+		node.aabb[0] = glm::vec3(1e10f);
+		node.aabb[1] = glm::vec3(-1e10f);
+		for (unsigned k = 0; k < node.nMeshes; k++)
+		{
+			glm::vec3 bb[2];
+			m_meshes[pNode->mMeshes[k]].getAABB(bb);
+			transformAABB(bb, node.global, bb);
+			node.aabb[0] = glm::min(node.aabb[0], bb[0]);
+			node.aabb[1] = glm::max(node.aabb[1], bb[1]);
+		}
+		node.sphere = glm::vec4((node.aabb[0] + node.aabb[1]) * 0.5f, glm::length(node.aabb[1] - node.aabb[0]) * 0.5f);
+		node.subtreeAABB[0] = node.aabb[0];
+		node.subtreeAABB[1] = node.aabb[1];
+		if (parent == 0)
+			m_mainNodes.push_back((unsigned)m_nodes.size());
+		m_nodes.push_back(node);
+
+		for (unsigned i = pNode->mNumChildren; i > 0; i--)
+			stack.push_back(std::make_pair(pNode->mChildren[i - 1], (int)m_nodes.size() - 1));
+	}
+
+	// subtree ranges and bounds: a node's subtree ends where the next node outside of it begins.
+	// In the reverse order, all descendants of a node are complete by the time the node is reached
+	for (unsigned i = (unsigned)m_nodes.size(); i > 0; i--)
+	{
+		NODE& node = m_nodes[i - 1];
+		if (node.end == 0)
+			node.end = i;
+		node.subtreeSphere = glm::vec4((node.subtreeAABB[0] + node.subtreeAABB[1]) * 0.5f, glm::length(node.subtreeAABB[1] - node.subtreeAABB[0]) * 0.5f);
+		if (node.parent >= 0)
+		{
+			NODE& parent = m_nodes[node.parent];
+			parent.end = std::max(parent.end, node.end);
+			parent.subtreeAABB[0] = glm::min(parent.subtreeAABB[0], node.subtreeAABB[0]);
+			parent.subtreeAABB[1] = glm::max(parent.subtreeAABB[1], node.subtreeAABB[1]);
+		}
+	}
+}
+
+int C3dglModel::findNode(const aiNode* pNode) const
+{
+	for (size_t i = 0; i < m_nodes.size(); i++)
+		if (m_nodes[i].pNode == pNode)
+			return (int)i;
+	return -1;
+}
+
+glm::mat4 C3dglModel::getNodeBase(int iNode, glm::mat4 m) const
+{
+	// low-level functions take the parent's transform - convert it to the model transform the global node matrices are relative to
+	int parent = m_nodes[iNode].parent;
+	return parent >= 0 ? m * glm::inverse(m_nodes[parent].global) : m;
 }
 
 void C3dglModel::loadMaterials(const char* pTexRootPath)
@@ -108,6 +201,14 @@ unsigned C3dglModel::loadAnimations(C3dglModel* pCompatibleModel)
 
 void C3dglModel::destroy()
 {
+	if (m_idCellIndirect)
+		C3dglState::deleteBuffers(1, &m_idCellIndirect);
+	m_idCellIndirect = 0;
+	m_cells.clear();
+	m_instances.clear();
+	m_cellOrder.clear();
+	destroyBatch();
+
 	if (m_pScene)
 	{
 		for (C3dglMesh mesh : m_meshes)
@@ -116,43 +217,176 @@ void C3dglModel::destroy()
 			mat.destroy();
 		aiReleaseImport(m_pScene);
 		m_pScene = NULL;
+		m_nodes.clear();
+		m_nodeMeshes.clear();
+		m_mainNodes.clear();
 	}
 }
 
 void C3dglModel::renderNode(aiNode* pNode, glm::mat4 m, GLsizei instances, C3dglProgram* pProgram) const
 {
-	m *= glm::transpose(glm::make_mat4((GLfloat*)&pNode->mTransformation));
+	int i = findNode(pNode);
+	if (i >= 0)
+		renderNodes(i, m_nodes[i].end, getNodeBase(i, m), instances, pProgram, 0, 0);
+}
 
-	// render all meshes (and their materials)
-	for (unsigned iMesh : std::vector<unsigned>(pNode->mMeshes, pNode->mMeshes + pNode->mNumMeshes))
+void C3dglModel::renderNodes(unsigned first, unsigned end, glm::mat4 matrix, GLsizei instances, C3dglProgram* pProgram, GLuint idIndirect, GLsizei nDraws,
+	const C3dglFrustum* pFrustum) const
+{
+	unsigned insideEnd = first;		// nodes before insideEnd are known to be entirely inside the frustum
+	for (unsigned i = first; i < end; i++)
 	{
-		const C3dglMesh* pMesh = &m_meshes[iMesh];
-		const C3dglMaterial* pMaterial = pMesh->getMaterial();
-		if (pMaterial)
-			pMaterial->render(pProgram);
-		pMesh->render(m, instances, pProgram);
-		if (pMaterial)
-			pMaterial->postRender(pProgram);
+		const NODE& node = m_nodes[i];
+		if (pFrustum && i >= insideEnd)
+		{
+			// the subtree first: skipped as a whole if outside, no more tests within it if inside
+			C3dglFrustum::CLASS c = classifyBounds(*pFrustum, node.subtreeAABB, node.subtreeSphere);
+			if (c == C3dglFrustum::OUTSIDE)
+			{
+				i = node.end - 1;
+				continue;
+			}
+			if (c == C3dglFrustum::INSIDE)
+				insideEnd = node.end;
+			else if (node.nMeshes && classifyBounds(*pFrustum, node.aabb, node.sphere) == C3dglFrustum::OUTSIDE)
+				continue;
+		}
+		if (node.nMeshes == 0)
+			continue;
+		glm::mat4 m = matrix * node.global;
+
+		// render all meshes (and their materials)
+		for (unsigned k = node.firstMesh; k < node.firstMesh + node.nMeshes; k++)
+		{
+			unsigned iMesh = m_nodeMeshes[k];
+			const C3dglMesh* pMesh = &m_meshes[iMesh];
+			const C3dglMaterial* pMaterial = pMesh->getMaterial();
+			if (m_pQueue && nDraws == 0)
+			{
+				// deferred: depth of the mesh centre, in view space
+				glm::vec3 aabb[2];
+				pMesh->getAABB(aabb);
+				float depth = -(m * glm::vec4((aabb[0] + aabb[1]) * 0.5f, 1)).z;
+				m_pQueue->submit(pMesh, pMaterial, m, depth, instances, pProgram, m_queuePass);
+				continue;
+			}
+			if (pMaterial)
+				pMaterial->render(pProgram);
+			if (nDraws == 0)
+				pMesh->render(m, instances, pProgram);
+			else if (idIndirect)
+				pMesh->renderIndirect(m, idIndirect, iMesh * nDraws * sizeof(DRAW_ELEMENTS_INDIRECT_COMMAND), nDraws, pProgram);
+			else
+				pMesh->renderRanges(m, m_rangeFirst.data(), m_rangeCount.data(), nDraws, pProgram);
+			if (pMaterial)
+				pMaterial->postRender(pProgram);
+		}
 	}
+}
+
+void C3dglModel::record(C3dglCommandList& list, glm::mat4 matrix, GLsizei instances, C3dglProgram* pProgram, unsigned pass) const
+{
+	for (const NODE& node : m_nodes)
+	{
+		if (node.nMeshes == 0)
+			continue;
+		glm::mat4 m = matrix * node.global;
 
-	// draw all children
-	for (aiNode* p : std::vector<aiNode*>(pNode->mChildren, pNode->mChildren + pNode->mNumChildren))
-		renderNode(p, m, instances, pProgram);
+		// depth of the mesh centre, in view space - as with the render queue
+		for (unsigned k = node.firstMesh; k < node.firstMesh + node.nMeshes; k++)
+		{
+			const C3dglMesh* pMesh = &m_meshes[m_nodeMeshes[k]];
+			glm::vec3 aabb[2];
+			pMesh->getAABB(aabb);
+			float depth = -(m * glm::vec4((aabb[0] + aabb[1]) * 0.5f, 1)).z;
+			list.record(pMesh, pMesh->getMaterial(), m, depth, instances, pProgram, pass);
+		}
+	}
 }
 
 void C3dglModel::render(glm::mat4 matrix, GLsizei instances, C3dglProgram* pProgram) const
 { 
-	if (m_pScene->mRootNode) 
-		renderNode(m_pScene->mRootNode, matrix, instances, pProgram);
+	renderNodes(0, (unsigned)m_nodes.size(), matrix, instances, pProgram, 0, 0);
+}
+
+void C3dglModel::render(glm::mat4 matrix, glm::mat4 matrixProjection, C3dglProgram* pProgram) const
+{
+	// the frustum in the model coordinates, the same as the node bounds
+	C3dglFrustum frustum(matrixProjection * matrix);
+	renderNodes(0, (unsigned)m_nodes.size(), matrix, 1, pProgram, 0, 0, &frustum);
+}
+
+void C3dglModel::renderNode(aiNode* pNode, glm::mat4 m, glm::mat4 matrixProjection, C3dglProgram* pProgram) const
+{
+	int i = findNode(pNode);
+	if (i < 0) return;
+	glm::mat4 matrix = getNodeBase(i, m);
+	C3dglFrustum frustum(matrixProjection * matrix);
+	renderNodes(i, m_nodes[i].end, matrix, 1, pProgram, 0, 0, &frustum);
+}
+
+void C3dglModel::renderIndirect(glm::mat4 matrix, GLuint idIndirect, C3dglProgram* pProgram) const
+{
+	renderNodes(0, (unsigned)m_nodes.size(), matrix, 1, pProgram, idIndirect, 1);
+}
+
+void C3dglModel::render(glm::mat4 matrix, const C3dglFrustum& frustum, C3dglProgram* pProgram) const
+{
+	if (m_nodes.empty())
+		return;
+	if (m_cells.empty())
+	{
+		renderNodes(0, (unsigned)m_nodes.size(), matrix, 1, pProgram, 0, 0);
+		return;
+	}
+
+	// collect visible cells; neighbouring cells merge into a single range
+	m_rangeFirst.clear();
+	m_rangeCount.clear();
+	for (size_t i = 0; i < m_cells.size(); i++)
+	{
+		const CELL& cell = m_cells[m_cellOrder.empty() ? i : m_cellOrder[i]];
+		if (frustum.isVisible(cell.aabb))
+		{
+			if (!m_rangeFirst.empty() && m_rangeFirst.back() + m_rangeCount.back() == cell.first)
+				m_rangeCount.back() += cell.count;
+			else
+			{
+				m_rangeFirst.push_back(cell.first);
+				m_rangeCount.push_back(cell.count);
+			}
+		}
+	}
+	GLsizei nDraws = (GLsizei)m_rangeFirst.size();
+	if (nDraws == 0)
+		return;
+
+	// one multi-draw per mesh if possible; otherwise one instanced draw per range
+	if (m_idCellIndirect)
+	{
+		std::vector<DRAW_ELEMENTS_INDIRECT_COMMAND> commands;
+		commands.reserve(getMeshCount() * nDraws);
+		for (const C3dglMesh& mesh : m_meshes)
+			for (GLsizei i = 0; i < nDraws; i++)
+				commands.push_back({ (GLuint)mesh.getIndexCount(), (GLuint)m_rangeCount[i], mesh.getFirstIndex(), mesh.getBaseVertex(), m_rangeFirst[i] });
+		C3dglState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, m_idCellIndirect);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DRAW_ELEMENTS_INDIRECT_COMMAND), commands.data(), GL_STREAM_DRAW);
+	}
+	renderNodes(0, (unsigned)m_nodes.size(), matrix, 1, pProgram, m_idCellIndirect, nDraws);
 }
 
 void C3dglModel::render(unsigned iNode, glm::mat4 matrix, GLsizei instances, C3dglProgram* pProgram) const
 {
-	// update transform
-	matrix *= glm::transpose(glm::make_mat4((GLfloat*)&m_pScene->mRootNode->mTransformation));
+	// the global node transforms include the root transform
+	if (iNode < m_mainNodes.size())
+		renderNodes(m_mainNodes[iNode], m_nodes[m_mainNodes[iNode]].end, matrix, instances, pProgram, 0, 0);
+}
 
-	if (iNode <= getMainNodeCount())
-		renderNode(m_pScene->mRootNode->mChildren[iNode], matrix, instances, pProgram);
+C3dglFrustum::CLASS C3dglModel::classifyBounds(const C3dglFrustum& frustum, const glm::vec3 aabb[2], glm::vec4 sphere) const
+{
+	if (aabb[0].x > aabb[1].x)
+		return C3dglFrustum::OUTSIDE;	// no meshes
+	return m_bCullingSphere ? frustum.classify(aabb, glm::vec3(sphere), sphere.w) : frustum.classify(aabb);
 }
 
 unsigned C3dglModel::getMainNodeCount() const
@@ -172,6 +406,255 @@ void C3dglModel::createVertexBuffers(GLint attrLocation, size_t instances, GLint
 		getMesh(i)->createVertexBuffer(attrLocation, instances, size, data, stride, divisor, usage);
 }
 
+void C3dglModel::createRingVertexBuffers(GLint attrLocation, size_t instances, GLint size, float* data, GLsizei stride, GLuint divisor, unsigned nFrames)
+{
+	for (int i = 0; i < getMeshCount(); i++)
+		getMesh(i)->createRingVertexBuffer(attrLocation, instances, size, data, stride, divisor, nFrames);
+}
+
+void C3dglModel::createRingVertexBuffers(GLint attrLocation, size_t instances, GLint size, int* data, GLsizei stride, GLuint divisor, unsigned nFrames)
+{
+	for (int i = 0; i < getMeshCount(); i++)
+		getMesh(i)->createRingVertexBuffer(attrLocation, instances, size, data, stride, divisor, nFrames);
+}
+
+void C3dglModel::createInstanceCells(GLint attrLocation, size_t instances, const glm::vec3* data, float cellSize, glm::mat4 matrixModel, GLenum usage)
+{
+	m_cells.clear();
+	m_instances.clear();
+	m_cellOrder.clear();
+	m_sortEye = glm::vec3(FLT_MAX);
+	m_cellAttrLocation = attrLocation;
+	if (instances == 0 || cellSize <= 0)
+		return;
+
+	// grid extent (XZ plane)
+	glm::vec3 minPos = data[0], maxPos = data[0];
+	for (size_t i = 1; i < instances; i++)
+	{
+		minPos = glm::min(minPos, data[i]);
+		maxPos = glm::max(maxPos, data[i]);
+	}
+	size_t nx = (size_t)((maxPos.x - minPos.x) / cellSize) + 1;
+	size_t nz = (size_t)((maxPos.z - minPos.z) / cellSize) + 1;
+	auto cellOf = [&](const glm::vec3& p) { return (size_t)((p.z - minPos.z) / cellSize) * nx + (size_t)((p.x - minPos.x) / cellSize); };
+
+	// counting sort of the instances by cells
+	std::vector<GLuint> start(nx * nz + 1, 0);
+	for (size_t i = 0; i < instances; i++)
+		start[cellOf(data[i]) + 1]++;
+	for (size_t c = 0; c < nx * nz; c++)
+		start[c + 1] += start[c];
+	std::vector<GLuint> next(start.begin(), start.end() - 1);
+	m_instances.resize(instances);
+	for (size_t i = 0; i < instances; i++)
+		m_instances[next[cellOf(data[i])]++] = data[i];
+
+	// world bounding box of the model rendered at the origin
+	glm::vec3 aabb[2];
+	getAABB(aabb, matrixModel);
+
+	// non-empty cells
+	for (size_t c = 0; c < nx * nz; c++)
+		if (start[c + 1] > start[c])
+		{
+			CELL cell = { { glm::vec3(1e10f), glm::vec3(-1e10f) }, start[c], start[c + 1] - start[c] };
+			for (GLuint i = cell.first; i < cell.first + cell.count; i++)
+			{
+				cell.aabb[0] = glm::min(cell.aabb[0], aabb[0] + m_instances[i]);
+				cell.aabb[1] = glm::max(cell.aabb[1], aabb[1] + m_instances[i]);
+			}
+			m_cells.push_back(cell);
+		}
+
+	createVertexBuffers(attrLocation, instances, 3, (float*)m_instances.data(), 0, 1, usage);
+
+	if (GLEW_ARB_multi_draw_indirect && m_idCellIndirect == 0)
+		glGenBuffers(1, &m_idCellIndirect);
+}
+
+bool C3dglModel::createBatch(size_t instances, const glm::vec3* instanceData)
+{
+	destroyBatch();
+	if (!m_pScene || !m_pScene->mRootNode || m_meshes.empty())
+		return false;
+
+	// all meshes must share the pool's VAO and index type
+	// (the batch shader indexes the per-draw data with gl_BaseInstance: GL 4.6 or GL_ARB_shader_draw_parameters)
+	bool bAvailable = GLEW_ARB_multi_draw_indirect && GLEW_ARB_shader_storage_buffer_object && (GLEW_VERSION_4_6 || GLEW_ARB_shader_draw_parameters) && m_pPool;
+	for (const C3dglMesh& mesh : m_meshes)
+		if (mesh.getGeometryPool() != m_pPool || mesh.getVAOid() != m_meshes[0].getVAOid() || mesh.getIndexType() != m_meshes[0].getIndexType())
+			bAvailable = false;
+	if (!bAvailable)
+	{
+		log(M3DGL_WARNING_BATCH_NOT_AVAILABLE);
+		return false;
+	}
+
+	// per-draw data: one draw for each mesh of each node
+	struct DRAW { glm::mat4 matrix; GLuint material; GLuint pad[3]; };		// std430 layout
+	std::vector<DRAW> draws;
+	std::vector<const C3dglMesh*> meshes;
+	for (const NODE& node : m_nodes)
+		for (unsigned k = node.firstMesh; k < node.firstMesh + node.nMeshes; k++)
+		{
+			unsigned iMesh = m_nodeMeshes[k];
+			const C3dglMaterial* pMaterial = m_meshes[iMesh].getMaterial();
+			draws.push_back({ node.global, pMaterial ? (GLuint)getMaterialIndex(pMaterial) : 0xFFFFFFFF, { 0, 0, 0 } });
+			meshes.push_back(&m_meshes[iMesh]);
+		}
+
+	// group the draws by material, then merge the neighbouring groups with the same textures into runs
+	std::vector<unsigned> order(draws.size());
+	for (unsigned i = 0; i < order.size(); i++) order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&](unsigned a, unsigned b) { return draws[a].material < draws[b].material; });
+	auto sameTextures = [](const C3dglMaterial* p, const C3dglMaterial* q)
+	{
+		for (GLenum texUnit = GL_TEXTURE0; texUnit <= GL_TEXTURE31; texUnit++)
+		{
+			// pooled textures are identified by their array - materials differing only by the layer share the run
+			unsigned idP = 0xFFFFFFFF, idQ = 0xFFFFFFFF;
+			int layer;
+			if (p && !p->getTextureLayer(texUnit, idP, layer)) p->getTexture(texUnit, idP);
+			if (q && !q->getTextureLayer(texUnit, idQ, layer)) q->getTexture(texUnit, idQ);
+			if (idP != idQ) return false;
+		}
+		return true;
+	};
+
+	// indirect commands, in the run order. baseInstance identifies the draw - gl_InstanceID still counts from 0
+	std::vector<DRAW_ELEMENTS_INDIRECT_COMMAND> commands;
+	std::vector<DRAW> sortedDraws;
+	for (unsigned i : order)
+	{
+		const C3dglMesh* pMesh = meshes[i];
+		const C3dglMaterial* pMaterial = pMesh->getMaterial();
+		GLuint iDraw = (GLuint)commands.size();
+		commands.push_back({ (GLuint)pMesh->getIndexCount(), (GLuint)instances, pMesh->getFirstIndex(), pMesh->getBaseVertex(), iDraw });
+		sortedDraws.push_back(draws[i]);
+		if (m_batchRuns.empty() || !sameTextures(m_batchRuns.back().pMaterial, pMaterial))
+			m_batchRuns.push_back({ iDraw, 0, pMaterial });
+		m_batchRuns.back().count++;
+	}
+
+	// material data
+	struct MATERIAL { glm::vec4 ambient, diffuse, specular, emissive; glm::ivec4 layers; };
+	std::vector<MATERIAL> materials(std::max(m_materials.size(), (size_t)1), MATERIAL{ glm::vec4(0), glm::vec4(0), glm::vec4(0), glm::vec4(0), glm::ivec4(-1) });
+	for (size_t i = 0; i < m_materials.size(); i++)
+	{
+		glm::vec3 v;
+		float shininess = 0;
+		unsigned idArray;
+		int layer;
+		if (m_materials[i].getAmbient(v)) materials[i].ambient = glm::vec4(v, 1);
+		if (m_materials[i].getDiffuse(v)) materials[i].diffuse = glm::vec4(v, 1);
+		if (m_materials[i].getSpecular(v)) materials[i].specular = glm::vec4(v, 0);
+		if (m_materials[i].getEmissive(v)) materials[i].emissive = glm::vec4(v, 1);
+		if (m_materials[i].getShininess(shininess)) materials[i].specular.w = shininess;
+		for (int j = 0; j < BATCH_TEXTURE_ARRAYS; j++)
+			if (m_materials[i].getTextureLayer(GL_TEXTURE0 + j, idArray, layer)) materials[i].layers[j] = layer;
+	}
+
+	// instance data
+	std::vector<glm::vec4> offsets(std::max(instances, (size_t)1), glm::vec4(0));
+	if (instanceData)
+		for (size_t i = 0; i < instances; i++)
+			offsets[i] = glm::vec4(instanceData[i], 0);
+
+	auto createBuffer = [](GLenum target, GLuint& id, size_t size, const void* data)
+	{
+		glGenBuffers(1, &id);
+		C3dglState::bindBuffer(target, id);
+		glBufferData(target, size, data, GL_STATIC_DRAW);
+	};
+	createBuffer(GL_DRAW_INDIRECT_BUFFER, m_idBatchIndirect, commands.size() * sizeof(DRAW_ELEMENTS_INDIRECT_COMMAND), commands.data());
+	createBuffer(GL_SHADER_STORAGE_BUFFER, m_idBatchDraws, sortedDraws.size() * sizeof(DRAW), sortedDraws.data());
+	createBuffer(GL_SHADER_STORAGE_BUFFER, m_idBatchMaterials, materials.size() * sizeof(MATERIAL), materials.data());
+	createBuffer(GL_SHADER_STORAGE_BUFFER, m_idBatchInstances, offsets.size() * sizeof(glm::vec4), offsets.data());
+	C3dglState::bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	return true;
+}
+
+void C3dglModel::destroyBatch()
+{
+	GLuint ids[] = { m_idBatchIndirect, m_idBatchDraws, m_idBatchMaterials, m_idBatchInstances };
+	for (GLuint id : ids)
+		if (id) C3dglState::deleteBuffers(1, &id);
+	m_idBatchIndirect = m_idBatchDraws = m_idBatchMaterials = m_idBatchInstances = 0;
+	m_batchRuns.clear();
+}
+
+void C3dglModel::renderBatch(glm::mat4 matrix, C3dglProgram* pProgram) const
+{
+	if (!hasBatch())
+	{
+		render(matrix, 1, pProgram);
+		return;
+	}
+
+	C3dglState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, BATCH_DRAWS, m_idBatchDraws);
+	C3dglState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, BATCH_MATERIALS, m_idBatchMaterials);
+	C3dglState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, BATCH_INSTANCES, m_idBatchInstances);
+
+	// the meshes share the VAO: any of them can issue the draws
+	const C3dglMesh& mesh = m_meshes[0];
+	for (size_t i = 0; i < m_batchRuns.size(); i++)
+	{
+		const BATCH_RUN& run = m_batchRuns[i];
+		if (run.pMaterial)
+		{
+			run.pMaterial->render(pProgram);
+			unsigned idArray;
+			int layer;
+			for (int j = 0; j < BATCH_TEXTURE_ARRAYS; j++)
+				if (run.pMaterial->getTextureLayer(GL_TEXTURE0 + j, idArray, layer))
+					C3dglState::bindTexture(GL_TEXTURE0 + BATCH_TEXTURE_ARRAY0 + j, GL_TEXTURE_2D_ARRAY, idArray);
+		}
+		if (i == 0)
+			mesh.renderIndirect(matrix, m_idBatchIndirect, run.first * sizeof(DRAW_ELEMENTS_INDIRECT_COMMAND), run.count, pProgram);
+		else
+			mesh.renderIndirect(m_idBatchIndirect, run.first * sizeof(DRAW_ELEMENTS_INDIRECT_COMMAND), run.count);
+		if (run.pMaterial)
+			run.pMaterial->postRender(pProgram);
+	}
+}
+
+bool C3dglModel::sortInstances(glm::vec3 eye, float minMove)
+{
+	if (m_cells.empty() || glm::distance(eye, m_sortEye) < minMove)
+		return false;
+	m_sortEye = eye;
+
+	// instances within cells
+	std::vector<unsigned> order;
+	std::vector<glm::vec3> sorted;
+	for (const CELL& cell : m_cells)
+	{
+		order.resize(cell.count);
+		sorted.resize(cell.count);
+		sortFrontToBack(&m_instances[cell.first], cell.count, eye, order.data(), 16);
+		for (GLuint i = 0; i < cell.count; i++)
+			sorted[i] = m_instances[cell.first + order[i]];
+		std::copy(sorted.begin(), sorted.end(), m_instances.begin() + cell.first);
+	}
+
+	// cells, by the distance from the eye to the bounding box
+	std::vector<glm::vec3> nearest(m_cells.size());
+	for (size_t i = 0; i < m_cells.size(); i++)
+		nearest[i] = glm::clamp(eye, m_cells[i].aabb[0], m_cells[i].aabb[1]);
+	m_cellOrder.resize(m_cells.size());
+	sortFrontToBack(nearest.data(), nearest.size(), eye, m_cellOrder.data());
+
+	updateVertexBuffers(m_cellAttrLocation, 0, m_instances.size(), m_instances.data());
+	return true;
+}
+
+void C3dglModel::updateVertexBuffers(GLint attrLocation, size_t first, size_t count, const void* data)
+{
+	for (int i = 0; i < getMeshCount(); i++)
+		getMesh(i)->updateVertexBuffer(attrLocation, first, count, data);
+}
+
 void C3dglModel::addAttribPointers(GLint attrLocation, GLint attrFirstLocation, size_t instances, GLint size, GLsizei stride, size_t offset, GLuint divisor, GLenum usage)
 {
 	for (int i = 0; i < getMeshCount(); i++)
@@ -231,52 +714,32 @@ size_t C3dglModel::getOrAddBone(std::string boneName, glm::mat4 offsetMatrix)
 
 void C3dglModel::getAABB(glm::vec3 BB[2]) const
 { 
-	BB[0] = glm::vec3(1e10f, 1e10f, 1e10f);
-	BB[1] = glm::vec3(-1e10f, -1e10f, -1e10f);
-	if (m_pScene->mRootNode)
-		getAABB(m_pScene->mRootNode, BB); 
+	BB[0] = m_nodes.empty() ? glm::vec3(1e10f, 1e10f, 1e10f) : m_nodes[0].subtreeAABB[0];
+	BB[1] = m_nodes.empty() ? glm::vec3(-1e10f, -1e10f, -1e10f) : m_nodes[0].subtreeAABB[1];
 }
 
-void C3dglModel::getAABB(unsigned iNode, glm::vec3 BB[2]) const
+void C3dglModel::getAABB(glm::vec3 BB[2], const glm::mat4& matrix) const
 {
-	BB[0] = glm::vec3(1e10f, 1e10f, 1e10f);
-	BB[1] = glm::vec3(-1e10f, -1e10f, -1e10f);
+	getAABB(BB);
+	if (BB[0].x <= BB[1].x)
+		transformAABB(BB, matrix, BB);
+}
 
-	if (iNode <= getMainNodeCount())
-		getAABB(m_pScene->mRootNode->mChildren[iNode], BB, glm::transpose(glm::make_mat4((GLfloat*)&m_pScene->mRootNode->mTransformation)));
+void C3dglModel::getAABB(unsigned iNode, glm::vec3 BB[2]) const
+{
+	BB[0] = iNode < m_mainNodes.size() ? m_nodes[m_mainNodes[iNode]].subtreeAABB[0] : glm::vec3(1e10f, 1e10f, 1e10f);
+	BB[1] = iNode < m_mainNodes.size() ? m_nodes[m_mainNodes[iNode]].subtreeAABB[1] : glm::vec3(-1e10f, -1e10f, -1e10f);
 }
 
 void C3dglModel::getAABB(aiNode* pNode, glm::vec3 BB[2], glm::mat4 m) const
 {
-	m *= glm::transpose(glm::make_mat4((GLfloat*)&pNode->mTransformation));
-
-	for (unsigned iMesh : std::vector<unsigned>(pNode->mMeshes, pNode->mMeshes + pNode->mNumMeshes))
-	{
-		glm::vec3 bb[2];
-		m_meshes[iMesh].getAABB(bb);
-
-		glm::vec4 bb4[2];
-		bb4[0] = m * glm::vec4(bb[0], 1);
-		bb4[1] = m * glm::vec4(bb[1], 1);
-
-		BB[0].x = std::min(BB[0].x, bb4[0].x);
-		BB[0].y = std::min(BB[0].y, bb4[0].y);
-		BB[0].z = std::min(BB[0].z, bb4[0].z);
-		BB[0].x = std::min(BB[0].x, bb4[1].x);
-		BB[0].y = std::min(BB[0].y, bb4[1].y);
-		BB[0].z = std::min(BB[0].z, bb4[1].z);
-
-		BB[1].x = std::max(BB[1].x, bb4[0].x);
-		BB[1].y = std::max(BB[1].y, bb4[0].y);
-		BB[1].z = std::max(BB[1].z, bb4[0].z);
-		BB[1].x = std::max(BB[1].x, bb4[1].x);
-		BB[1].y = std::max(BB[1].y, bb4[1].y);
-		BB[1].z = std::max(BB[1].z, bb4[1].z);
-	}
-
-	// check all children
-	for (aiNode* p : std::vector<aiNode*>(pNode->mChildren, pNode->mChildren + pNode->mNumChildren))
-		getAABB(p, BB, m);
+	int i = findNode(pNode);
+	if (i < 0 || m_nodes[i].subtreeAABB[0].x > m_nodes[i].subtreeAABB[1].x)
+		return;
+	glm::vec3 bb[2];
+	transformAABB(m_nodes[i].subtreeAABB, getNodeBase(i, m), bb);
+	BB[0] = glm::min(BB[0], bb[0]);
+	BB[1] = glm::max(BB[1], bb[1]);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,166 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <3dgl/Profiler.h>
+#include <algorithm>
+
+using namespace _3dgl;
+
+/*********************************************************************************
+** class C3dglProfiler
+*/
+
+C3dglProfiler::C3dglProfiler(unsigned nFrames) : C3dglObject(), m_frames(std::max(nFrames, 2u)), m_iFrame(0), m_nDropped(0), m_bEnabled(false)
+{
+}
+
+bool C3dglProfiler::create()
+{
+	destroy();
+	if (!GLEW_VERSION_3_3 && !GLEW_ARB_timer_query)
+		return log(M3DGL_WARNING_TIMER_QUERIES_NOT_SUPPORTED);
+	m_bEnabled = true;
+	return true;
+}
+
+void C3dglProfiler::destroy()
+{
+	for (FRAME& frame : m_frames)
+	{
+		if (!frame.queries.empty())
+			glDeleteQueries((GLsizei)frame.queries.size(), frame.queries.data());
+		frame = FRAME();
+	}
+	m_names.clear();
+	m_paths.clear();
+	m_stack.clear();
+	m_order.clear();
+	m_iFrame = 0;
+	m_nDropped = 0;
+	m_bEnabled = false;
+}
+
+void C3dglProfiler::beginFrame()
+{
+	if (!m_bEnabled) return;
+
+	// scopes left open are not measured
+	if (!m_stack.empty())
+	{
+		FRAME& frame = m_frames[m_iFrame];
+		frame.scopes.resize(m_stack.front());
+		m_stack.clear();
+	}
+
+	m_iFrame = (m_iFrame + 1) % m_frames.size();
+	FRAME& frame = m_frames[m_iFrame];
+	collect(frame);
+	frame.nQueries = 0;
+	frame.scopes.clear();
+}
+
+void C3dglProfiler::begin(std::string name)
+{
+	if (!m_bEnabled) return;
+	FRAME& frame = m_frames[m_iFrame];
+
+	std::string path = m_stack.empty() ? name : m_names[frame.scopes[m_stack.back()].iName].path + "/" + name;
+	auto it = m_paths.find(path);
+	unsigned iName;
+	if (it == m_paths.end())
+	{
+		iName = (unsigned)m_names.size();
+		m_paths[path] = iName;
+		RESULT result;
+		result.path = path;
+		result.name = name;
+		result.depth = (unsigned)m_stack.size();
+		m_names.push_back(result);
+	}
+	else
+		iName = it->second;
+
+	SCOPE scope;
+	scope.iName = iName;
+	scope.idBegin = nextQuery(frame);
+	scope.idEnd = 0;
+	glQueryCounter(scope.idBegin, GL_TIMESTAMP);
+	m_stack.push_back((unsigned)frame.scopes.size());
+	frame.scopes.push_back(scope);
+}
+
+void C3dglProfiler::end()
+{
+	if (!m_bEnabled || m_stack.empty()) return;
+	FRAME& frame = m_frames[m_iFrame];
+	SCOPE& scope = frame.scopes[m_stack.back()];
+	m_stack.pop_back();
+	scope.idEnd = nextQuery(frame);
+	glQueryCounter(scope.idEnd, GL_TIMESTAMP);
+}
+
+double C3dglProfiler::getAverageTime(std::string path) const
+{
+	auto it = m_paths.find(path);
+	return it == m_paths.end() ? 0 : m_names[it->second].average;
+}
+
+void C3dglProfiler::print(int x, int y, glm::vec3 color, enum FONT font, int lineHeight) const
+{
+	for (size_t i = 0; i < m_order.size(); i++)
+	{
+		const RESULT& result = m_names[m_order[i]];
+		std::string indent(2 * result.depth, ' ');
+		_3dgl::print(x, y - (int)i * lineHeight, std::format("{:<24}{:7.3f} ms", indent + result.name, result.average), color, font);
+	}
+}
+
+GLuint C3dglProfiler::nextQuery(FRAME& frame)
+{
+	if (frame.nQueries == frame.queries.size())
+	{
+		size_t n = std::max(frame.queries.size(), (size_t)16);
+		frame.queries.resize(frame.queries.size() + n);
+		glGenQueries((GLsizei)n, frame.queries.data() + frame.nQueries);
+	}
+	return frame.queries[frame.nQueries++];
+}
+
+void C3dglProfiler::collect(FRAME& frame)
+{
+	if (frame.scopes.empty()) return;
+
+	// timestamps complete in order: if the last one is available, so are all the others
+	GLint available = 0;
+	glGetQueryObjectiv(frame.queries[frame.nQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+	{
+		m_nDropped++;
+		return;
+	}
+
+	for (RESULT& result : m_names)
+		result.time = 0;
+	m_order.clear();
+	for (SCOPE& scope : frame.scopes)
+	{
+		if (scope.idEnd == 0) continue;
+		GLuint64 t0, t1;
+		glGetQueryObjectui64v(scope.idBegin, GL_QUERY_RESULT, &t0);
+		glGetQueryObjectui64v(scope.idEnd, GL_QUERY_RESULT, &t1);
+		if (std::find(m_order.begin(), m_order.end(), scope.iName) == m_order.end())
+			m_order.push_back(scope.iName);
+		RESULT& result = m_names[scope.iName];
+		result.time += (t1 - t0) * 1e-6;
+	}
+
+	for (unsigned i : m_order)
+	{
+		RESULT& result = m_names[i];
+		result.average = result.valid ? result.average * 0.9 + result.time * 0.1 : result.time;
+		result.valid = true;
+	}
+}
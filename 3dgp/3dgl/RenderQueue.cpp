@@ -0,0 +1,141 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <algorithm>
+#include <cstring>
+#include <3dgl/RenderQueue.h>
+#include <3dgl/VAO.h>
+#include <3dgl/Shader.h>
+#include <3dgl/Material.h>
+#include <3dgl/State.h>
+#include <3dgl/CommandList.h>
+
+using namespace _3dgl;
+
+/*********************************************************************************
+** class C3dglRenderQueue
+*/
+
+// Sort key layout (most significant bits first):
+//   opaque passes:      pass:4 | program:12 | material:16 | VAO:16 | depth:16
+//   transparent passes: pass:4 | ~depth:16  | program:12  | material:16 | VAO:16
+// Ids wider than their fields are truncated: this may only make the grouping less efficient, never incorrect
+
+void C3dglRenderQueue::submit(const C3dglVertexAttrObject* pVAO, const C3dglMaterial* pMaterial, glm::mat4 matrix, float depth, GLsizei instances, C3dglProgram* pProgram, unsigned pass)
+{
+	if (!pVAO) return;
+	if (pProgram == NULL)
+		pProgram = C3dglProgram::getCurrentProgram();
+
+	uint64_t idProgram = pProgram ? pProgram->getId() & 0xFFF : 0;
+	uint64_t idMaterial = 0;
+	if (pMaterial)
+	{
+		auto it = m_materialIds.find(pMaterial);
+		if (it == m_materialIds.end())
+			it = m_materialIds.insert(std::make_pair(pMaterial, (unsigned)m_materialIds.size() + 1)).first;
+		idMaterial = it->second & 0xFFFF;
+	}
+	uint64_t idVAO = pVAO->getVAOid() & 0xFFFF;
+	uint64_t idDepth = depthKey(depth);
+
+	uint64_t key = (uint64_t)(pass & 0xF) << 60;
+	if (pass < PASS_TRANSPARENT)
+		key |= idProgram << 48 | idMaterial << 32 | idVAO << 16 | idDepth;
+	else
+		key |= (0xFFFF - idDepth) << 44 | idProgram << 32 | idMaterial << 16 | idVAO;
+
+	m_keys.push_back(std::make_pair(key, (unsigned)m_items.size()));
+	m_items.push_back({ pVAO, pMaterial, pProgram, matrix, instances });
+}
+
+void C3dglRenderQueue::submit(const C3dglVertexAttrObject* pVAO, const C3dglMaterial* pMaterial, glm::mat4 matrix, GLsizei instances, C3dglProgram* pProgram, unsigned pass)
+{
+	submit(pVAO, pMaterial, matrix, -matrix[3][2], instances, pProgram, pass);
+}
+
+void C3dglRenderQueue::submit(const C3dglCommandList& list)
+{
+	m_items.reserve(m_items.size() + list.getSize());
+	m_keys.reserve(m_keys.size() + list.getSize());
+	for (size_t i = 0; i < list.getSize(); i++)
+	{
+		const C3dglCommandList::COMMAND& cmd = list.getCommand(i);
+		submit(cmd.pVAO, cmd.pMaterial, cmd.matrix, cmd.depth, cmd.instances, cmd.pProgram, cmd.pass);
+	}
+}
+
+uint64_t C3dglRenderQueue::depthKey(float depth)
+{
+	// the bit pattern of a non-negative float grows with its value: the top 16 bits (exponent + 7 bits of mantissa) make a scale-free key
+	if (!(depth > 0)) return 0;
+	uint32_t bits;
+	memcpy(&bits, &depth, sizeof(bits));
+	return bits >> 16;
+}
+
+void C3dglRenderQueue::flush()
+{
+	std::sort(m_keys.begin(), m_keys.end());
+
+	m_nItems = m_items.size();
+	m_nProgramChanges = m_nMaterialChanges = m_nVAOChanges = 0;
+
+	bool bProgramSet = false;
+	C3dglProgram* pProgram = NULL;
+	const C3dglMaterial* pMaterial = NULL;
+	GLuint idVAO = 0;
+	glm::mat4 matrix;
+	for (auto& key : m_keys)
+	{
+		const ITEM& item = m_items[key.second];
+
+		// program - a new program has none of the material and matrix uniforms set by this queue
+		bool bNewProgram = !bProgramSet || item.pProgram != pProgram;
+		if (bNewProgram)
+		{
+			pProgram = item.pProgram;
+			if (pProgram)
+				pProgram->use();
+			else
+				C3dglState::useProgram(0);
+			pMaterial = NULL;
+			bProgramSet = true;
+			m_nProgramChanges++;
+		}
+
+		// material
+		if (item.pMaterial && item.pMaterial != pMaterial)
+		{
+			item.pMaterial->bind(pProgram);
+			m_nMaterialChanges++;
+		}
+		pMaterial = item.pMaterial;
+
+		// model-view matrix
+		if (bNewProgram || item.matrix != matrix)
+		{
+			matrix = item.matrix;
+			if (pProgram)
+				pProgram->sendUniform(UNI_MODELVIEW, matrix);
+			else
+			{
+				glMatrixMode(GL_MODELVIEW);
+				glLoadMatrixf((GLfloat*)&matrix);
+			}
+		}
+
+		// the VAO is bound by the draw call (through the state cache)
+		if (item.pVAO->getVAOid() != idVAO)
+		{
+			idVAO = item.pVAO->getVAOid();
+			m_nVAOChanges++;
+		}
+		item.pVAO->render(item.instances);
+	}
+
+	clear();
+}
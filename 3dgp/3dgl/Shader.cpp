@@ -5,9 +5,12 @@ Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
 *********************************************************************************/
 #include "pch.h"
 #include <3dgl/Shader.h>
+#include <3dgl/State.h>
+#include <3dgl/StreamBuffer.h>
 
 #include <fstream>
 #include <vector>
+#include <cstddef>
 
 using namespace _3dgl;
 
@@ -171,12 +174,32 @@ std::string C3dglShader::getName() const
 // C3dglProgram
 
 C3dglProgram *C3dglProgram::c_pCurrentProgram = NULL;
+C3dglStreamBuffer* C3dglProgram::c_pUniformStream = NULL;
+GLuint C3dglProgram::c_idUniformBuffer = 0;
+GLint C3dglProgram::c_uniformAlignment = 256;
+PER_OBJECT_BLOCK C3dglProgram::c_perObject;
+bool C3dglProgram::c_bPerObjectDirty = false;
+
+// location of the standard uniforms within the PerObject block
+static const struct {
+	size_t offset;
+	size_t size;
+} c_perObjectLayout[UNI_COUNT] =
+{
+	{ offsetof(PER_OBJECT_BLOCK, matrixModelView), sizeof(glm::mat4) },
+	{ offsetof(PER_OBJECT_BLOCK, materialAmbient), sizeof(glm::vec3) },
+	{ offsetof(PER_OBJECT_BLOCK, materialDiffuse), sizeof(glm::vec3) },
+	{ offsetof(PER_OBJECT_BLOCK, materialSpecular), sizeof(glm::vec3) },
+	{ offsetof(PER_OBJECT_BLOCK, materialEmissive), sizeof(glm::vec3) },
+	{ offsetof(PER_OBJECT_BLOCK, materialShininess), sizeof(float) },
+};
 
 C3dglProgram::C3dglProgram() : C3dglObject()
 {
 	m_id = 0;
 	std::fill(m_stdAttr, m_stdAttr + ATTR_COUNT, -1);
 	std::fill(m_stdUni, m_stdUni + UNI_COUNT, -1);
+	std::fill(m_stdBlock, m_stdBlock + UNI_BLOCK_COUNT, false);
 	// init the static (global) map of uniform types
 	_initMapTypes();
 }
@@ -338,7 +361,7 @@ bool C3dglProgram::link(std::string std_attrib_names, std::string std_uni_names)
 
 			// find the name among the registered variables
 			std::map<std::string, UNIFORM>::iterator it = m_uniforms.find(name.c_str());
-			if (it != m_uniforms.end())
+			if (it != m_uniforms.end() && it->second.location != -1)	// members of uniform blocks have no location
 			{
 				m_stdUni[i] = it->second.location;
 				log(M3DGL_SUCCESS_UNIFORM_FOUND, name, m_stdUni[i]);
@@ -346,6 +369,19 @@ bool C3dglProgram::link(std::string std_attrib_names, std::string std_uni_names)
 		}
 	}
 
+	// Bind Standard Uniform Blocks - each to the binding point of its UNI_BLOCK_STD value
+	std::string STD_BLOCK_NAMES[] = { "PerFrame", "PerObject" };
+	for (unsigned i = 0; i < UNI_BLOCK_COUNT; i++)
+	{
+		GLuint index = glGetUniformBlockIndex(m_id, STD_BLOCK_NAMES[i].c_str());
+		m_stdBlock[i] = (index != GL_INVALID_INDEX);
+		if (m_stdBlock[i])
+		{
+			glUniformBlockBinding(m_id, index, i);
+			log(M3DGL_SUCCESS_UNIFORM_BLOCK_FOUND, STD_BLOCK_NAMES[i], i);
+		}
+	}
+
 	return log(M3DGL_SUCCESS_LINKED);
 }
 
@@ -353,7 +389,7 @@ bool C3dglProgram::use(bool bValidate)
 {
 	if (m_id == 0) return log(M3DGL_ERROR_PROGRAM_NOT_CREATED);
 	
-	glUseProgram(m_id);
+	C3dglState::useProgram(m_id);
 
 	if (isUsed()) return true;	// nothing to do
 
@@ -688,6 +724,14 @@ bool C3dglProgram::sendUniform(std::string name, size_t index, glm::mat4 v) { re
 
 template<class T> bool C3dglProgram::_sendUniform(enum UNI_STD stdloc, T v)
 {
+	if (stdloc >= 0 && stdloc < UNI_COUNT && m_stdBlock[UNI_BLOCK_PER_OBJECT])
+	{
+		// PerObject block: uploaded before the next draw. The program is still made current, as with all other uniforms
+		use();
+		memcpy((char*)&c_perObject + c_perObjectLayout[stdloc].offset, &v, std::min(sizeof(T), c_perObjectLayout[stdloc].size));
+		c_bPerObjectDirty = true;
+		return true;
+	}
 	GLint i = getUniformLocation(stdloc); 
 	if (i == -1) 
 		return false; 
@@ -872,10 +916,108 @@ bool C3dglProgram::retrieveUniform(std::string name, size_t index, glm::mat2& v)
 bool C3dglProgram::retrieveUniform(std::string name, size_t index, glm::mat3& v)	{ return retrieveUniform(getUniformLocation(name, index), v); }
 bool C3dglProgram::retrieveUniform(std::string name, size_t index, glm::mat4& v)	{ return retrieveUniform(getUniformLocation(name, index), v); }
 
-bool C3dglProgram::retrieveUniform(enum UNI_STD stdloc, GLfloat& v)					{ return retrieveUniform(getUniformLocation(stdloc), v); } 
-bool C3dglProgram::retrieveUniform(enum UNI_STD stdloc, glm::vec2& v)				{ return retrieveUniform(getUniformLocation(stdloc), v); }
-bool C3dglProgram::retrieveUniform(enum UNI_STD stdloc, glm::vec3& v)				{ return retrieveUniform(getUniformLocation(stdloc), v); }
-bool C3dglProgram::retrieveUniform(enum UNI_STD stdloc, glm::vec4& v)				{ return retrieveUniform(getUniformLocation(stdloc), v); }
-bool C3dglProgram::retrieveUniform(enum UNI_STD stdloc, glm::mat2& v)				{ return retrieveUniform(getUniformLocation(stdloc), v); }
-bool C3dglProgram::retrieveUniform(enum UNI_STD stdloc, glm::mat3& v)				{ return retrieveUniform(getUniformLocation(stdloc), v); }
-bool C3dglProgram::retrieveUniform(enum UNI_STD stdloc, glm::mat4& v)				{ return retrieveUniform(getUniformLocation(stdloc), v); }
+template<class T> bool C3dglProgram::_retrieveUniform(enum UNI_STD stdloc, T& v)
+{
+	if (stdloc >= 0 && stdloc < UNI_COUNT && m_stdBlock[UNI_BLOCK_PER_OBJECT])
+	{
+		memcpy(&v, (char*)&c_perObject + c_perObjectLayout[stdloc].offset, std::min(sizeof(T), c_perObjectLayout[stdloc].size));
+		return true;
+	}
+	return retrieveUniform(getUniformLocation(stdloc), v);
+}
+
+bool C3dglProgram::retrieveUniform(enum UNI_STD stdloc, GLfloat& v)					{ return _retrieveUniform(stdloc, v); } 
+bool C3dglProgram::retrieveUniform(enum UNI_STD stdloc, glm::vec2& v)				{ return _retrieveUniform(stdloc, v); }
+bool C3dglProgram::retrieveUniform(enum UNI_STD stdloc, glm::vec3& v)				{ return _retrieveUniform(stdloc, v); }
+bool C3dglProgram::retrieveUniform(enum UNI_STD stdloc, glm::vec4& v)				{ return _retrieveUniform(stdloc, v); }
+bool C3dglProgram::retrieveUniform(enum UNI_STD stdloc, glm::mat2& v)				{ return _retrieveUniform(stdloc, v); }
+bool C3dglProgram::retrieveUniform(enum UNI_STD stdloc, glm::mat3& v)				{ return _retrieveUniform(stdloc, v); }
+bool C3dglProgram::retrieveUniform(enum UNI_STD stdloc, glm::mat4& v)				{ return _retrieveUniform(stdloc, v); }
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// Standard Uniform Blocks
+
+bool C3dglProgram::createUniformBlocks(size_t maxObjects, unsigned nFrames)
+{
+	destroyUniformBlocks();
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &c_uniformAlignment);
+
+	// fallback buffer: one slot per block
+	const size_t slot = C3dglStreamBuffer::REGION_ALIGNMENT;
+	if (C3dglState::isDSA())
+	{
+		glCreateBuffers(1, &c_idUniformBuffer);
+		glNamedBufferData(c_idUniformBuffer, UNI_BLOCK_COUNT * slot, NULL, GL_DYNAMIC_DRAW);
+	}
+	else
+	{
+		glGenBuffers(1, &c_idUniformBuffer);
+		C3dglState::bindBuffer(GL_UNIFORM_BUFFER, c_idUniformBuffer);
+		glBufferData(GL_UNIFORM_BUFFER, UNI_BLOCK_COUNT * slot, NULL, GL_DYNAMIC_DRAW);
+	}
+
+	// the ring: a region holds the PerFrame block and up to maxObjects PerObject blocks
+	size_t blockSize = (std::max(sizeof(PER_FRAME_BLOCK), sizeof(PER_OBJECT_BLOCK)) + c_uniformAlignment - 1) / c_uniformAlignment * c_uniformAlignment;
+	c_pUniformStream = new C3dglStreamBuffer;
+	if (!c_pUniformStream->create((maxObjects + 1) * blockSize, nFrames))
+	{
+		delete c_pUniformStream;		// the warning has been logged; the fallback buffer will be used instead
+		c_pUniformStream = NULL;
+	}
+	c_bPerObjectDirty = true;
+	return true;
+}
+
+void C3dglProgram::destroyUniformBlocks()
+{
+	if (c_pUniformStream)
+		delete c_pUniformStream;
+	c_pUniformStream = NULL;
+	if (c_idUniformBuffer)
+		C3dglState::deleteBuffers(1, &c_idUniformBuffer);
+	c_idUniformBuffer = 0;
+}
+
+void C3dglProgram::sendPerFrame(const PER_FRAME_BLOCK& block)
+{
+	if (c_idUniformBuffer == 0)
+		createUniformBlocks();
+	if (c_pUniformStream)
+		c_pUniformStream->nextFrame();
+	uploadUniformBlock(UNI_BLOCK_PER_FRAME, &block, sizeof(block));
+	c_bPerObjectDirty = true;		// the ring has moved on: the PerObject block must be uploaded again, too
+}
+
+void C3dglProgram::flushUniformBlocks()
+{
+	if (!c_bPerObjectDirty)
+		return;
+	if (c_idUniformBuffer == 0)
+		createUniformBlocks();
+	uploadUniformBlock(UNI_BLOCK_PER_OBJECT, &c_perObject, sizeof(c_perObject));
+	c_bPerObjectDirty = false;
+}
+
+void C3dglProgram::uploadUniformBlock(UNI_BLOCK_STD block, const void* data, size_t size)
+{
+	size_t offset;
+	void* p = c_pUniformStream ? c_pUniformStream->alloc(size, offset, c_uniformAlignment) : NULL;
+	if (p)
+	{
+		// no driver calls except for the binding
+		memcpy(p, data, size);
+		c_pUniformStream->bindRange(GL_UNIFORM_BUFFER, block, offset, size);
+		return;
+	}
+
+	// no ring buffer, or the current region is full: update the fallback buffer in place
+	offset = block * C3dglStreamBuffer::REGION_ALIGNMENT;
+	if (C3dglState::isDSA())
+		glNamedBufferSubData(c_idUniformBuffer, offset, size, data);
+	else
+	{
+		C3dglState::bindBuffer(GL_UNIFORM_BUFFER, c_idUniformBuffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+	}
+	C3dglState::bindBufferRange(GL_UNIFORM_BUFFER, block, c_idUniformBuffer, offset, size);
+}
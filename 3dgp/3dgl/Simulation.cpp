@@ -0,0 +1,128 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <3dgl/Simulation.h>
+#include <algorithm>
+#include <cmath>
+
+using namespace _3dgl;
+
+/*********************************************************************************
+** class C3dglSimulation
+*/
+
+C3dglSimulation::C3dglSimulation(float tickRate, unsigned maxTicks) : C3dglObject(), m_nTicks(0), m_step(1.0 / tickRate), m_maxTicks(std::max(maxTicks, 1u)),
+	m_accumulator(0), m_iPrev(0), m_iCurr(0), m_iRenderPrev(0), m_iRenderCurr(0), m_alpha(0), m_bQuit(false)
+{
+}
+
+void C3dglSimulation::create(TICK tick)
+{
+	destroy();
+	m_tick = tick;
+	m_accumulator = 0;
+	m_iPrev = m_iCurr = m_iRenderPrev = m_iRenderCurr = 0;
+	m_alpha = 0;
+	m_nTicks = 0;
+}
+
+void C3dglSimulation::destroy()
+{
+	stop();
+	m_tick = nullptr;
+}
+
+void C3dglSimulation::start()
+{
+	if (isRunning() || !m_tick) return;
+	m_bQuit = false;
+	m_timeCurr = std::chrono::steady_clock::now();
+	m_thread = std::thread(&C3dglSimulation::run, this);
+}
+
+void C3dglSimulation::stop()
+{
+	if (!isRunning()) return;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bQuit = true;
+	}
+	m_cvQuit.notify_all();
+	m_thread.join();
+	m_accumulator = 0;
+}
+
+float C3dglSimulation::update(float deltaTime)
+{
+	if (isRunning())
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_iRenderPrev = m_iPrev;
+		m_iRenderCurr = m_iCurr;
+		std::chrono::duration<double> since = std::chrono::steady_clock::now() - m_timeCurr;
+		m_alpha = (float)std::clamp(since.count() / m_step, 0.0, 1.0);
+		return m_alpha;
+	}
+
+	m_accumulator += deltaTime;
+	for (unsigned n = 0; m_tick && m_accumulator >= m_step && n < m_maxTicks; n++)
+	{
+		tick();
+		m_accumulator -= m_step;
+	}
+	if (m_accumulator >= m_step)
+		m_accumulator = fmod(m_accumulator, m_step);	// too far behind: drop the excess time rather than slow down the frame rate further
+
+	m_iRenderPrev = m_iPrev;
+	m_iRenderCurr = m_iCurr;
+	m_alpha = (float)(m_accumulator / m_step);
+	return m_alpha;
+}
+
+unsigned C3dglSimulation::freeState() const
+{
+	for (unsigned i = 0; i < STATES; i++)
+		if (i != m_iPrev && i != m_iCurr && i != m_iRenderPrev && i != m_iRenderCurr)
+			return i;
+	return 0;	// never happens
+}
+
+void C3dglSimulation::tick()
+{
+	unsigned iNext = freeState();
+	m_tick(m_iCurr, iNext, (float)m_step);
+	m_iPrev = m_iCurr;
+	m_iCurr = iNext;
+	m_nTicks++;
+}
+
+void C3dglSimulation::run()
+{
+	std::chrono::duration<double> step(m_step);
+	auto due = std::chrono::steady_clock::now();
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;)
+	{
+		due += std::chrono::duration_cast<std::chrono::steady_clock::duration>(step);
+		if (m_cvQuit.wait_until(lock, due, [this] { return m_bQuit; }))
+			break;
+
+		// too far behind: drop the excess time
+		auto now = std::chrono::steady_clock::now();
+		if (now - due > step * m_maxTicks)
+			due = now;
+
+		// the states written and rendered are all different: the tick runs unlocked, the renderer may take the last two ticks meanwhile
+		unsigned iPrev = m_iCurr, iNext = freeState();
+		lock.unlock();
+		m_tick(iPrev, iNext, (float)m_step);
+		lock.lock();
+		m_iPrev = iPrev;
+		m_iCurr = iNext;
+		m_timeCurr = due;
+		m_nTicks++;
+	}
+}
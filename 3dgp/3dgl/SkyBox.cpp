@@ -7,6 +7,8 @@ Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
 #include <3dgl/Shader.h>
 #include <3dgl/Bitmap.h>
 #include <3dgl/SkyBox.h>
+#include <3dgl/State.h>
+#include <3dgl/Tools.h>
 
 using namespace _3dgl;
 
@@ -23,21 +25,12 @@ bool C3dglSkyBox::load(const char* pFd, const char* pRt, const char* pBk, const
 		return false;		// this should never happen!
 	}
 
-	glGenTextures(6, m_idTex);
-
 	// load six textures
-	glActiveTexture(GL_TEXTURE0);
 	const char*pFilenames[] = { pBk, pRt, pFd, pLt, pUp, pDn };
 	for (int i = 0; i < 6; ++i)
 	{
 		C3dglBitmap bm(pFilenames[i], GL_RGBA);
-		glGenTextures(1, &m_idTex[i]);
-		glBindTexture(GL_TEXTURE_2D, m_idTex[i]);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, bm.getWidth(), abs(bm.getHeight()), 0, GL_RGBA, GL_UNSIGNED_BYTE, bm.getBits());
+		m_idTex[i] = createTexture2D(bm.getWidth(), abs(bm.getHeight()), GL_RGBA, bm.getBits(), GL_CLAMP_TO_EDGE);
 	}
 
 	float vertices[] = 
@@ -87,26 +80,22 @@ bool C3dglSkyBox::load(const char* pFd, const char* pRt, const char* pBk, const
 void C3dglSkyBox::render(GLsizei instances) const
 {
 	// disable depth-buffer write cycles - so that the skybox cannot obscure anything
-	GLboolean bDepthMask;
-	::glGetBooleanv(GL_DEPTH_WRITEMASK, &bDepthMask);
-	glDepthMask(GL_FALSE);
-
-	GLuint prevVAO;
-	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, (GLint*)&prevVAO);
-	glBindVertexArray(getVAOid());
-	glActiveTexture(GL_TEXTURE0);
+	GLboolean bDepthMask = C3dglState::getDepthMask();
+	C3dglState::depthMask(GL_FALSE);
+
+	C3dglProgram::flushUniformBlocks();
+	C3dglState::bindVertexArray(getVAOid());
 	for (int i = 0; i < 6; ++i)
 	{
-		glBindTexture(GL_TEXTURE_2D, m_idTex[i]);
+		C3dglState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, m_idTex[i]);
 		if (instances == 1)
 			glDrawArrays(GL_TRIANGLE_FAN, i * 4, 4);
 		else
 			glDrawArraysInstanced(GL_TRIANGLE_FAN, i * 4, 4, instances);
 	}
-	glBindVertexArray(prevVAO);
 
 	// enable depth-buffer write cycle
-	glDepthMask(bDepthMask);
+	C3dglState::depthMask(bDepthMask);
 }
 
 void C3dglSkyBox::render(glm::mat4 matrix, C3dglProgram* pProgram) const
@@ -0,0 +1,234 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <3dgl/SpatialIndex.h>
+#include <algorithm>
+
+using namespace _3dgl;
+
+/*********************************************************************************
+** class C3dglSpatialIndex
+*/
+
+C3dglSpatialIndex::C3dglSpatialIndex() : C3dglObject(), m_min(0), m_cellSize(1), m_dims(0)
+{
+}
+
+void C3dglSpatialIndex::build(const glm::vec3* points, size_t count, float cellSize)
+{
+	clear();
+	if (count == 0)
+		return;
+
+	glm::vec3 maxPos = m_min = points[0];
+	for (size_t i = 1; i < count; i++)
+	{
+		m_min = glm::min(m_min, points[i]);
+		maxPos = glm::max(maxPos, points[i]);
+	}
+	glm::vec3 extent = maxPos - m_min;
+
+	if (cellSize <= 0)
+	{
+		// about 4 points per cell, distributed over non-degenerate axes only (e.g. XZ for objects placed on a terrain)
+		float extentMax = glm::max(extent.x, glm::max(extent.y, extent.z));
+		float volume = 1;
+		int nAxes = 0;
+		for (int a = 0; a < 3; a++)
+			if (extent[a] > extentMax * 0.001f)
+			{
+				volume *= extent[a];
+				nAxes++;
+			}
+		cellSize = nAxes ? pow(volume * 4 / count, 1.0f / nAxes) : 1.0f;
+	}
+	m_cellSize = glm::vec3(cellSize);
+	m_dims = glm::ivec3(extent / m_cellSize) + 1;
+
+	// counting sort of the points by cells
+	size_t nCells = (size_t)m_dims.x * m_dims.y * m_dims.z;
+	std::vector<size_t> cells(count);
+	m_cellStart.assign(nCells + 1, 0);
+	for (size_t i = 0; i < count; i++)
+	{
+		glm::ivec3 c = getCell(points[i]);
+		cells[i] = getCellIndex(c.x, c.y, c.z);
+		m_cellStart[cells[i] + 1]++;
+	}
+	for (size_t c = 0; c < nCells; c++)
+		m_cellStart[c + 1] += m_cellStart[c];
+	std::vector<unsigned> next(m_cellStart.begin(), m_cellStart.end() - 1);
+	m_points.resize(count);
+	m_ids.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		unsigned slot = next[cells[i]]++;
+		m_points[slot] = points[i];
+		m_ids[slot] = i;
+	}
+}
+
+void C3dglSpatialIndex::clear()
+{
+	m_cellStart.clear();
+	m_points.clear();
+	m_ids.clear();
+	m_dims = glm::ivec3(0);
+}
+
+glm::ivec3 C3dglSpatialIndex::getCell(glm::vec3 p) const
+{
+	return glm::clamp(glm::ivec3(glm::floor((p - m_min) / m_cellSize)), glm::ivec3(0), m_dims - 1);
+}
+
+void C3dglSpatialIndex::appendRange(glm::ivec3 c0, glm::ivec3 c1, glm::vec3 p, float r2, const glm::vec3* aabb, std::vector<size_t>& result) const
+{
+	for (int z = c0.z; z <= c1.z; z++)
+		for (int y = c0.y; y <= c1.y; y++)
+		{
+			// cells along the x axis are contiguous
+			unsigned first = m_cellStart[getCellIndex(c0.x, y, z)];
+			unsigned last = m_cellStart[getCellIndex(c1.x, y, z) + 1];
+			for (unsigned i = first; i < last; i++)
+			{
+				const glm::vec3& q = m_points[i];
+				if (aabb ? glm::all(glm::greaterThanEqual(q, aabb[0])) && glm::all(glm::lessThanEqual(q, aabb[1])) : glm::dot(q - p, q - p) <= r2)
+					result.push_back(m_ids[i]);
+			}
+		}
+}
+
+size_t C3dglSpatialIndex::queryNearest(glm::vec3 p, size_t k, std::vector<size_t>& result, float maxDist) const
+{
+	result.clear();
+	if (k == 0 || m_points.empty())
+		return 0;
+
+	// max-heap of the k best candidates so far: (squared distance, slot)
+	std::vector<std::pair<float, unsigned> > heap;
+	heap.reserve(k);
+	float maxDist2 = maxDist < sqrt(FLT_MAX) ? maxDist * maxDist : FLT_MAX;
+	auto visit = [&](int x, int y, int z)
+	{
+		size_t c = getCellIndex(x, y, z);
+		for (unsigned i = m_cellStart[c]; i < m_cellStart[c + 1]; i++)
+		{
+			float d2 = glm::dot(m_points[i] - p, m_points[i] - p);
+			if (d2 > maxDist2)
+				continue;
+			if (heap.size() < k)
+			{
+				heap.push_back({ d2, i });
+				std::push_heap(heap.begin(), heap.end());
+			}
+			else if (d2 < heap.front().first)
+			{
+				std::pop_heap(heap.begin(), heap.end());
+				heap.back() = { d2, i };
+				std::push_heap(heap.begin(), heap.end());
+			}
+		}
+	};
+
+	// search in growing rings of cells around the query point's cell
+	glm::ivec3 c = getCell(p);
+	for (int r = 0; ; r++)
+	{
+		glm::ivec3 c0 = glm::max(c - r, glm::ivec3(0));
+		glm::ivec3 c1 = glm::min(c + r, m_dims - 1);
+		for (int z = c0.z; z <= c1.z; z++)
+			for (int y = c0.y; y <= c1.y; y++)
+				if (abs(z - c.z) == r || abs(y - c.y) == r)
+					for (int x = c0.x; x <= c1.x; x++)
+						visit(x, y, z);
+				else
+				{
+					// inside the ring only the two extreme cells along x belong to it
+					if (c.x - r >= 0) visit(c.x - r, y, z);
+					if (r > 0 && c.x + r < m_dims.x) visit(c.x + r, y, z);
+				}
+
+		// distance from p to the nearest cell not searched yet
+		float bound = FLT_MAX;
+		for (int a = 0; a < 3; a++)
+		{
+			if (c[a] - r > 0)
+				bound = glm::min(bound, p[a] - (m_min[a] + (c[a] - r) * m_cellSize[a]));
+			if (c[a] + r < m_dims[a] - 1)
+				bound = glm::min(bound, m_min[a] + (c[a] + r + 1) * m_cellSize[a] - p[a]);
+		}
+		if (bound == FLT_MAX)
+			break;		// the entire grid searched
+		float worst2 = heap.size() == k ? heap.front().first : maxDist2;
+		if (bound > 0 && bound * bound >= worst2)
+			break;		// no closer points possible
+	}
+
+	std::sort_heap(heap.begin(), heap.end());
+	for (auto& entry : heap)
+		result.push_back(m_ids[entry.second]);
+	return result.size();
+}
+
+size_t C3dglSpatialIndex::findNearest(glm::vec3 p) const
+{
+	std::vector<size_t> result;
+	return queryNearest(p, 1, result) ? result[0] : (size_t)-1;
+}
+
+size_t C3dglSpatialIndex::queryRadius(glm::vec3 p, float r, std::vector<size_t>& result) const
+{
+	result.clear();
+	if (!m_points.empty())
+		appendRange(getCell(p - r), getCell(p + r), p, r * r, NULL, result);
+	return result.size();
+}
+
+size_t C3dglSpatialIndex::queryBox(const glm::vec3 aabb[2], std::vector<size_t>& result) const
+{
+	result.clear();
+	if (!m_points.empty())
+		appendRange(getCell(aabb[0]), getCell(aabb[1]), glm::vec3(0), 0, aabb, result);
+	return result.size();
+}
+
+void C3dglSpatialIndex::queryNearest(const glm::vec3* p, size_t n, size_t k, std::vector<size_t>& result, float maxDist) const
+{
+	result.assign(n * k, (size_t)-1);
+	std::vector<size_t> found;
+	found.reserve(k);
+	for (size_t i = 0; i < n; i++)
+	{
+		queryNearest(p[i], k, found, maxDist);
+		std::copy(found.begin(), found.end(), result.begin() + i * k);
+	}
+}
+
+void C3dglSpatialIndex::queryRadius(const glm::vec3* p, size_t n, float r, std::vector<size_t>& result, std::vector<size_t>& offsets) const
+{
+	result.clear();
+	offsets.resize(n + 1);
+	offsets[0] = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		if (!m_points.empty())
+			appendRange(getCell(p[i] - r), getCell(p[i] + r), p[i], r * r, NULL, result);
+		offsets[i + 1] = result.size();
+	}
+}
+
+void C3dglSpatialIndex::queryBox(const glm::vec3 (*aabb)[2], size_t n, std::vector<size_t>& result, std::vector<size_t>& offsets) const
+{
+	result.clear();
+	offsets.resize(n + 1);
+	offsets[0] = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		if (!m_points.empty())
+			appendRange(getCell(aabb[i][0]), getCell(aabb[i][1]), glm::vec3(0), 0, aabb[i], result);
+		offsets[i + 1] = result.size();
+	}
+}
@@ -0,0 +1,339 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <3dgl/State.h>
+
+using namespace _3dgl;
+
+/*********************************************************************************
+** class C3dglState
+*/
+
+GLuint C3dglState::c_idVAO = C3dglState::UNKNOWN;
+GLuint C3dglState::c_idProgram = C3dglState::UNKNOWN;
+GLuint C3dglState::c_idFramebuffer = C3dglState::UNKNOWN;
+GLenum C3dglState::c_activeTexture = C3dglState::UNKNOWN;
+GLuint C3dglState::c_idTextures[C3dglState::TEXTURE_UNITS][C3dglState::TEXTURE_TARGETS];
+GLuint C3dglState::c_idBuffers[C3dglState::BUFFER_TARGETS];
+GLint C3dglState::c_viewport[4] = { -1, -1, -1, -1 };
+GLint C3dglState::c_caps[C3dglState::CAPS] = { -1, -1, -1, -1 };
+GLint C3dglState::c_depthMask = -1;
+GLenum C3dglState::c_depthFunc = C3dglState::UNKNOWN;
+GLenum C3dglState::c_blendSrc = C3dglState::UNKNOWN;
+GLenum C3dglState::c_blendDst = C3dglState::UNKNOWN;
+GLint C3dglState::c_dsa = -1;
+
+// static initialisation of the arrays
+static struct STATE_INIT { STATE_INIT() { C3dglState::invalidate(); } } c_stateInit;
+
+void C3dglState::invalidate()
+{
+	c_idVAO = c_idProgram = c_idFramebuffer = UNKNOWN;
+	c_activeTexture = UNKNOWN;
+	for (auto& unit : c_idTextures)
+		for (GLuint& id : unit)
+			id = UNKNOWN;
+	for (GLuint& id : c_idBuffers)
+		id = UNKNOWN;
+	c_viewport[2] = -1;
+	for (GLint& cap : c_caps)
+		cap = -1;
+	c_depthMask = -1;
+	c_depthFunc = c_blendSrc = c_blendDst = UNKNOWN;
+}
+
+int C3dglState::textureIndex(GLenum target)
+{
+	switch (target)
+	{
+	case GL_TEXTURE_2D: return 0;
+	case GL_TEXTURE_CUBE_MAP: return 1;
+	case GL_TEXTURE_2D_ARRAY: return 2;
+	default: return -1;
+	}
+}
+
+int C3dglState::bufferIndex(GLenum target)
+{
+	switch (target)
+	{
+	case GL_ARRAY_BUFFER: return 0;
+	case GL_DRAW_INDIRECT_BUFFER: return 1;
+	case GL_COPY_READ_BUFFER: return 2;
+	case GL_COPY_WRITE_BUFFER: return 3;
+	case GL_PIXEL_PACK_BUFFER: return 4;
+	case GL_PIXEL_UNPACK_BUFFER: return 5;
+	case GL_SHADER_STORAGE_BUFFER: return 6;
+	case GL_UNIFORM_BUFFER: return 7;
+	default: return -1;
+	}
+}
+
+int C3dglState::capIndex(GLenum cap)
+{
+	switch (cap)
+	{
+	case GL_DEPTH_TEST: return 0;
+	case GL_BLEND: return 1;
+	case GL_CULL_FACE: return 2;
+	case GL_ALPHA_TEST: return 3;
+	default: return -1;
+	}
+}
+
+void C3dglState::bindVertexArray(GLuint id)
+{
+	if (id == c_idVAO) return;
+	glBindVertexArray(id);
+	c_idVAO = id;
+}
+
+GLuint C3dglState::getVertexArray()
+{
+	if (c_idVAO == UNKNOWN)
+		glGetIntegerv(GL_VERTEX_ARRAY_BINDING, (GLint*)&c_idVAO);
+	return c_idVAO;
+}
+
+void C3dglState::useProgram(GLuint id)
+{
+	if (id == c_idProgram) return;
+	glUseProgram(id);
+	c_idProgram = id;
+}
+
+GLuint C3dglState::getProgram()
+{
+	if (c_idProgram == UNKNOWN)
+		glGetIntegerv(GL_CURRENT_PROGRAM, (GLint*)&c_idProgram);
+	return c_idProgram;
+}
+
+void C3dglState::activeTexture(GLenum texUnit)
+{
+	if (texUnit == c_activeTexture) return;
+	glActiveTexture(texUnit);
+	c_activeTexture = texUnit;
+}
+
+GLenum C3dglState::getActiveTexture()
+{
+	if (c_activeTexture == UNKNOWN)
+		glGetIntegerv(GL_ACTIVE_TEXTURE, (GLint*)&c_activeTexture);
+	return c_activeTexture;
+}
+
+void C3dglState::bindTexture(GLenum texUnit, GLenum target, GLuint id)
+{
+	int i = textureIndex(target);
+	unsigned unit = texUnit - GL_TEXTURE0;
+	if (i >= 0 && unit < TEXTURE_UNITS && c_idTextures[unit][i] == id) return;
+	activeTexture(texUnit);
+	glBindTexture(target, id);
+	if (i >= 0 && unit < TEXTURE_UNITS)
+		c_idTextures[unit][i] = id;
+}
+
+GLuint C3dglState::getTexture(GLenum texUnit, GLenum target)
+{
+	int i = textureIndex(target);
+	unsigned unit = texUnit - GL_TEXTURE0;
+	GLuint* pId = (i >= 0 && unit < TEXTURE_UNITS) ? &c_idTextures[unit][i] : NULL;
+	if (pId && *pId != UNKNOWN)
+		return *pId;
+
+	static const GLenum bindings[] = { GL_TEXTURE_BINDING_2D, GL_TEXTURE_BINDING_CUBE_MAP, GL_TEXTURE_BINDING_2D_ARRAY };
+	GLuint id = 0;
+	if (i >= 0)
+	{
+		activeTexture(texUnit);
+		glGetIntegerv(bindings[i], (GLint*)&id);
+	}
+	if (pId) *pId = id;
+	return id;
+}
+
+void C3dglState::bindBuffer(GLenum target, GLuint id)
+{
+	int i = bufferIndex(target);
+	if (i >= 0 && c_idBuffers[i] == id) return;
+	glBindBuffer(target, id);
+	if (i >= 0) c_idBuffers[i] = id;
+}
+
+void C3dglState::bindBufferBase(GLenum target, GLuint index, GLuint id)
+{
+	glBindBufferBase(target, index, id);
+	int i = bufferIndex(target);
+	if (i >= 0) c_idBuffers[i] = id;
+}
+
+void C3dglState::bindBufferRange(GLenum target, GLuint index, GLuint id, GLintptr offset, GLsizeiptr size)
+{
+	glBindBufferRange(target, index, id, offset, size);
+	int i = bufferIndex(target);
+	if (i >= 0) c_idBuffers[i] = id;
+}
+
+GLuint C3dglState::getBuffer(GLenum target)
+{
+	int i = bufferIndex(target);
+	if (i >= 0 && c_idBuffers[i] != UNKNOWN)
+		return c_idBuffers[i];
+
+	static const GLenum bindings[] = { GL_ARRAY_BUFFER_BINDING, GL_DRAW_INDIRECT_BUFFER_BINDING, GL_COPY_READ_BUFFER_BINDING, GL_COPY_WRITE_BUFFER_BINDING,
+		GL_PIXEL_PACK_BUFFER_BINDING, GL_PIXEL_UNPACK_BUFFER_BINDING, GL_SHADER_STORAGE_BUFFER_BINDING, GL_UNIFORM_BUFFER_BINDING };
+	GLuint id = 0;
+	if (i >= 0)
+	{
+		glGetIntegerv(bindings[i], (GLint*)&id);
+		c_idBuffers[i] = id;
+	}
+	else if (target == GL_ELEMENT_ARRAY_BUFFER)
+		glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, (GLint*)&id);
+	return id;
+}
+
+void C3dglState::bindFramebuffer(GLuint id)
+{
+	if (id == c_idFramebuffer) return;
+	glBindFramebuffer(GL_FRAMEBUFFER, id);
+	c_idFramebuffer = id;
+}
+
+GLuint C3dglState::getFramebuffer()
+{
+	if (c_idFramebuffer == UNKNOWN)
+		glGetIntegerv(GL_FRAMEBUFFER_BINDING, (GLint*)&c_idFramebuffer);
+	return c_idFramebuffer;
+}
+
+void C3dglState::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	if (c_viewport[0] == x && c_viewport[1] == y && c_viewport[2] == width && c_viewport[3] == height) return;
+	glViewport(x, y, width, height);
+	c_viewport[0] = x; c_viewport[1] = y; c_viewport[2] = width; c_viewport[3] = height;
+}
+
+void C3dglState::getViewport(GLint viewport[4])
+{
+	if (c_viewport[2] < 0)
+		glGetIntegerv(GL_VIEWPORT, c_viewport);
+	for (int i = 0; i < 4; i++)
+		viewport[i] = c_viewport[i];
+}
+
+void C3dglState::enable(GLenum cap, bool bEnable)
+{
+	int i = capIndex(cap);
+	if (i >= 0 && c_caps[i] == (GLint)bEnable) return;
+	if (bEnable)
+		glEnable(cap);
+	else
+		glDisable(cap);
+	if (i >= 0) c_caps[i] = bEnable;
+}
+
+bool C3dglState::isEnabled(GLenum cap)
+{
+	int i = capIndex(cap);
+	if (i < 0)
+		return glIsEnabled(cap) == GL_TRUE;
+	if (c_caps[i] < 0)
+		c_caps[i] = glIsEnabled(cap) == GL_TRUE;
+	return c_caps[i] == 1;
+}
+
+void C3dglState::depthMask(GLboolean flag)
+{
+	if (c_depthMask == (GLint)flag) return;
+	glDepthMask(flag);
+	c_depthMask = flag;
+}
+
+GLboolean C3dglState::getDepthMask()
+{
+	if (c_depthMask < 0)
+	{
+		GLboolean flag;
+		glGetBooleanv(GL_DEPTH_WRITEMASK, &flag);
+		c_depthMask = flag;
+	}
+	return (GLboolean)c_depthMask;
+}
+
+void C3dglState::depthFunc(GLenum func)
+{
+	if (func == c_depthFunc) return;
+	glDepthFunc(func);
+	c_depthFunc = func;
+}
+
+GLenum C3dglState::getDepthFunc()
+{
+	if (c_depthFunc == UNKNOWN)
+		glGetIntegerv(GL_DEPTH_FUNC, (GLint*)&c_depthFunc);
+	return c_depthFunc;
+}
+
+void C3dglState::blendFunc(GLenum src, GLenum dst)
+{
+	if (src == c_blendSrc && dst == c_blendDst) return;
+	glBlendFunc(src, dst);
+	c_blendSrc = src;
+	c_blendDst = dst;
+}
+
+bool C3dglState::isDSA()
+{
+	if (c_dsa < 0)
+		c_dsa = GLEW_VERSION_4_5 || GLEW_ARB_direct_state_access;
+	return c_dsa == 1;
+}
+
+void C3dglState::enableDSA(bool bEnable)
+{
+	c_dsa = -1;
+	c_dsa = bEnable && isDSA();
+}
+
+void C3dglState::deleteVertexArrays(GLsizei n, const GLuint* ids)
+{
+	for (GLsizei i = 0; i < n; i++)
+		if (ids[i] == c_idVAO) c_idVAO = 0;
+	glDeleteVertexArrays(n, ids);
+}
+
+void C3dglState::deleteProgram(GLuint id)
+{
+	// a program in use is only flagged for deletion - and remains in use
+	if (id == c_idProgram) c_idProgram = UNKNOWN;
+	glDeleteProgram(id);
+}
+
+void C3dglState::deleteTextures(GLsizei n, const GLuint* ids)
+{
+	for (GLsizei i = 0; i < n; i++)
+		for (auto& unit : c_idTextures)
+			for (GLuint& id : unit)
+				if (id == ids[i]) id = 0;
+	glDeleteTextures(n, ids);
+}
+
+void C3dglState::deleteBuffers(GLsizei n, const GLuint* ids)
+{
+	for (GLsizei i = 0; i < n; i++)
+		for (GLuint& id : c_idBuffers)
+			if (id == ids[i]) id = 0;
+	glDeleteBuffers(n, ids);
+}
+
+void C3dglState::deleteFramebuffers(GLsizei n, const GLuint* ids)
+{
+	for (GLsizei i = 0; i < n; i++)
+		if (ids[i] == c_idFramebuffer) c_idFramebuffer = 0;
+	glDeleteFramebuffers(n, ids);
+}
@@ -0,0 +1,169 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <3dgl/StaticBatch.h>
+#include <3dgl/Model.h>
+#include <3dgl/Shader.h>
+
+// assimp include file
+#include "assimp/scene.h"
+
+// GLM include files
+#include "../glm/gtc/type_ptr.hpp"
+#include "../glm/gtc/matrix_inverse.hpp"
+
+using namespace _3dgl;
+
+// merged geometry of a group - see C3dglStaticBatch::build
+class CStaticBatchGroup : public C3dglVertexAttrObject
+{
+public:
+	CStaticBatchGroup() : C3dglVertexAttrObject(ATTR_COUNT_EXT) { }
+	std::string getName() const { return "Static Batch Group"; }
+};
+
+/*********************************************************************************
+** class C3dglStaticBatch
+*/
+
+void C3dglStaticBatch::destroy()
+{
+	for (auto& group : m_groups)
+		delete group.second.pVAO;
+	m_groups.clear();
+	m_nObjects = 0;
+}
+
+void C3dglStaticBatch::add(C3dglModel& model, glm::mat4 matrixWorld)
+{
+	if (!model.getScene() || !model.getScene()->mRootNode)
+		return;
+	for (size_t i = 0; i < model.getNodeCount(); i++)
+		addNode(model, i, matrixWorld * model.getNodeGlobal(i));
+	m_nObjects++;
+}
+
+void C3dglStaticBatch::addNode(C3dglModel& model, size_t iNode, glm::mat4 m)
+{
+	unsigned nMeshes;
+	const unsigned* pMeshes = model.getNodeMeshes(iNode, nMeshes);
+	if (nMeshes == 0)
+		return;
+	glm::mat3 matrixNormal = glm::inverseTranspose(glm::mat3(m));
+
+	for (unsigned k = 0; k < nMeshes; k++)
+	{
+		unsigned iMesh = pMeshes[k];
+		const aiMesh* pMesh = model.getScene()->mMeshes[iMesh];
+		if (pMesh->mNumBones > 0 || pMesh->mNumVertices == 0)
+			continue;		// skinned meshes cannot be pre-transformed
+
+		// transformed vertices and their bounding box
+		std::vector<glm::vec3> vertices(pMesh->mNumVertices);
+		glm::vec3 aabb[2] = { glm::vec3(1e10f), glm::vec3(-1e10f) };
+		for (unsigned i = 0; i < pMesh->mNumVertices; i++)
+		{
+			vertices[i] = glm::vec3(m * glm::vec4(glm::make_vec3(&pMesh->mVertices[i].x), 1));
+			aabb[0] = glm::min(aabb[0], vertices[i]);
+			aabb[1] = glm::max(aabb[1], vertices[i]);
+		}
+
+		// find the group: material & the cell of the mesh centre
+		std::pair<int, int> cell(0, 0);
+		if (m_cellSize > 0)
+		{
+			glm::vec3 centre = (aabb[0] + aabb[1]) * 0.5f;
+			cell = std::make_pair((int)floor(centre.x / m_cellSize), (int)floor(centre.z / m_cellSize));
+		}
+		const C3dglMaterial* pMaterial = model.getMesh(iMesh)->getMaterial();
+		GROUP& group = m_groups[std::make_pair(pMaterial, cell)];
+		group.pMaterial = pMaterial;
+		group.aabb[0] = glm::min(group.aabb[0], aabb[0]);
+		group.aabb[1] = glm::max(group.aabb[1], aabb[1]);
+
+		// append the vertex data; missing attributes are zero-filled
+		GLuint base = (GLuint)group.vertices.size();
+		group.vertices.insert(group.vertices.end(), vertices.begin(), vertices.end());
+		for (unsigned i = 0; i < pMesh->mNumVertices; i++)
+		{
+			group.normals.push_back(pMesh->mNormals ? glm::normalize(matrixNormal * glm::make_vec3(&pMesh->mNormals[i].x)) : glm::vec3(0));
+			group.texCoords.push_back(pMesh->mTextureCoords[0] ? glm::vec2(glm::make_vec3(&pMesh->mTextureCoords[0][i].x)) : glm::vec2(0));
+			group.tangents.push_back(pMesh->mTangents ? glm::normalize(glm::mat3(m) * glm::make_vec3(&pMesh->mTangents[i].x)) : glm::vec3(0));
+			group.bitangents.push_back(pMesh->mBitangents ? glm::normalize(glm::mat3(m) * glm::make_vec3(&pMesh->mBitangents[i].x)) : glm::vec3(0));
+		}
+		group.bTexCoords |= pMesh->mTextureCoords[0] != NULL;
+		group.bTangents |= pMesh->mTangents != NULL && pMesh->mBitangents != NULL;
+
+		// indices (triangles only)
+		for (unsigned f = 0; f < pMesh->mNumFaces; f++)
+		{
+			const aiFace& face = pMesh->mFaces[f];
+			if (face.mNumIndices == 3)
+				for (unsigned i = 0; i < 3; i++)
+					group.indices.push_back(base + face.mIndices[i]);
+		}
+	}
+}
+
+void C3dglStaticBatch::build(C3dglProgram* pProgram)
+{
+	for (auto& it : m_groups)
+	{
+		GROUP& group = it.second;
+		if (group.pVAO || group.indices.empty())
+			continue;
+
+		void* attrData[] = { group.vertices.data(), group.normals.data(), group.bTexCoords ? group.texCoords.data() : NULL,
+			group.bTangents ? group.tangents.data() : NULL, group.bTangents ? group.bitangents.data() : NULL };
+		size_t attrSize[] = { sizeof(glm::vec3), sizeof(glm::vec3), sizeof(glm::vec2), sizeof(glm::vec3), sizeof(glm::vec3) };
+
+		group.pVAO = new CStaticBatchGroup();
+		group.pVAO->create(ATTR_COUNT_EXT, group.vertices.size(), attrData, attrSize, group.indices.size(), group.indices.data(), sizeof(GLuint), pProgram, true);
+
+		// release the CPU copy
+		group.vertices = group.normals = group.tangents = group.bitangents = std::vector<glm::vec3>();
+		group.texCoords = std::vector<glm::vec2>();
+		group.indices = std::vector<GLuint>();
+	}
+}
+
+void C3dglStaticBatch::render(glm::mat4 matrixView, C3dglProgram* pProgram) const
+{
+	render(matrixView, NULL, pProgram);
+}
+
+void C3dglStaticBatch::render(glm::mat4 matrixView, const C3dglFrustum& frustum, C3dglProgram* pProgram) const
+{
+	render(matrixView, &frustum, pProgram);
+}
+
+void C3dglStaticBatch::render(glm::mat4 matrixView, const C3dglFrustum* pFrustum, C3dglProgram* pProgram) const
+{
+	// the groups are ordered by material: each material is set up once, for all its cells
+	const C3dglMaterial* pMaterial = NULL;
+	bool bMatrix = false;
+	for (auto& it : m_groups)
+	{
+		const GROUP& group = it.second;
+		if (!group.pVAO || (pFrustum && !pFrustum->isVisible(group.aabb)))
+			continue;
+
+		if (group.pMaterial != pMaterial)
+		{
+			if (pMaterial) pMaterial->postRender(pProgram);
+			pMaterial = group.pMaterial;
+			if (pMaterial) pMaterial->render(pProgram);
+		}
+
+		// all groups share the matrix - the vertices are in world coordinates
+		if (!bMatrix)
+			group.pVAO->render(matrixView, 1, pProgram);
+		else
+			group.pVAO->render(1);
+		bMatrix = true;
+	}
+	if (pMaterial) pMaterial->postRender(pProgram);
+}
@@ -0,0 +1,101 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <3dgl/StreamBuffer.h>
+#include <3dgl/State.h>
+
+using namespace _3dgl;
+
+/*********************************************************************************
+** class C3dglStreamBuffer
+*/
+
+bool C3dglStreamBuffer::create(size_t regionSize, unsigned nFrames)
+{
+	destroy();
+	if (!GLEW_ARB_buffer_storage)
+	{
+		log(M3DGL_WARNING_PERSISTENT_BUFFERS_NOT_SUPPORTED);
+		return false;
+	}
+	if (regionSize == 0 || nFrames == 0)
+		return false;
+
+	m_regionSize = (regionSize + REGION_ALIGNMENT - 1) / REGION_ALIGNMENT * REGION_ALIGNMENT;
+	m_nFrames = nFrames;
+	m_iFrame = 0;
+	m_used = 0;
+	m_fences.assign(nFrames, NULL);
+
+	// immutable storage, mapped once for the lifetime of the buffer; coherent - no explicit flushes needed
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	if (C3dglState::isDSA())
+	{
+		glCreateBuffers(1, &m_id);
+		glNamedBufferStorage(m_id, m_regionSize * nFrames, NULL, flags);
+		m_pMapped = (char*)glMapNamedBufferRange(m_id, 0, m_regionSize * nFrames, flags);
+	}
+	else
+	{
+		glGenBuffers(1, &m_id);
+		C3dglState::bindBuffer(GL_COPY_WRITE_BUFFER, m_id);
+		glBufferStorage(GL_COPY_WRITE_BUFFER, m_regionSize * nFrames, NULL, flags);
+		m_pMapped = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, m_regionSize * nFrames, flags);
+		C3dglState::bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	return m_pMapped != NULL;
+}
+
+void C3dglStreamBuffer::destroy()
+{
+	for (GLsync fence : m_fences)
+		if (fence) glDeleteSync(fence);
+	m_fences.clear();
+	if (m_id)
+		C3dglState::deleteBuffers(1, &m_id);	// persistent mapping is released together with the buffer
+	m_id = 0;
+	m_pMapped = NULL;
+	m_regionSize = 0;
+	m_nFrames = m_iFrame = 0;
+	m_used = 0;
+}
+
+void C3dglStreamBuffer::nextFrame()
+{
+	if (!m_pMapped) return;
+
+	// all draws reading the current region have been issued by now - fence it
+	if (m_fences[m_iFrame])
+		glDeleteSync(m_fences[m_iFrame]);
+	m_fences[m_iFrame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	// wait for the GPU to release the next region - normally it did so frames ago
+	m_iFrame = (m_iFrame + 1) % m_nFrames;
+	if (m_fences[m_iFrame])
+	{
+		GLenum res;
+		do res = glClientWaitSync(m_fences[m_iFrame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		while (res == GL_TIMEOUT_EXPIRED);
+		glDeleteSync(m_fences[m_iFrame]);
+		m_fences[m_iFrame] = NULL;
+	}
+	m_used = 0;
+}
+
+void* C3dglStreamBuffer::alloc(size_t size, size_t& offset, size_t alignment)
+{
+	size_t first = (m_used + alignment - 1) / alignment * alignment;
+	if (!m_pMapped || first + size > m_regionSize)
+		return NULL;
+	m_used = first + size;
+	offset = getRegionOffset() + first;
+	return m_pMapped + offset;
+}
+
+void C3dglStreamBuffer::bindRange(GLenum target, GLuint index, size_t offset, size_t size) const
+{
+	C3dglState::bindBufferRange(target, index, m_id, offset, size);
+}
@@ -0,0 +1,135 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+*********************************************************************************/
+#include "pch.h"
+#include <3dgl/TexturePool.h>
+#include <3dgl/Model.h>
+#include <3dgl/State.h>
+
+using namespace _3dgl;
+
+/*********************************************************************************
+** class C3dglTexturePool
+*/
+
+void C3dglTexturePool::destroy()
+{
+	for (ARRAY& array : m_arrays)
+		C3dglState::deleteTextures(1, &array.id);
+	m_arrays.clear();
+	m_pooled.clear();
+}
+
+bool C3dglTexturePool::add(GLsizei width, GLsizei height, GLenum format, const void* pixels, GLuint& idArray, GLint& layer)
+{
+	if (width <= 0 || height <= 0 || pixels == NULL)
+		return false;
+
+	ARRAY& array = findOrAddArray(width, height);
+	idArray = array.id;
+	layer = array.layers++;
+	if (C3dglState::isDSA())
+		glTextureSubImage3D(array.id, 0, 0, 0, layer, width, height, 1, format, GL_UNSIGNED_BYTE, pixels);
+	else
+	{
+		C3dglState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D_ARRAY, array.id);
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1, format, GL_UNSIGNED_BYTE, pixels);
+	}
+	return true;
+}
+
+bool C3dglTexturePool::add(GLuint idTexture, GLuint& idArray, GLint& layer)
+{
+	auto it = m_pooled.find(idTexture);
+	if (it != m_pooled.end())
+	{
+		idArray = it->second.first;
+		layer = it->second.second;
+		return true;
+	}
+
+	// size of the source texture
+	GLint width = 0, height = 0;
+	if (C3dglState::isDSA())
+	{
+		glGetTextureLevelParameteriv(idTexture, 0, GL_TEXTURE_WIDTH, &width);
+		glGetTextureLevelParameteriv(idTexture, 0, GL_TEXTURE_HEIGHT, &height);
+	}
+	else
+	{
+		C3dglState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, idTexture);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+	}
+	if (width <= 0 || height <= 0)
+		return false;
+
+	if (GLEW_ARB_copy_image)
+	{
+		// GPU-side copy
+		ARRAY& array = findOrAddArray(width, height);
+		idArray = array.id;
+		layer = array.layers++;
+		glCopyImageSubData(idTexture, GL_TEXTURE_2D, 0, 0, 0, 0, array.id, GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1);
+	}
+	else
+	{
+		// read back, then upload
+		std::vector<GLubyte> pixels(width * height * 4);
+		C3dglState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, idTexture);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+		if (!add(width, height, GL_RGBA, pixels.data(), idArray, layer))
+			return false;
+	}
+	m_pooled[idTexture] = std::make_pair(idArray, layer);
+	return true;
+}
+
+size_t C3dglTexturePool::add(C3dglModel& model, GLenum texUnit)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < model.getMaterialCount(); i++)
+	{
+		C3dglMaterial* pMaterial = model.getMaterial(i);
+		unsigned idTex;
+		GLuint idArray;
+		GLint layer;
+		if (pMaterial->getTexture(texUnit, idTex) && add(idTex, idArray, layer))
+		{
+			pMaterial->setTextureLayer(texUnit, idArray, layer);
+			n++;
+		}
+	}
+	return n;
+}
+
+C3dglTexturePool::ARRAY& C3dglTexturePool::findOrAddArray(GLsizei width, GLsizei height)
+{
+	for (ARRAY& array : m_arrays)
+		if (array.width == width && array.height == height && array.layers < m_maxLayers)
+			return array;
+
+	// immutable storage for all the layers; linear filtering and no mipmaps - as createTexture2D
+	m_arrays.push_back(ARRAY());
+	ARRAY& array = m_arrays.back();
+	array.width = width;
+	array.height = height;
+	if (C3dglState::isDSA())
+	{
+		glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &array.id);
+		glTextureStorage3D(array.id, 1, GL_RGBA8, width, height, m_maxLayers);
+		glTextureParameteri(array.id, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTextureParameteri(array.id, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	}
+	else
+	{
+		glGenTextures(1, &array.id);
+		C3dglState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D_ARRAY, array.id);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, m_maxLayers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	}
+	return array;
+}
@@ -7,45 +7,63 @@ Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <algorithm>
+#include <cfloat>
 
 // GLM include files
 #include "../glm/gtc/type_ptr.hpp"
 
+#ifndef M3DGL_HEADLESS
 #include <GL/glut.h>
+#endif
 #include <3dgl/Tools.h>
+#include <3dgl/State.h>
 #include <3dgl/CommonDef.h>
 #include <3dgl/Bitmap.h>
 #include <3dgl/Terrain.h>
 #include <3dgl/Shader.h>
 #include <3dgl/Mesh.h>
 
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#define M3DGL_TOOLS_SSE
+#include <xmmintrin.h>
+#endif
+
 using namespace _3dgl;
 
 void MY3DGL_API _3dgl::print(int x, int y, std::string text, glm::vec3 color, enum FONT font, enum ALIGN align)
 {
+#ifndef M3DGL_HEADLESS
 	void*fonts[] = { GLUT_BITMAP_9_BY_15, GLUT_BITMAP_8_BY_13, GLUT_BITMAP_TIMES_ROMAN_10, GLUT_BITMAP_TIMES_ROMAN_24, GLUT_BITMAP_HELVETICA_10, GLUT_BITMAP_HELVETICA_12, GLUT_BITMAP_HELVETICA_18 };
 	int heights[] = { 15, 13, 10, 24, 10, 12, 18 };
 	int width = 0;
 	for (char ch : text)
 		width += glutBitmapWidth(fonts[font], ch);
 
+	// negative coordinates are relative to the right and top edges of the viewport
+	GLint viewport[4];
+	C3dglState::getViewport(viewport);
 	if (x < 0)
-		x += glutGet(GLUT_WINDOW_WIDTH) - width;
+		x += viewport[2] - width;
 	else if (align == RIGHT)
 		x -= width;
 	else if (align == CENTRE)
 		x -= width / 2;
 	if (y < 0)
-		y += glutGet(GLUT_WINDOW_HEIGHT) - heights[font];
+		y += viewport[3] - heights[font];
 	void* f = fonts[font];
 
 	C3dglProgram* pProgram = C3dglProgram::getCurrentProgram();
-	glUseProgram(0);
+	C3dglState::useProgram(0);
 	glColor3f(color.r, color.g, color.b);
 	glWindowPos2i(x, y);  // move in 10 pixels from the left and bottom edges
 	for (char ch : text)
 		glutBitmapCharacter(fonts[font], ch);
 	if (pProgram) pProgram->use(false);
+#else
+	// no GLUT fonts in headless builds
+	(void)x; (void)y; (void)text; (void)color; (void)font; (void)align;
+#endif
 }
 
 void MY3DGL_API _3dgl::print(int x, int y, float deltaTime, glm::vec3 color, enum FONT font, enum ALIGN align)
@@ -71,6 +89,91 @@ void MY3DGL_API _3dgl::print(int x, int y, glm::mat4 matrixView, glm::vec3 color
 	print(x, y, std::format("X: {:.2f} Y: {:.2f} Z: {:.2f}", pos.x, pos.y, pos.z), color, font, align);
 }
 
+void MY3DGL_API _3dgl::sortFrontToBack(const glm::vec3* points, size_t count, glm::vec3 eye, unsigned* order, unsigned nBuckets)
+{
+	if (count == 0 || nBuckets == 0) return;
+
+	std::vector<float> dist(count);
+	float minDist = FLT_MAX, maxDist = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		dist[i] = glm::distance(points[i], eye);
+		minDist = std::min(minDist, dist[i]);
+		maxDist = std::max(maxDist, dist[i]);
+	}
+
+	// counting sort by buckets
+	float scale = maxDist > minDist ? (nBuckets - 1) / (maxDist - minDist) : 0;
+	std::vector<unsigned> bucket(count), start(nBuckets + 1, 0);
+	for (size_t i = 0; i < count; i++)
+	{
+		bucket[i] = (unsigned)((dist[i] - minDist) * scale);
+		start[bucket[i] + 1]++;
+	}
+	for (unsigned b = 0; b < nBuckets; b++)
+		start[b + 1] += start[b];
+	for (size_t i = 0; i < count; i++)
+		order[start[bucket[i]]++] = (unsigned)i;
+}
+
+void MY3DGL_API _3dgl::transformAABB(const glm::vec3 aabb[2], const glm::mat4& m, glm::vec3 result[2])
+{
+	// start with the translation; each matrix element adds its smaller product to the minimum, the larger to the maximum.
+	// The input is read before anything is written: aabb and result may be the same array
+#ifdef M3DGL_TOOLS_SSE
+	__m128 lo = _mm_loadu_ps(&m[3][0]), hi = lo;
+	for (int col = 0; col < 3; col++)
+	{
+		__m128 c = _mm_loadu_ps(&m[col][0]);
+		__m128 a = _mm_mul_ps(c, _mm_set1_ps(aabb[0][col]));
+		__m128 b = _mm_mul_ps(c, _mm_set1_ps(aabb[1][col]));
+		lo = _mm_add_ps(lo, _mm_min_ps(a, b));
+		hi = _mm_add_ps(hi, _mm_max_ps(a, b));
+	}
+	float f[8];
+	_mm_storeu_ps(f, lo);
+	_mm_storeu_ps(f + 4, hi);
+	result[0] = glm::vec3(f[0], f[1], f[2]);
+	result[1] = glm::vec3(f[4], f[5], f[6]);
+#else
+	glm::vec3 in[2] = { aabb[0], aabb[1] };
+	result[0] = result[1] = glm::vec3(m[3]);
+	for (int col = 0; col < 3; col++)
+		for (int row = 0; row < 3; row++)
+		{
+			float a = m[col][row] * in[0][col];
+			float b = m[col][row] * in[1][col];
+			result[0][row] += std::min(a, b);
+			result[1][row] += std::max(a, b);
+		}
+#endif
+}
+
+GLuint MY3DGL_API _3dgl::createTexture2D(GLsizei width, GLsizei height, GLenum format, const void* pixels, GLenum wrap, GLenum texUnit)
+{
+	GLuint id;
+	if (C3dglState::isDSA())
+	{
+		glCreateTextures(GL_TEXTURE_2D, 1, &id);
+		glTextureStorage2D(id, 1, GL_RGBA8, width, height);
+		glTextureSubImage2D(id, 0, 0, 0, width, height, format, GL_UNSIGNED_BYTE, pixels);
+		glTextureParameteri(id, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTextureParameteri(id, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTextureParameteri(id, GL_TEXTURE_WRAP_S, wrap);
+		glTextureParameteri(id, GL_TEXTURE_WRAP_T, wrap);
+		return id;
+	}
+
+	glGenTextures(1, &id);
+	C3dglState::bindTexture(texUnit, GL_TEXTURE_2D, id);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
+	return id;
+}
+
 bool MY3DGL_API _3dgl::convHeightmap2OBJ(const std::string fileImage, float scaleHeight, const std::string fileOBJ)
 {
 	C3dglBitmap bm;
@@ -7,12 +7,103 @@ Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
 #include <iostream>
 #include <3dgl/VAO.h>
 #include <3dgl/Shader.h>
+#include <3dgl/State.h>
+#include <3dgl/GeometryPool.h>
+#include <3dgl/StreamBuffer.h>
+#include <algorithm>
 
 // GLM include files
 #include "../glm/gtc/type_ptr.hpp"
 
 using namespace _3dgl;
 
+// formats of the standard attributes - see ATTRIB_STD enum
+struct ATTRIB_FORMAT
+{
+	size_t bytes;			// element size, in bytes
+	GLint size;				// number of components
+	GLenum type;			// component type
+	GLboolean normalized;	// fixed point values normalized to [0..1] or [-1..1]
+	bool integer;			// integer attribute (glVertexAttribIPointer)
+};
+
+// full precision formats
+static const ATTRIB_FORMAT c_attribFormats[] = {
+	{ 12, 3, GL_FLOAT, GL_FALSE, false },										// vertex
+	{ 12, 3, GL_FLOAT, GL_FALSE, false },										// normal
+	{ 8, 2, GL_FLOAT, GL_FALSE, false },										// texcoord
+	{ 12, 3, GL_FLOAT, GL_FALSE, false },										// tangent
+	{ 12, 3, GL_FLOAT, GL_FALSE, false },										// bitangent
+	{ 16, 3, GL_FLOAT, GL_FALSE, false },										// color (aiColor4D)
+	{ 4 * MAX_BONES_PER_VERTEX, MAX_BONES_PER_VERTEX, GL_INT, GL_FALSE, true },	// bone ids
+	{ 4 * MAX_BONES_PER_VERTEX, MAX_BONES_PER_VERTEX, GL_FLOAT, GL_FALSE, false },	// bone weights
+};
+
+// quantized formats - see C3dglModel::setQuantizedFlag. Tangents carry the handedness in w; bitangents are not stored
+static const ATTRIB_FORMAT c_attribFormatsQ[] = {
+	{ 12, 3, GL_FLOAT, GL_FALSE, false },										// vertex - never quantized
+	{ 4, 4, GL_INT_2_10_10_10_REV, GL_TRUE, false },							// normal
+	{ 4, 2, GL_HALF_FLOAT, GL_FALSE, false },									// texcoord
+	{ 4, 4, GL_INT_2_10_10_10_REV, GL_TRUE, false },							// tangent + handedness
+	{ 12, 3, GL_FLOAT, GL_FALSE, false },										// bitangent - never quantized
+	{ 4, 4, GL_UNSIGNED_BYTE, GL_TRUE, false },									// color
+	{ MAX_BONES_PER_VERTEX, MAX_BONES_PER_VERTEX, GL_UNSIGNED_BYTE, GL_FALSE, true },	// bone ids
+	{ MAX_BONES_PER_VERTEX, MAX_BONES_PER_VERTEX, GL_UNSIGNED_BYTE, GL_TRUE, false },	// bone weights
+};
+
+// the format is identified by the element size; unknown sizes are assumed to be full precision
+static const ATTRIB_FORMAT& getAttribFormat(unsigned attr, size_t bytes)
+{
+	return bytes == c_attribFormatsQ[attr].bytes ? c_attribFormatsQ[attr] : c_attribFormats[attr];
+}
+
+/*********************************************************************************
+** struct VERTEX_FORMAT
+*/
+
+bool VERTEX_FORMAT::operator==(const VERTEX_FORMAT& f) const
+{
+	return stride == f.stride
+		&& std::equal(location, location + ATTR_COUNT, f.location)
+		&& std::equal(offset, offset + ATTR_COUNT, f.offset)
+		&& std::equal(bytes, bytes + ATTR_COUNT, f.bytes);
+}
+
+void VERTEX_FORMAT::setAttribPointers() const
+{
+	for (unsigned attr = 0; attr < ATTR_COUNT; attr++)
+		if (location[attr] != -1)
+		{
+			const ATTRIB_FORMAT& f = getAttribFormat(attr, bytes[attr]);
+			glEnableVertexAttribArray(location[attr]);
+			if (f.integer)
+				glVertexAttribIPointer(location[attr], f.size, f.type, stride, reinterpret_cast<void*>((size_t)offset[attr]));
+			else
+				glVertexAttribPointer(location[attr], f.size, f.type, f.normalized, stride, reinterpret_cast<void*>((size_t)offset[attr]));
+		}
+}
+
+void VERTEX_FORMAT::setAttribFormat(GLuint idVAO, GLuint idBuffer) const
+{
+	// all the attributes share a single buffer binding point - the location of the first attribute present
+	GLuint binding = (GLuint)-1;
+	for (unsigned attr = 0; attr < ATTR_COUNT; attr++)
+		if (location[attr] != -1)
+		{
+			if (binding == (GLuint)-1)
+				binding = location[attr];
+			const ATTRIB_FORMAT& f = getAttribFormat(attr, bytes[attr]);
+			glEnableVertexArrayAttrib(idVAO, location[attr]);
+			if (f.integer)
+				glVertexArrayAttribIFormat(idVAO, location[attr], f.size, f.type, offset[attr]);
+			else
+				glVertexArrayAttribFormat(idVAO, location[attr], f.size, f.type, f.normalized, offset[attr]);
+			glVertexArrayAttribBinding(idVAO, location[attr], binding);
+		}
+	if (binding != (GLuint)-1)
+		glVertexArrayVertexBuffer(idVAO, binding, idBuffer, 0, stride);
+}
+
 /*********************************************************************************
 ** class C3dglVertexAttrObject
 */
@@ -31,7 +122,7 @@ bool C3dglVertexAttrObject::getVertexBufferId(GLint attrLocation, GLuint& buffer
 	auto it = m_mapBuffers.find(attrLocation);
 	if (it != m_mapBuffers.end())
 	{
-		bufferId = it->second;
+		bufferId = it->second.id;
 		return true;
 	}
 	else
@@ -39,7 +130,7 @@ bool C3dglVertexAttrObject::getVertexBufferId(GLint attrLocation, GLuint& buffer
 }
 
 
-void C3dglVertexAttrObject::create(size_t attrCount, size_t nVertices, void** attrData, size_t* attrSize, size_t nIndices, void* indexData, size_t indSize, C3dglProgram* pProgram)
+void C3dglVertexAttrObject::create(size_t attrCount, size_t nVertices, void** attrData, size_t* attrSize, size_t nIndices, void* indexData, size_t indSize, C3dglProgram* pProgram, bool bInterleaved, C3dglGeometryPool* pPool)
 {
 	// Find the program to be used
 	m_pProgram = pProgram;
@@ -73,28 +164,60 @@ void C3dglVertexAttrObject::create(size_t attrCount, size_t nVertices, void** at
 	if (m_nVertices + m_nIndices == 0)
 		return;			// nothing to do!
 
-	// create VAO
-	GLuint prevVAO;
-	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, (GLint*)&prevVAO);
-	glGenVertexArrays(1, &m_idVAO);
-	glBindVertexArray(m_idVAO);
+	// index type: 16-bit indices whenever they can address all the vertices
+	std::vector<GLushort> shortIndices;
+	m_indexType = indSize == sizeof(GLubyte) ? GL_UNSIGNED_BYTE : indSize == sizeof(GLushort) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	if (m_indexType == GL_UNSIGNED_INT && indexData && m_nVertices <= 65536)
+	{
+		shortIndices.assign((const GLuint*)indexData, (const GLuint*)indexData + m_nIndices);
+		indexData = shortIndices.data();
+		indSize = sizeof(GLushort);
+		m_indexType = GL_UNSIGNED_SHORT;
+	}
+
+	// store in the geometry pool
+	if (pPool && m_pProgram && m_nVertices && m_nIndices)
+	{
+		VERTEX_FORMAT format;
+		std::vector<char> data;
+		packInterleaved(attrCount, attrId, attrData, attrSize, format, data);
+		if (m_indexType != GL_UNSIGNED_BYTE && pPool->allocate(format, data.data(), m_nVertices, indexData, m_indexType, m_nIndices, m_iArena, m_baseVertex, m_firstIndex))
+		{
+			m_pPool = pPool;
+			m_idVAO = pPool->getVAOid(m_iArena);
+			m_interleavedStride = format.stride;
+			return;
+		}
+		log(M3DGL_WARNING_GEOMETRY_POOL_NOT_USED);
+	}
+
+	// create VAO - with Direct State Access, buffers and attributes are set up by name and nothing gets bound
+	bool bDSA = m_pProgram && C3dglState::isDSA();
+	GLuint prevVAO = 0;
+	if (bDSA)
+		glCreateVertexArrays(1, &m_idVAO);
+	else
+	{
+		prevVAO = C3dglState::getVertexArray();
+		glGenVertexArrays(1, &m_idVAO);
+		C3dglState::bindVertexArray(m_idVAO);
+	}
 
 	// generate attribute buffers, then bind them and send data to OpenGL
 	if (m_nVertices)
 	{
-		if (m_pProgram)
+		if (m_pProgram && bInterleaved)
+			// programmable pipeline, interleaved layout
+			createInterleavedBuffer(attrCount, attrId, attrData, attrSize);
+		else if (m_pProgram)
 			// programmable pipeline
 			for (unsigned attr = 0; attr < attrCount; attr++)
 			{
 				if (attrId[attr] == -1 || attrData[attr] == NULL)
 					continue;
-				
 
-				static GLint attribMult[] = { 3, 3, 2, 3, 3, 3, MAX_BONES_PER_VERTEX, MAX_BONES_PER_VERTEX };
-				if (attr != ATTR_BONE_ID)
-					createVertexBuffer(attrId[attr], nVertices, attribMult[attr], (float*)attrData[attr], (GLsizei)attrSize[attr]);
-				else
-					createVertexBuffer(attrId[attr], nVertices, attribMult[attr], (int*)attrData[attr], (GLsizei)attrSize[attr]);
+				const ATTRIB_FORMAT& f = getAttribFormat(attr, attrSize[attr]);
+				createVertexBuffer(attrId[attr], nVertices, f.size, f.type, f.normalized, f.integer, attrData[attr], (GLsizei)attrSize[attr], 0, GL_STATIC_DRAW, 0);
 			}
 		else
 			// fixed pipeline only
@@ -109,135 +232,243 @@ void C3dglVertexAttrObject::create(size_t attrCount, size_t nVertices, void** at
 	}
 
 	// Index buffer
-	if (m_nIndices)
+	if (m_nIndices && bDSA)
+	{
+		glCreateBuffers(1, &m_idIndex);
+		glNamedBufferData(m_idIndex, indSize * m_nIndices, indexData, GL_STATIC_DRAW);
+		glVertexArrayElementBuffer(m_idVAO, m_idIndex);
+	}
+	else if (m_nIndices)
 	{
 		glGenBuffers(1, &m_idIndex);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_idIndex);
+		C3dglState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_idIndex);
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indSize * m_nIndices, indexData, GL_STATIC_DRAW);
 	}
 
-	// Reset VAO & buffers
-	glBindVertexArray(prevVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	// Reset VAO & buffers - the index buffer binding is a part of the VAO state, and stays
+	if (!bDSA)
+	{
+		C3dglState::bindVertexArray(prevVAO);
+		C3dglState::bindBuffer(GL_ARRAY_BUFFER, 0);
+	}
 }
 
 void C3dglVertexAttrObject::destroy()
 {
-	for (auto it = m_mapBuffers.begin(); it != m_mapBuffers.end(); it++)
-		glDeleteBuffers(1, &it->second);
-	m_mapBuffers.clear();
+	if (m_pPool)
+	{
+		// the pool owns the buffers and the VAO
+		m_pPool->free(m_iArena, m_baseVertex, m_nVertices, m_firstIndex, m_nIndices);
+		m_pPool = NULL;
+		m_idVAO = 0;
+		m_interleavedStride = 0;
+		m_baseVertex = 0;
+		m_firstIndex = 0;
+	}
+	while (!m_mapBuffers.empty())
+		destroyVertexBuffer(m_mapBuffers.begin()->first);
 	if (m_idIndex != 0)
-		glDeleteBuffers(1, &m_idIndex);
+		C3dglState::deleteBuffers(1, &m_idIndex);
 	m_idIndex = 0;
-	if (&m_idVAO != 0)
-		glDeleteVertexArrays(1, &m_idVAO);
+	if (m_idInterleaved != 0)
+		C3dglState::deleteBuffers(1, &m_idInterleaved);
+	m_idInterleaved = 0;
+	m_interleavedStride = 0;
+	if (m_idVAO != 0)
+		C3dglState::deleteVertexArrays(1, &m_idVAO);
 	m_idVAO = 0;
 	m_nVertices = m_nIndices = 0;
 }
 
-GLuint C3dglVertexAttrObject::createVertexBuffer(GLint attrLocation, size_t instances, GLint size, float* data, GLsizei stride, GLuint divisor, GLenum usage)
+void C3dglVertexAttrObject::packInterleaved(size_t attrCount, const GLint* attrId, void** attrData, size_t* attrSize, VERTEX_FORMAT& format, std::vector<char>& data) const
 {
-	if (attrLocation == -1)
-	{
-		log(M3DGL_ERROR_ATTRIBUTE_NOT_FOUND);
-		return (GLuint)-1;
-	}
+	// vertex layout: the attributes present, in the ATTRIB_STD order
+	std::fill(format.location, format.location + ATTR_COUNT, -1);
+	std::fill(format.offset, format.offset + ATTR_COUNT, 0);
+	std::fill(format.bytes, format.bytes + ATTR_COUNT, 0);
+	format.stride = 0;
+	attrCount = std::min(attrCount, (size_t)ATTR_COUNT);
+	for (unsigned attr = 0; attr < attrCount; attr++)
+		if (attrId[attr] != -1 && attrData[attr] != NULL)
+		{
+			format.location[attr] = attrId[attr];
+			format.offset[attr] = format.stride;
+			format.bytes[attr] = (GLuint)attrSize[attr];
+			format.stride += (GLsizei)attrSize[attr];
+		}
 
-	if (stride == 0) stride = size * sizeof(float);
+	data.resize(m_nVertices * format.stride);
+	for (unsigned attr = 0; attr < attrCount; attr++)
+		if (format.location[attr] != -1)
+			for (size_t i = 0; i < m_nVertices; i++)
+				memcpy(&data[i * format.stride + format.offset[attr]], (char*)attrData[attr] + i * attrSize[attr], attrSize[attr]);
+}
 
-	destroyVertexBuffer(attrLocation);
+void C3dglVertexAttrObject::createInterleavedBuffer(size_t attrCount, const GLint* attrId, void** attrData, size_t* attrSize)
+{
+	// expects the VAO to be bound, unless Direct State Access is used
+	VERTEX_FORMAT format;
+	std::vector<char> data;
+	packInterleaved(attrCount, attrId, attrData, attrSize, format, data);
+	if (format.stride == 0)
+		return;
 
-	GLuint prevVAO;
-	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, (GLint*)&prevVAO);
-	if (prevVAO != m_idVAO)
-		glBindVertexArray(m_idVAO);
+	m_interleavedStride = format.stride;
+	if (C3dglState::isDSA())
+	{
+		glCreateBuffers(1, &m_idInterleaved);
+		glNamedBufferData(m_idInterleaved, data.size(), data.data(), GL_STATIC_DRAW);
+		format.setAttribFormat(m_idVAO, m_idInterleaved);
+		return;
+	}
 
-	GLuint bufferId;
-	glGenBuffers(1, &bufferId);
-	m_mapBuffers[attrLocation] = bufferId;
-	glBindBuffer(GL_ARRAY_BUFFER, bufferId);
-	glBufferData(GL_ARRAY_BUFFER, instances * stride, data, usage);
+	glGenBuffers(1, &m_idInterleaved);
+	C3dglState::bindBuffer(GL_ARRAY_BUFFER, m_idInterleaved);
+	glBufferData(GL_ARRAY_BUFFER, data.size(), data.data(), GL_STATIC_DRAW);
+	format.setAttribPointers();
+}
 
-	glEnableVertexAttribArray(attrLocation);
-	glVertexAttribPointer(attrLocation, size, GL_FLOAT, GL_FALSE, stride, 0);
-	if (divisor) glVertexAttribDivisor(attrLocation, divisor);
+GLuint C3dglVertexAttrObject::createVertexBuffer(GLint attrLocation, size_t instances, GLint size, float* data, GLsizei stride, GLuint divisor, GLenum usage)
+{
+	return createVertexBuffer(attrLocation, instances, size, GL_FLOAT, GL_FALSE, false, data, stride, divisor, usage, 0);
+}
 
-	// Reset VAO & buffers
-	if (prevVAO != m_idVAO)
-		glBindVertexArray(prevVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+GLuint C3dglVertexAttrObject::createVertexBuffer(GLint attrLocation, size_t instances, GLint size, int* data, GLsizei stride, GLuint divisor, GLenum usage)
+{
+	return createVertexBuffer(attrLocation, instances, size, GL_INT, GL_FALSE, true, data, stride, divisor, usage, 0);
+}
 
-	return bufferId;
+GLuint C3dglVertexAttrObject::createRingVertexBuffer(GLint attrLocation, size_t instances, GLint size, float* data, GLsizei stride, GLuint divisor, unsigned nFrames)
+{
+	return createVertexBuffer(attrLocation, instances, size, GL_FLOAT, GL_FALSE, false, data, stride, divisor, GL_STREAM_DRAW, nFrames);
 }
 
-GLuint C3dglVertexAttrObject::createVertexBuffer(GLint attrLocation, size_t instances, GLint size, int* data, GLsizei stride, GLuint divisor, GLenum usage)
+GLuint C3dglVertexAttrObject::createRingVertexBuffer(GLint attrLocation, size_t instances, GLint size, int* data, GLsizei stride, GLuint divisor, unsigned nFrames)
+{
+	return createVertexBuffer(attrLocation, instances, size, GL_INT, GL_FALSE, true, data, stride, divisor, GL_STREAM_DRAW, nFrames);
+}
+
+GLuint C3dglVertexAttrObject::createVertexBuffer(GLint attrLocation, size_t instances, GLint size, GLenum type, GLboolean normalized, bool integer, const void* data, GLsizei stride, GLuint divisor, GLenum usage, unsigned nFrames)
 {
 	if (attrLocation == -1)
 	{
 		log(M3DGL_ERROR_ATTRIBUTE_NOT_FOUND);
 		return (GLuint)-1;
 	}
+	if (m_pPool)
+	{
+		log(M3DGL_ERROR_POOLED_VERTEX_BUFFER);
+		return (GLuint)-1;
+	}
 
 	if (stride == 0)
-		stride = size * sizeof(int);
+		stride = size * (type == GL_INT ? sizeof(int) : sizeof(float));
 
 	destroyVertexBuffer(attrLocation);
 
-	GLuint prevVAO;
-	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, (GLint*)&prevVAO);
-	if (prevVAO != m_idVAO)
-		glBindVertexArray(m_idVAO);
+	// ring buffer: a stream buffer of nFrames regions, each holding the whole data
+	C3dglStreamBuffer* pStream = NULL;
+	if (nFrames)
+	{
+		pStream = new C3dglStreamBuffer;
+		if (!pStream->create(instances * stride, nFrames))
+		{
+			delete pStream;		// the warning has been logged; a dynamic buffer will be used instead
+			pStream = NULL;
+		}
+	}
 
-	GLuint bufferId;
-	glGenBuffers(1, &bufferId);
-	m_mapBuffers[attrLocation] = bufferId;
-	glBindBuffer(GL_ARRAY_BUFFER, bufferId);
-	glBufferData(GL_ARRAY_BUFFER, instances * stride, data, usage);
+	BUFFER& buf = m_mapBuffers[attrLocation];
+	buf.type = type;
+	buf.normalized = normalized;
+	buf.integer = integer;
+	buf.size = size;
+	buf.stride = stride;
+	buf.divisor = divisor;
+	buf.count = instances;
+	buf.usage = usage;
+
+	bool bDSA = C3dglState::isDSA();
+	GLuint prevVAO = 0;
+	if (!bDSA)
+	{
+		prevVAO = C3dglState::getVertexArray();
+		C3dglState::bindVertexArray(m_idVAO);
+	}
+
+	if (pStream)
+	{
+		size_t region = instances * stride;
+		buf.id = pStream->getId();
+		buf.pStream = pStream;
+		buf.nDraws = m_nDraws;
+		buf.shadow.resize(region);
+		if (data)
+			memcpy(buf.shadow.data(), data, region);
+		memcpy(pStream->getRegion(), buf.shadow.data(), region);
+		if (!bDSA)
+			C3dglState::bindBuffer(GL_ARRAY_BUFFER, buf.id);
+	}
+	else if (bDSA)
+	{
+		glCreateBuffers(1, &buf.id);
+		glNamedBufferData(buf.id, instances * stride, data, usage);
+	}
+	else
+	{
+		glGenBuffers(1, &buf.id);
+		C3dglState::bindBuffer(GL_ARRAY_BUFFER, buf.id);
+		glBufferData(GL_ARRAY_BUFFER, instances * stride, data, usage);
+	}
+
+	if (bDSA)
+	{
+		glEnableVertexArrayAttrib(m_idVAO, attrLocation);
+		setAttribPointer(attrLocation, buf, 0);
+		if (divisor) glVertexArrayBindingDivisor(m_idVAO, attrLocation, divisor);
+		return buf.id;
+	}
 
 	glEnableVertexAttribArray(attrLocation);
-	glVertexAttribIPointer(attrLocation, size, GL_INT, stride, 0);
+	setAttribPointer(attrLocation, buf, 0);
 	if (divisor) glVertexAttribDivisor(attrLocation, divisor);
 
 	// Reset VAO & buffers
-	if (prevVAO != m_idVAO)
-		glBindVertexArray(prevVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	C3dglState::bindVertexArray(prevVAO);
+	C3dglState::bindBuffer(GL_ARRAY_BUFFER, 0);
 
-	return bufferId;
+	return buf.id;
 }
 
 GLuint C3dglVertexAttrObject::createVertexBuffer(GLenum cap, size_t instances, float* data, GLsizei stride, GLenum usage)
 {
 	destroyVertexBuffer(cap);
 
-	GLuint prevVAO;
-	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, (GLint*)&prevVAO);
-	if (prevVAO != m_idVAO)
-		glBindVertexArray(m_idVAO);
+	GLuint prevVAO = C3dglState::getVertexArray();
+	C3dglState::bindVertexArray(m_idVAO);
 
 	GLuint bufferId;
 	glGenBuffers(1, &bufferId);
-	glBindBuffer(GL_ARRAY_BUFFER, bufferId);
+	C3dglState::bindBuffer(GL_ARRAY_BUFFER, bufferId);
 
 	switch (cap)
 	{
 	case ATTR_VERTEX:
-		m_mapBuffers[GL_VERTEX_ARRAY] = bufferId;
+		m_mapBuffers[GL_VERTEX_ARRAY].id = bufferId;
 		if (stride == 0) stride = 3 * sizeof(float);
 		glBufferData(GL_ARRAY_BUFFER, instances * stride, data, GL_STATIC_DRAW);
 		glEnableClientState(GL_VERTEX_ARRAY);
 		glVertexPointer(3, GL_FLOAT, stride, 0);
 		break;
 	case ATTR_NORMAL:
-		m_mapBuffers[GL_NORMAL_ARRAY] = bufferId;
+		m_mapBuffers[GL_NORMAL_ARRAY].id = bufferId;
 		if (stride == 0) stride = 3 * sizeof(float);
 		glBufferData(GL_ARRAY_BUFFER, instances * stride, data, GL_STATIC_DRAW);
 		glEnableClientState(GL_NORMAL_ARRAY);
 		glNormalPointer(GL_FLOAT, stride, 0);
 		break;
 	case ATTR_TEXCOORD:
-		m_mapBuffers[GL_TEXTURE_COORD_ARRAY] = bufferId;
+		m_mapBuffers[GL_TEXTURE_COORD_ARRAY].id = bufferId;
 		if (stride == 0) stride = 2 * sizeof(float);	// not always true; if this doesn't work, just provide the actual value of strride (!=0)
 		glBufferData(GL_ARRAY_BUFFER, instances * stride, data, GL_STATIC_DRAW);
 		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
@@ -245,14 +476,13 @@ GLuint C3dglVertexAttrObject::createVertexBuffer(GLenum cap, size_t instances, f
 		break;
 	default:
 		log(M3DGL_ERROR_ATTRIBUTE_NOT_FOUND);
-		glDeleteBuffers(1, &bufferId);
+		C3dglState::deleteBuffers(1, &bufferId);
 		break;
 	}
 
 	// Reset VAO & buffers
-	if (prevVAO != m_idVAO)
-		glBindVertexArray(prevVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	C3dglState::bindVertexArray(prevVAO);
+	C3dglState::bindBuffer(GL_ARRAY_BUFFER, 0);
 
 	return bufferId;
 }
@@ -264,22 +494,38 @@ void C3dglVertexAttrObject::addAttribPointer(GLint attrLocation, GLuint bufferId
 		log(M3DGL_ERROR_ATTRIBUTE_NOT_FOUND);
 		return;
 	}
+	if (m_pPool)
+	{
+		log(M3DGL_ERROR_POOLED_VERTEX_BUFFER);
+		return;
+	}
+
+	offset = addRingAlias(attrLocation, bufferId, size, false, stride ? stride : GLsizei(size * sizeof(float)), offset);
+
+	if (C3dglState::isDSA())
+	{
+		// with DSA, the stride is never implied; the offset goes into the buffer binding
+		if (stride == 0) stride = size * sizeof(float);
+		glEnableVertexArrayAttrib(m_idVAO, attrLocation);
+		glVertexArrayAttribFormat(m_idVAO, attrLocation, size, GL_FLOAT, GL_FALSE, 0);
+		glVertexArrayAttribBinding(m_idVAO, attrLocation, attrLocation);
+		glVertexArrayVertexBuffer(m_idVAO, attrLocation, bufferId, offset, stride);
+		if (divisor) glVertexArrayBindingDivisor(m_idVAO, attrLocation, divisor);
+		return;
+	}
 
-	GLuint prevVAO;
-	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, (GLint*)&prevVAO);
-	if (prevVAO != m_idVAO)
-		glBindVertexArray(m_idVAO);
+	GLuint prevVAO = C3dglState::getVertexArray();
+	C3dglState::bindVertexArray(m_idVAO);
 	
-	glBindBuffer(GL_ARRAY_BUFFER, bufferId);
+	C3dglState::bindBuffer(GL_ARRAY_BUFFER, bufferId);
 
 	glEnableVertexAttribArray(attrLocation);
 	glVertexAttribPointer(attrLocation, size, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void*>(offset));
 	if (divisor) glVertexAttribDivisor(attrLocation, divisor);
 
 	// Reset VAO & buffers
-	if (prevVAO != m_idVAO)
-		glBindVertexArray(prevVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	C3dglState::bindVertexArray(prevVAO);
+	C3dglState::bindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void C3dglVertexAttrObject::addAttribIPointer(GLint attrLocation, GLuint bufferId, size_t instances, GLint size, GLsizei stride, size_t offset, GLuint divisor, GLenum usage)
@@ -289,22 +535,37 @@ void C3dglVertexAttrObject::addAttribIPointer(GLint attrLocation, GLuint bufferI
 		log(M3DGL_ERROR_ATTRIBUTE_NOT_FOUND);
 		return;
 	}
+	if (m_pPool)
+	{
+		log(M3DGL_ERROR_POOLED_VERTEX_BUFFER);
+		return;
+	}
+
+	offset = addRingAlias(attrLocation, bufferId, size, true, stride ? stride : GLsizei(size * sizeof(int)), offset);
+
+	if (C3dglState::isDSA())
+	{
+		if (stride == 0) stride = size * sizeof(int);
+		glEnableVertexArrayAttrib(m_idVAO, attrLocation);
+		glVertexArrayAttribIFormat(m_idVAO, attrLocation, size, GL_INT, 0);
+		glVertexArrayAttribBinding(m_idVAO, attrLocation, attrLocation);
+		glVertexArrayVertexBuffer(m_idVAO, attrLocation, bufferId, offset, stride);
+		if (divisor) glVertexArrayBindingDivisor(m_idVAO, attrLocation, divisor);
+		return;
+	}
 
-	GLuint prevVAO;
-	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, (GLint*)&prevVAO);
-	if (prevVAO != m_idVAO)
-		glBindVertexArray(m_idVAO);
+	GLuint prevVAO = C3dglState::getVertexArray();
+	C3dglState::bindVertexArray(m_idVAO);
 
-	glBindBuffer(GL_ARRAY_BUFFER, bufferId);
+	C3dglState::bindBuffer(GL_ARRAY_BUFFER, bufferId);
 
 	glEnableVertexAttribArray(attrLocation);
 	glVertexAttribIPointer(attrLocation, size, GL_INT, stride, reinterpret_cast<void*>(offset));
 	if (divisor) glVertexAttribDivisor(attrLocation, divisor);
 
 	// Reset VAO & buffers
-	if (prevVAO != m_idVAO)
-		glBindVertexArray(prevVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	C3dglState::bindVertexArray(prevVAO);
+	C3dglState::bindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void C3dglVertexAttrObject::destroyVertexBuffer(GLint attrLocation)
@@ -312,12 +573,140 @@ void C3dglVertexAttrObject::destroyVertexBuffer(GLint attrLocation)
 	auto it = m_mapBuffers.find(attrLocation);
 	if (it != m_mapBuffers.end())
 	{
-		glDeleteBuffers(1, &it->second);
+		if (it->second.pStream)
+			delete it->second.pStream;
+		else
+			C3dglState::deleteBuffers(1, &it->second.id);
 		m_mapBuffers.erase(it);
 	}
 }
 
+bool C3dglVertexAttrObject::updateVertexBuffer(GLint attrLocation, size_t first, size_t count, const void* data)
+{
+	auto it = m_mapBuffers.find(attrLocation);
+	if (it == m_mapBuffers.end())
+		return log(M3DGL_ERROR_BUFFER_NOT_FOUND, attrLocation);
+	BUFFER& buf = it->second;
+	if (first + count > buf.count)
+		return log(M3DGL_ERROR_BUFFER_OVERFLOW, first + count, buf.count);
+	if (count == 0)
+		return true;
+
+	size_t offset = first * buf.stride;
+	size_t size = count * buf.stride;
+
+	if (buf.pStream)
+	{
+		// ring buffer: if the current region has been rendered since the last update, move on to the next one
+		if (buf.nDraws != m_nDraws)
+			advanceRing(attrLocation, buf);
+		memcpy(buf.shadow.data() + offset, data, size);
+		memcpy(buf.pStream->getRegion() + offset, data, size);
+	}
+	else if (C3dglState::isDSA())
+	{
+		if (first == 0 && count == buf.count && buf.usage != GL_STATIC_DRAW)
+			glNamedBufferData(buf.id, size, NULL, buf.usage);		// orphaning
+		glNamedBufferSubData(buf.id, offset, size, data);
+	}
+	else
+	{
+		C3dglState::bindBuffer(GL_ARRAY_BUFFER, buf.id);
+		if (first == 0 && count == buf.count && buf.usage != GL_STATIC_DRAW)
+			glBufferData(GL_ARRAY_BUFFER, size, NULL, buf.usage);	// orphaning: the old storage is released once the GPU is done with it
+		glBufferSubData(GL_ARRAY_BUFFER, offset, size, data);
+		C3dglState::bindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	return true;
+}
+
+void C3dglVertexAttrObject::advanceRing(GLint attrLocation, BUFFER& buf)
+{
+	// fence the current region and wait for the next one, carry over the data, then re-point the attribute at the new region
+	buf.pStream->nextFrame();
+	memcpy(buf.pStream->getRegion(), buf.shadow.data(), buf.shadow.size());
+
+	// the attributes aliasing the ring (see addAttribPointer) follow it
+	GLuint prevVAO = C3dglState::getVertexArray();
+	if (!C3dglState::isDSA())
+	{
+		C3dglState::bindVertexArray(m_idVAO);
+		C3dglState::bindBuffer(GL_ARRAY_BUFFER, buf.id);
+	}
+	size_t region = buf.pStream->getRegionOffset();
+	setAttribPointer(attrLocation, buf, region);
+	for (const ALIAS& alias : buf.aliases)
+	{
+		BUFFER format;
+		format.id = buf.id;
+		format.type = alias.integer ? GL_INT : GL_FLOAT;
+		format.integer = alias.integer;
+		format.size = alias.size;
+		format.stride = alias.stride;
+		setAttribPointer(alias.attrLocation, format, region + alias.offset);
+	}
+	if (!C3dglState::isDSA())
+	{
+		C3dglState::bindVertexArray(prevVAO);
+		C3dglState::bindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	buf.nDraws = m_nDraws;
+}
+
+size_t C3dglVertexAttrObject::addRingAlias(GLint attrLocation, GLuint bufferId, GLint size, bool integer, GLsizei stride, size_t offset)
+{
+	// if bufferId is a ring buffer, records the attribute so that advanceRing re-points it, and returns its offset within the current region
+	for (auto& [location, buf] : m_mapBuffers)
+		if (buf.pStream && buf.id == bufferId)
+		{
+			buf.aliases.erase(std::remove_if(buf.aliases.begin(), buf.aliases.end(), [attrLocation](const ALIAS& a) { return a.attrLocation == attrLocation; }), buf.aliases.end());
+			buf.aliases.push_back({ attrLocation, offset, size, integer, stride });
+			return buf.pStream->getRegionOffset() + offset;
+		}
+	return offset;
+}
+
+void C3dglVertexAttrObject::setAttribPointer(GLint attrLocation, const BUFFER& buf, size_t offset) const
+{
+	if (C3dglState::isDSA())
+	{
+		// the attribute has its own buffer binding point, numbered after its location; the offset goes into the binding
+		if (buf.integer)
+			glVertexArrayAttribIFormat(m_idVAO, attrLocation, buf.size, buf.type, 0);
+		else
+			glVertexArrayAttribFormat(m_idVAO, attrLocation, buf.size, buf.type, buf.normalized, 0);
+		glVertexArrayAttribBinding(m_idVAO, attrLocation, attrLocation);
+		glVertexArrayVertexBuffer(m_idVAO, attrLocation, buf.id, offset, buf.stride);
+		return;
+	}
+
+	// expects the VAO and the buffer to be bound
+	if (buf.integer)
+		glVertexAttribIPointer(attrLocation, buf.size, buf.type, buf.stride, reinterpret_cast<void*>(offset));
+	else
+		glVertexAttribPointer(attrLocation, buf.size, buf.type, buf.normalized, buf.stride, reinterpret_cast<void*>(offset));
+}
+
 void C3dglVertexAttrObject::render(glm::mat4 matrix, GLsizei instances, C3dglProgram* pProgram) const
+{
+	prepareRender(matrix, pProgram);
+	render(instances);
+}
+
+void C3dglVertexAttrObject::renderIndirect(glm::mat4 matrix, GLuint idIndirect, size_t offset, GLsizei drawCount, C3dglProgram* pProgram) const
+{
+	prepareRender(matrix, pProgram);
+	renderIndirect(idIndirect, offset, drawCount);
+}
+
+void C3dglVertexAttrObject::renderRanges(glm::mat4 matrix, const GLuint* first, const GLsizei* count, size_t nRanges, C3dglProgram* pProgram) const
+{
+	prepareRender(matrix, pProgram);
+	renderRanges(first, count, nRanges);
+}
+
+void C3dglVertexAttrObject::prepareRender(glm::mat4 matrix, C3dglProgram* pProgram) const
 {
 	// check if a shading program is active
 	if (pProgram == NULL)
@@ -358,21 +747,42 @@ void C3dglVertexAttrObject::render(glm::mat4 matrix, GLsizei instances, C3dglPro
 		glLoadIdentity();
 		glMultMatrixf((GLfloat*)&matrix);
 	}
-
-	render(instances);
 }
 
 void C3dglVertexAttrObject::render(GLsizei instances) const
 {
-	GLuint prevVAO;
-	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, (GLint*)&prevVAO);
-	if (prevVAO != m_idVAO)
-		glBindVertexArray(m_idVAO);
+	m_nDraws++;
+	C3dglProgram::flushUniformBlocks();
+
+	C3dglState::bindVertexArray(m_idVAO);	// left bound: the next draw of this VAO needs no bind
+	void* indices = reinterpret_cast<void*>(m_firstIndex * getIndexSize(m_indexType));
 	if (instances == 1)
-		glDrawElements(GL_TRIANGLES, (GLsizei)m_nIndices, GL_UNSIGNED_INT, 0);
+		glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)m_nIndices, m_indexType, indices, m_baseVertex);
+	else
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, (GLsizei)m_nIndices, m_indexType, indices, instances, m_baseVertex);
+}
+
+
+void C3dglVertexAttrObject::renderIndirect(GLuint idIndirect, size_t offset, GLsizei drawCount) const
+{
+	m_nDraws++;
+	C3dglProgram::flushUniformBlocks();
+
+	C3dglState::bindVertexArray(m_idVAO);
+	C3dglState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, idIndirect);
+	if (drawCount == 1)
+		glDrawElementsIndirect(GL_TRIANGLES, m_indexType, reinterpret_cast<void*>(offset));
 	else
-		glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)m_nIndices, GL_UNSIGNED_INT, 0, instances);
-	if (prevVAO != m_idVAO)
-		glBindVertexArray(prevVAO);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, m_indexType, reinterpret_cast<void*>(offset), drawCount, 0);
 }
 
+void C3dglVertexAttrObject::renderRanges(const GLuint* first, const GLsizei* count, size_t nRanges) const
+{
+	m_nDraws++;
+	C3dglProgram::flushUniformBlocks();
+
+	C3dglState::bindVertexArray(m_idVAO);
+	void* indices = reinterpret_cast<void*>(m_firstIndex * getIndexSize(m_indexType));
+	for (size_t i = 0; i < nRanges; i++)
+		glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, (GLsizei)m_nIndices, m_indexType, indices, count[i], m_baseVertex, first[i]);
+}
@@ -2,6 +2,9 @@
 
 #include "pch.h"
 
+// other platforms build a shared library with no entry point
+#ifdef _WIN32
+
 #define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers
 // Windows Header Files
 #include <windows.h>
@@ -27,3 +30,5 @@ BOOL APIENTRY DllMain( HMODULE hModule,
     return TRUE;
 }
 
+#endif
+
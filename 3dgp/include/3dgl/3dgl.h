@@ -33,6 +33,19 @@ freely, subject to the following restrictions:
 #include "Terrain.h"
 #include "SkyBox.h"
 #include "Bitmap.h"
+#include "Frustum.h"
+#include "HiZ.h"
+#include "SpatialIndex.h"
+#include "State.h"
+#include "GeometryPool.h"
+#include "RenderQueue.h"
+#include "StaticBatch.h"
+#include "StreamBuffer.h"
+#include "TexturePool.h"
+#include "CommandList.h"
+#include "Headless.h"
+#include "Profiler.h"
+#include "Simulation.h"
 
 // link with AssImp and DevIL libraries
 #pragma comment (lib, "assimp-vc143-mt.lib") 
@@ -33,6 +33,9 @@ freely, subject to the following restrictions:
 // that uses this DLL. This way any other project whose source files include this file see
 // MY3DGL_API functions as being imported from a DLL, whereas this DLL sees symbols
 // defined with this macro as being exported.
+// Other compilers (e.g. GCC for the headless Linux builds - see Headless.h) build a shared library with the default visibility.
+#ifdef _MSC_VER
+
 #ifdef MY3DGL_EXPORTS
 #define MY3DGL_API __declspec(dllexport)
 #else
@@ -49,4 +52,10 @@ struct MY3DGL_API std::_Container_base12;
 union MY3DGL_API std::_String_val<std::_Simple_types<char>>::_Bxty;
 template class MY3DGL_API std::_String_val<std::_Simple_types<char>>;
 template class MY3DGL_API std::_Compressed_pair<std::allocator<char>, std::_String_val<std::_Simple_types<char>>, true>;
-template class MY3DGL_API std::basic_string<char, std::char_traits<char>, std::allocator<char>>;
\ No newline at end of file
+template class MY3DGL_API std::basic_string<char, std::char_traits<char>, std::allocator<char>>;
+
+#else
+
+#define MY3DGL_API __attribute__((visibility("default")))
+
+#endif
\ No newline at end of file
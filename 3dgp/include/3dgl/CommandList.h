@@ -0,0 +1,145 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Command lists: draw commands recorded with no OpenGL calls, so that worker threads
+can traverse the scene in parallel. The lists are merged into a render queue and
+replayed - sorted by the state - on the OpenGL thread.
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+
+#ifndef __3dglCommandList_h_
+#define __3dglCommandList_h_
+
+#include "Object.h"
+
+// standard libraries
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../glm/mat4x4.hpp"
+
+namespace _3dgl
+{
+	class C3dglProgram;
+	class C3dglMaterial;
+	class C3dglVertexAttrObject;
+	class C3dglRenderQueue;
+
+	class MY3DGL_API C3dglCommandList : public C3dglObject
+	{
+	public:
+		// a draw command - the arguments of C3dglRenderQueue::submit
+		struct COMMAND
+		{
+			const C3dglVertexAttrObject* pVAO;
+			const C3dglMaterial* pMaterial;		// NULL if none
+			C3dglProgram* pProgram;				// NULL for the program current when the list is submitted
+			glm::mat4 matrix;					// model-view matrix
+			float depth;						// distance from the eye (view space)
+			GLsizei instances;
+			unsigned pass;
+		};
+
+	private:
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		std::vector<COMMAND> m_commands;
+#pragma warning(pop)
+
+	public:
+		C3dglCommandList() : C3dglObject() { }
+
+		// Records a command - see C3dglRenderQueue::submit. No OpenGL calls are made: may be called from any thread,
+		// but each list should only be used by one thread at a time
+		void record(const C3dglVertexAttrObject* pVAO, const C3dglMaterial* pMaterial, glm::mat4 matrix, float depth, GLsizei instances = 1, C3dglProgram* pProgram = NULL, unsigned pass = 0);
+		// as above, the depth taken from the origin of the model-view matrix
+		void record(const C3dglVertexAttrObject* pVAO, const C3dglMaterial* pMaterial, glm::mat4 matrix, GLsizei instances = 1, C3dglProgram* pProgram = NULL, unsigned pass = 0);
+
+		// the memory is kept for the next frame
+		void clear()								{ m_commands.clear(); }
+
+		size_t getSize() const						{ return m_commands.size(); }
+		const COMMAND& getCommand(size_t i) const	{ return m_commands[i]; }
+
+		std::string getName() const { return "Command List"; }
+	};
+
+	// Worker threads recording command lists. The threads are created once and wait between the frames; each call to record
+	// distributes the jobs (e.g. one per model or per group of instances) among them - and the calling thread, which takes part, too.
+	// Each job records into its own list, so the result does not depend on the scheduling.
+	class MY3DGL_API C3dglCommandRecorder : public C3dglObject
+	{
+	public:
+		typedef std::function<void(size_t iJob, C3dglCommandList& list)> JOB;
+
+	private:
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		std::vector<std::thread> m_threads;
+		std::vector<C3dglCommandList> m_lists;	// one per job
+		JOB m_job;
+		std::atomic<size_t> m_nextJob;			// the next job to be taken
+		std::mutex m_mutex;
+		std::condition_variable m_cvWork;		// workers wait for a new generation (or quit)
+		std::condition_variable m_cvDone;		// record waits for all workers to finish
+#pragma warning(pop)
+		size_t m_nJobs = 0;
+		unsigned m_generation = 0;				// incremented with each call to record
+		unsigned m_nBusy = 0;					// workers still running the current generation
+		bool m_bQuit = false;
+
+	public:
+		C3dglCommandRecorder() : C3dglObject(), m_nextJob(0) { }
+		~C3dglCommandRecorder() { destroy(); }
+
+		// starts nThreads worker threads; 0 for one less than the number of hardware threads. Without the workers, all jobs run on the calling thread
+		void create(unsigned nThreads = 0);
+		void destroy();
+
+		// Runs job(i, list) for each i in [0, nJobs), and returns when all are done. The lists are cleared before.
+		// The jobs run concurrently: they must not call OpenGL, nor change any shared data (the models are only read)
+		void record(size_t nJobs, JOB job);
+
+		// submits the lists recorded by the last call to record, in the job order - must be called on the OpenGL thread
+		void submit(C3dglRenderQueue& queue) const;
+
+		size_t getThreadCount() const				{ return m_threads.size(); }
+		size_t getListCount() const					{ return m_nJobs; }
+		const C3dglCommandList& getList(size_t i) const { return m_lists[i]; }
+		size_t getCommandCount() const;
+
+		std::string getName() const { return "Command Recorder"; }
+
+	private:
+		void worker(unsigned generation);	// generation: the last one already done
+		void work();
+	};
+}; // namespace _3dgl
+
+#endif
@@ -60,6 +60,14 @@ namespace _3dgl
 		UNI_COUNT							// total standard unoform count
 	};
 
+	// Standard Uniform Blocks - values are also their binding points (see C3dglProgram::sendPerFrame)
+	enum UNI_BLOCK_STD {
+		UNI_BLOCK_PER_FRAME,				// camera and lights - shared by all programs
+		UNI_BLOCK_PER_OBJECT,				// the standard uniforms: model-view matrix and material colours
+
+		UNI_BLOCK_COUNT
+	};
+
 	// Maximum Bones per Vertex
 	const int MAX_BONES_PER_VERTEX = 4;
 
@@ -0,0 +1,76 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+View frustum class: six planes extracted from a projection x view matrix,
+used for bounding volume visibility tests. The tests check four planes at a time
+(SSE), with a scalar fallback on other platforms.
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+
+#ifndef __3dglFrustum_h_
+#define __3dglFrustum_h_
+
+// Include GLM core features
+#include "../glm/glm.hpp"
+
+// Include 3DGL API import/export settings
+#include "3dglapi.h"
+
+namespace _3dgl
+{
+	class MY3DGL_API C3dglFrustum
+	{
+		glm::vec4 m_planes[6];		// left, right, bottom, top, near, far; normals pointing inside; normalised
+		float m_soa[4][8];			// the planes transposed (x, y, z, w), padded to 8 with copies of the far plane - for SIMD tests
+
+	public:
+		C3dglFrustum();
+		// matrix is projection x view - then the frustum is defined in world coordinates,
+		// or projection x view x model - then the frustum is defined in the model's local coordinates
+		C3dglFrustum(glm::mat4 matrix)				{ set(matrix); }
+
+		void set(glm::mat4 matrix);
+		const glm::vec4& getPlane(unsigned i) const	{ return m_planes[i]; }
+
+		// visibility tests - conservative: may return true for some volumes just outside the frustum, never false for visible ones
+		bool isVisible(glm::vec3 point) const;
+		bool isVisible(glm::vec3 centre, float radius) const;
+		bool isVisible(const glm::vec3 aabb[2]) const;
+
+		// classification: OUTSIDE, INSIDE (entirely) or INTERSECT (crossing at least one plane; conservative, as above)
+		enum CLASS { OUTSIDE, INTERSECT, INSIDE };
+		CLASS classify(glm::vec3 centre, float radius) const;
+		CLASS classify(const glm::vec3 aabb[2]) const;
+		// bounding sphere early-out: the sphere is tested first, and only if it crosses a plane, the (usually tighter) box
+		CLASS classify(const glm::vec3 aabb[2], glm::vec3 centre, float radius) const;
+
+	private:
+		// the box given by its centre and half-extents; a sphere has all half-extents equal to 0 and a radius
+		CLASS classify(glm::vec3 centre, glm::vec3 extent, float radius) const;
+	};
+
+}; // namespace _3dgl
+
+#endif
@@ -0,0 +1,109 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Geometry pool: large, shared vertex and index buffers, one pair per vertex format,
+sub-allocated with a free-list allocator. Objects stored in the pool share its VAO
+and are drawn with base-vertex draws, so no VAO switch is needed between them.
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+
+#ifndef __3dglGeometryPool_h_
+#define __3dglGeometryPool_h_
+
+#include "Object.h"
+#include "VAO.h"
+
+// standard libraries
+#include <map>
+#include <vector>
+
+namespace _3dgl
+{
+	class MY3DGL_API C3dglGeometryPool : public C3dglObject
+	{
+		// free-list allocator: free blocks, sorted by the first element; adjacent blocks are always merged
+		typedef std::map<size_t, size_t> FREE_LIST;		// first -> count
+
+		// vertex & index buffers for a single vertex format and index type
+		struct ARENA
+		{
+			VERTEX_FORMAT format;
+			GLenum indexType = GL_UNSIGNED_INT;	// GL_UNSIGNED_INT or GL_UNSIGNED_SHORT
+			GLuint idVAO = 0;
+			GLuint idVertex = 0;
+			GLuint idIndex = 0;
+			size_t vertexCapacity = 0;		// in vertices
+			size_t indexCapacity = 0;		// in indices
+			FREE_LIST freeVertices;
+			FREE_LIST freeIndices;
+		};
+
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		std::vector<ARENA> m_arenas;
+#pragma warning(pop)
+		size_t m_initVertices;				// initial capacity of each arena
+		size_t m_initIndices;
+
+	public:
+		C3dglGeometryPool(size_t initVertices = 65536, size_t initIndices = 196608);
+		~C3dglGeometryPool() { destroy(); }
+
+		void destroy();
+
+		// Stores nVertices interleaved vertices of the given format and nIndices indices (relative to the first vertex) of the given type.
+		// Returns the arena, and the location of the first vertex and index - as used by base-vertex draws.
+		// Arenas grow (doubling the capacity) if necessary - this is expensive, so create pools with a realistic initial capacity.
+		bool allocate(const VERTEX_FORMAT& format, const void* vertexData, size_t nVertices, const void* indexData, GLenum indexType, size_t nIndices,
+			unsigned& iArena, GLint& baseVertex, GLuint& firstIndex);
+		// releases the space - it will be reused by subsequent allocations
+		void free(unsigned iArena, GLint baseVertex, size_t nVertices, GLuint firstIndex, size_t nIndices);
+
+		size_t getArenaCount() const						{ return m_arenas.size(); }
+		GLuint getVAOid(unsigned iArena) const				{ return m_arenas[iArena].idVAO; }
+		GLuint getVertexBufferId(unsigned iArena) const		{ return m_arenas[iArena].idVertex; }
+		GLuint getIndexBufferId(unsigned iArena) const		{ return m_arenas[iArena].idIndex; }
+		const VERTEX_FORMAT& getFormat(unsigned iArena) const { return m_arenas[iArena].format; }
+		GLenum getIndexType(unsigned iArena) const			{ return m_arenas[iArena].indexType; }
+
+		// statistics: the capacity and the free space, in vertices and indices
+		size_t getVertexCapacity(unsigned iArena) const		{ return m_arenas[iArena].vertexCapacity; }
+		size_t getIndexCapacity(unsigned iArena) const		{ return m_arenas[iArena].indexCapacity; }
+		size_t getFreeVertices(unsigned iArena) const;
+		size_t getFreeIndices(unsigned iArena) const;
+
+		std::string getName() const { return "Geometry Pool"; }
+
+	private:
+		unsigned findOrAddArena(const VERTEX_FORMAT& format, GLenum indexType);
+		void growVertices(ARENA& arena, size_t minCapacity);
+		void growIndices(ARENA& arena, size_t minCapacity);
+		static GLuint growBuffer(GLuint idOld, size_t oldSize, size_t newSize);
+		static bool allocBlock(FREE_LIST& freeList, size_t count, size_t& first);
+		static void freeBlock(FREE_LIST& freeList, size_t first, size_t count);
+	};
+}; // namespace _3dgl
+
+#endif
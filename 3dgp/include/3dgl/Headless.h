@@ -0,0 +1,74 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Headless rendering: an OpenGL context with no window (EGL, surfaceless), rendering
+into a framebuffer object - for automated benchmarks and regression tests, e.g.
+on a Linux machine with no GPU, under Mesa llvmpipe.
+Available in builds with M3DGL_HEADLESS defined, linked with libEGL; GLEW must be
+built with EGL support (GLEW_EGL).
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+
+#ifndef __3dglHeadless_h_
+#define __3dglHeadless_h_
+
+#include "Object.h"
+
+namespace _3dgl
+{
+	class MY3DGL_API C3dglHeadless : public C3dglObject
+	{
+		void* m_display = NULL;					// EGLDisplay
+		void* m_context = NULL;					// EGLContext
+		GLuint m_idFBO = 0;
+		GLuint m_idColor = 0;					// renderbuffers
+		GLuint m_idDepth = 0;
+		GLsizei m_width = 0;
+		GLsizei m_height = 0;
+
+	public:
+		C3dglHeadless() : C3dglObject() { }
+		~C3dglHeadless() { destroy(); }
+
+		// Creates the context and makes it current, initialises GLEW, then creates a width x height framebuffer (RGBA8 colour, 24-bit depth),
+		// binds it and sets the viewport. Replaces the window creation and glewInit in a windowed application. The state cache is invalidated.
+		bool create(GLsizei width, GLsizei height);
+		void destroy();
+
+		// waits until all the rendering is complete - the equivalent of swapping the buffers, for time measurement
+		void finish() const;
+		// reads the colour buffer: width * height RGBA pixels, bottom row first
+		void readPixels(void* pixels) const;
+
+		bool isCreated() const						{ return m_context != NULL; }
+		GLuint getFramebufferId() const				{ return m_idFBO; }
+		GLsizei getWidth() const					{ return m_width; }
+		GLsizei getHeight() const					{ return m_height; }
+
+		std::string getName() const { return "Headless Context"; }
+	};
+}; // namespace _3dgl
+
+#endif
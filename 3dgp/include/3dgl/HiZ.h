@@ -0,0 +1,175 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Hierarchical-Z (Hi-Z) occlusion culling.
+A pyramid of farthest depths is built from the depth buffer, or from a pre-pass
+of large occluders, and bounding boxes are tested against it - on the GPU
+(compute shader) for instances and on the CPU (asynchronous readback) for models.
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+
+#ifndef __3dglHiZ_h_
+#define __3dglHiZ_h_
+
+// Include GLM core features
+#include "../glm/glm.hpp"
+
+#include "Object.h"
+#include "Shader.h"
+
+// standard libraries
+#include <vector>
+#include <cfloat>
+
+namespace _3dgl
+{
+	class C3dglModel;
+
+	class MY3DGL_API C3dglHiZ : public C3dglObject
+	{
+		int m_width = 0, m_height = 0;		// size of the depth source (and of the pyramid level 0)
+		int m_nLevels = 0;					// number of pyramid levels
+
+		GLuint m_idDepth = 0;				// depth texture: copy of the depth buffer or the occluder pre-pass target
+		GLuint m_idFBODepth = 0;			// framebuffer for the occluder pre-pass
+		GLuint m_idPyramid = 0;				// GL_R32F texture, full mip chain; each texel holds the farthest depth of its footprint
+		GLuint m_idFBO = 0;					// framebuffer used to build the pyramid
+		GLuint m_idVAO = 0;					// empty VAO, for the full-screen triangle
+
+		C3dglProgram m_progReduce;			// builds the pyramid, one level at a time
+		C3dglProgram m_progCull;			// GPU instance culling (compute shader)
+		bool m_bCompute = false;			// true if compute shaders are available
+
+		glm::mat4 m_matrixViewProj;			// projection x view matrix used to render the depth the pyramid was built from
+		bool m_bBuilt = false;				// false until the first build - no occlusion culling before then
+
+		// CPU readback: a coarse level of the pyramid is downloaded asynchronously, through a pair of pixel buffers
+		bool m_bReadback = false;
+		int m_readLevel = 0, m_readWidth = 0, m_readHeight = 0;
+		GLuint m_idPBO[2] = { 0, 0 };
+		GLsync m_fences[2] = { NULL, NULL };
+		glm::mat4 m_matrixPBO[2];
+		int m_iPBO = 0;
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		std::vector<float> m_readback;		// the last level downloaded; empty if none available yet
+#pragma warning(pop)
+		glm::mat4 m_matrixReadback;			// projection x view matrix matching m_readback
+
+		// state saved by beginOccluders
+		GLuint m_prevFBO = 0;
+		GLint m_prevViewport[4] = { 0, 0, 0, 0 };
+
+	public:
+		C3dglHiZ();
+		~C3dglHiZ() { destroy(); }
+
+		// create (or re-create after the window has been resized) the pyramid for the given size of the depth buffer
+		bool create(int width, int height);
+		void destroy();
+
+		int getWidth() const						{ return m_width; }
+		int getHeight() const						{ return m_height; }
+		int getLevelCount() const					{ return m_nLevels; }
+		GLuint getPyramidId() const					{ return m_idPyramid; }
+		bool isComputeAvailable() const				{ return m_bCompute; }
+		glm::mat4 getMatrix() const					{ return m_matrixViewProj; }
+
+		// Depth sources - use one of them, then call build.
+		// Copy the depth buffer of the framebuffer currently bound for reading - typically at the end of the frame (before swapping),
+		// so that the next frame is culled against this frame's depth
+		void copyDepth();
+		// Depth pre-pass of large occluders (e.g. the terrain): render them between the two calls, with the usual shader program
+		void beginOccluders();
+		void endOccluders();
+
+		// Builds the pyramid. matrixViewProj is the projection x view matrix used to render the depth source.
+		// The depth source is assumed to cover the entire viewport.
+		void build(glm::mat4 matrixViewProj);
+
+		// CPU readback - disabled by default. When enabled, each build schedules a download of a coarse pyramid level,
+		// available for isVisible tests a frame or two later
+		void setReadback(bool b)					{ m_bReadback = b; }
+		bool getReadback() const					{ return m_bReadback; }
+
+		// CPU visibility test of a bounding box (e.g. from C3dglModel::getAABB), transformed with the model matrix (without the view).
+		// Conservative: returns true if no readback data available
+		bool isVisible(const glm::vec3 aabb[2], glm::mat4 matrixModel = glm::mat4(1)) const;
+
+		// GPU instance culling (low-level; see C3dglHiZInstances for a more convenient interface).
+		// Instance positions (vec3) from idSrc are frustum-culled using matrixViewProj, occlusion-culled against the pyramid,
+		// and the visible ones are written, compacted, to idDst. aabb is the world bounding box of the model rendered at the origin.
+		// idIndirect holds nCommands DRAW_ELEMENTS_INDIRECT_COMMAND structures; the instance count of each one is set to the number of visible instances.
+		void cullInstances(GLuint idSrc, GLuint idDst, size_t nInstances, GLuint idIndirect, size_t nCommands, const glm::vec3 aabb[2], glm::mat4 matrixViewProj);
+
+		std::string getName() const { return "Hi-Z Pyramid"; }
+
+	private:
+		void readback();
+	};
+
+	// A set of model instances, culled on the GPU against a C3dglHiZ pyramid and rendered with indirect draws.
+	// Replaces C3dglModel::createVertexBuffers for the instance offset attribute (vec3 aOffset in the basic shader).
+	class MY3DGL_API C3dglHiZInstances : public C3dglObject
+	{
+		C3dglModel* m_pModel = NULL;		// instanced model
+		size_t m_nInstances = 0;			// number of instances
+		GLuint m_idSrc = 0;					// all instance positions
+		GLuint m_idDst = 0;					// visible instance positions - the attribute buffer actually rendered
+		GLuint m_idIndirect = 0;			// one indirect draw command per mesh
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		std::vector<glm::vec3> m_positions;	// instance positions, in the original order
+		std::vector<unsigned> m_order;		// order of instances in the buffer; empty if not sorted
+#pragma warning(pop)
+		glm::vec3 m_sortEye;				// eye position of the last sort
+
+	public:
+		C3dglHiZInstances() : C3dglObject(), m_sortEye(FLT_MAX)	{ }
+		~C3dglHiZInstances() { destroy(); }
+
+		// create buffers for instances and attach them to each mesh of the model
+		bool create(C3dglModel* pModel, GLint attrLocation, size_t instances, const glm::vec3* data);
+		void destroy();
+
+		// update positions of count instances starting from first - no reallocation takes place
+		void update(size_t first, size_t count, const glm::vec3* data);
+
+		// front to back sorting - see C3dglModel::sortInstances. Culling roughly preserves the order of the visible instances
+		bool sort(glm::vec3 eye, float minMove = 1.0f);
+
+		// culling and rendering. matrixModel is the model matrix without the view (the one the instances are rendered with)
+		void cull(C3dglHiZ& hiz, glm::mat4 matrixModel, glm::mat4 matrixViewProj);
+		void render(glm::mat4 matrix, C3dglProgram* pProgram = NULL) const;
+
+		size_t getInstanceCount() const			{ return m_nInstances; }
+		GLuint getIndirectBufferId() const		{ return m_idIndirect; }
+
+		std::string getName() const { return "Hi-Z Instances"; }
+	};
+
+}; // namespace _3dgl
+
+#endif
@@ -51,6 +51,7 @@ namespace _3dgl
 		M3DGL_SUCCESS_VERIFICATION,
 		M3DGL_SUCCESS_LOADED,
 		M3DGL_SUCCESS_LOADED_FROM_EMBED_FILE,
+		M3DGL_SUCCESS_UNIFORM_BLOCK_FOUND,				// shader.cpp
 
 		// Warnings
 		M3DGL_WARNING_GENERIC = 200,
@@ -98,6 +99,11 @@ namespace _3dgl
 		M3DGL_WARNING_CANNOT_LOAD,					// bitmap.cpp
 		M3DGL_WARNING_CANNOT_LOAD_FROM_EMBED_FILE,
 		M3DGL_WARNING_EMBED_FILE_UNKNOWN_FORMAT,
+		M3DGL_WARNING_PERSISTENT_BUFFERS_NOT_SUPPORTED,	// VAO.cpp, StreamBuffer.cpp
+		M3DGL_WARNING_COMPUTE_SHADERS_NOT_SUPPORTED,	// HiZ.cpp
+		M3DGL_WARNING_GEOMETRY_POOL_NOT_USED,			// VAO.cpp
+		M3DGL_WARNING_BATCH_NOT_AVAILABLE,				// model.cpp
+		M3DGL_WARNING_TIMER_QUERIES_NOT_SUPPORTED,		// Profiler.cpp
 
 		// Errors
 		M3DGL_ERROR_GENERIC = 500,
@@ -115,7 +121,14 @@ namespace _3dgl
 		M3DGL_ERROR_PROGRAM_NOT_CREATED,
 		M3DGL_ERROR_UNKNOWN_LINKING_ERROR,
 
-		M3DGL_INTERNAL_ERROR
+		M3DGL_INTERNAL_ERROR,
+
+		// further errors - after M3DGL_INTERNAL_ERROR, so that the original codes keep their values
+		M3DGL_ERROR_BUFFER_NOT_FOUND,					// VAO.cpp
+		M3DGL_ERROR_BUFFER_OVERFLOW,
+		M3DGL_ERROR_POOLED_VERTEX_BUFFER,
+		M3DGL_ERROR_FRAMEBUFFER_INCOMPLETE,				// HiZ.cpp, Headless.cpp
+		M3DGL_ERROR_HEADLESS_CONTEXT,					// Headless.cpp
 	};
 
 	class MY3DGL_API C3dglLogger
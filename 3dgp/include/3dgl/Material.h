@@ -52,6 +52,10 @@ namespace _3dgl
 		// texture id
 		unsigned m_idTexture[GL_TEXTURE31 - GL_TEXTURE0 + 1];
 
+		// texture array & layer, if the texture has been pooled (see C3dglTexturePool); layer is -1 if not
+		unsigned m_idTexArray[GL_TEXTURE31 - GL_TEXTURE0 + 1];
+		int m_texLayer[GL_TEXTURE31 - GL_TEXTURE0 + 1];
+
 		// materials
 		bool m_bAmb, m_bDiff, m_bSpec, m_bEmiss, m_bShininess;
 		glm::vec3 m_amb, m_diff, m_spec, m_emiss;
@@ -67,8 +71,11 @@ namespace _3dgl
 		void create(const aiMaterial* pMat, const char* pDefTexPath);
 		void destroy();
 
+		// render sets the material up and backs up the previous state; postRender restores it
 		void render(C3dglProgram*) const;
 		void postRender(C3dglProgram*) const;
+		// sets the material up, with no backup - used by the render queue
+		void bind(C3dglProgram*) const;
 
 		bool getAmbient(glm::vec3& val)	const	{ if (!m_bAmb) return false; val = m_amb; return true;  }
 		bool getDiffuse(glm::vec3& val)	const	{ if (!m_bDiff) return false; val = m_diff; return true; }
@@ -84,12 +91,16 @@ namespace _3dgl
 
 		bool getTexture(GLenum texUnit, unsigned& idTex) const { unsigned i = m_idTexture[texUnit - GL_TEXTURE0];  if (i == 0xffffffff) return false; idTex = i; return true; }
 		bool getTexture(GLenum texUnit) const { return (m_idTexture[texUnit - GL_TEXTURE0] != 0xffffffff); }
+		bool getTextureLayer(GLenum texUnit, unsigned& idArray, int& layer) const { int i = texUnit - GL_TEXTURE0; if (m_texLayer[i] < 0) return false; idArray = m_idTexArray[i]; layer = m_texLayer[i]; return true; }
+		bool getTextureLayer(GLenum texUnit) const { return m_texLayer[texUnit - GL_TEXTURE0] >= 0; }
 
 		void setAmbient(glm::vec3 colour)	{ m_bAmb = true; m_amb = colour; }
 		void setDiffuse(glm::vec3 colour)	{ m_bDiff = true; m_diff = colour; }
 		void setSpecular(glm::vec3 colour)	{ m_bSpec = true; m_spec = colour; }
 		void setEmissive(glm::vec3 colour)	{ m_bEmiss = true; m_emiss = colour; }
 		void setShininess(float s)			{ m_bShininess = true; m_shininess = s; }
+		// the texture on texUnit is also available as a layer of a texture array - used by batched rendering (see C3dglModel::createBatch)
+		void setTextureLayer(GLenum texUnit, unsigned idArray, int layer)	{ m_idTexArray[texUnit - GL_TEXTURE0] = idArray; m_texLayer[texUnit - GL_TEXTURE0] = layer; }
 
 		void loadTexture(GLenum texUnit, std::string strPath);
 		void loadTexture(GLenum texUnit, std::string strTexRootPath, std::string strPath);
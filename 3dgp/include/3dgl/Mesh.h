@@ -58,9 +58,11 @@ namespace _3dgl
 		glm::vec3 m_aabb[2];		// Bounding Volume
 
 	protected:
-		size_t getBuffers(const aiMesh* pMesh, const GLint *attrId, size_t attrCount, void** attrData, size_t* attrSize) const;
+		// with bQuantized, pQuantized receives the bitmask (1 << ATTR_xxx) of the buffers converted by quantize - pass it to cleanUp
+		size_t getBuffers(const aiMesh* pMesh, const GLint *attrId, size_t attrCount, void** attrData, size_t* attrSize, bool bQuantized = false, unsigned* pQuantized = NULL) const;
+		unsigned quantize(const aiMesh* pMesh, const GLint* attrId, size_t attrCount, void** attrData, size_t* attrSize) const;	// called by getBuffers; returns the bitmask of the converted buffers
 		size_t getIndexBuffer(const aiMesh* pMesh, void** indexData, size_t *indSize) const;
-		void cleanUp(size_t attrCount, void** attrData, void *indexData) const;		// call after getBuffers well data no longer required
+		void cleanUp(size_t attrCount, void** attrData, void *indexData, unsigned quantized = 0) const;		// call after getBuffers well data no longer required
 		void getBoundingVolume(const aiMesh* pMesh, size_t nVertices, glm::vec3& aabb0, glm::vec3& aabb1) const;
 
 	public:
@@ -68,7 +70,9 @@ namespace _3dgl
 		virtual ~C3dglMesh() { destroy(); }
 
 		// Create a mesh using ASSIMP data and a shader progrem (currently used one if NULL)
-		void create(const aiMesh* pMesh, C3dglProgram* pProgram = NULL);
+		// If bInterleaved, all vertex attributes are stored in a single, interleaved buffer; if pPool provided, they are stored in the geometry pool
+		// If bQuantized, compact formats are used for the normals, tangents, texture coords, colours and bone data (see C3dglModel::setQuantizedFlag)
+		void create(const aiMesh* pMesh, C3dglProgram* pProgram = NULL, bool bInterleaved = false, C3dglGeometryPool* pPool = NULL, bool bQuantized = false);
 
 		// Using ASSIMP data, read attribute or index buffer data. A binary buffer will be allocated and a pointer stored in *ppData, 
 		// *indSize will be filled with the element size and the function returns number of elements (0 if data unavailable).
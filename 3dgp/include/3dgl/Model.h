@@ -42,6 +42,7 @@ freely, subject to the following restrictions:
 #include "Material.h"
 #include "Mesh.h"
 #include "Animation.h"
+#include "Frustum.h"
 
 // standard libraries
 #include <vector>
@@ -55,12 +56,20 @@ struct aiNode;
 namespace _3dgl
 {
 	class C3dglProgram;
+	class C3dglRenderQueue;
+	class C3dglCommandList;
 
 	class MY3DGL_API C3dglModel : public C3dglObject
 	{
 		const aiScene* m_pScene;					// parent scene (the main AssImp object)
 		std::string m_name;							// model name (derived from the filename)
 		bool m_bFBXImportPreservePivots;			// binary flag needed to tweak some quirky effects in AssImp FBX importer. Should be set to false
+		bool m_bInterleaved;						// interleaved vertex buffer layout flag
+		C3dglGeometryPool* m_pPool;					// geometry pool the meshes are stored in; NULL if none
+		bool m_bQuantized;							// quantized vertex formats flag
+		bool m_bCullingSphere;						// bounding sphere early-out in frustum culling
+		C3dglRenderQueue* m_pQueue;					// render queue the meshes are submitted to; NULL if rendered immediately
+		unsigned m_queuePass;						// render queue pass
 
 		// vectrors of meshes, materials and animations
 #pragma warning(push)
@@ -73,7 +82,55 @@ namespace _3dgl
 		std::vector<std::pair<std::string, glm::mat4> > m_vecBones;	// maps ids to pairs<bone name, bone offset matrix>
 		std::map<std::string, size_t> m_mapBones;	// maps bone names back to ids
 		glm::mat4 m_globInvT;						// global transformation matrix (transposed)
+
+		// Flattened node hierarchy, built at create: depth-first order (parents before children), so that the subtree of node i
+		// is the range [i, end). Rendering and bounding boxes run a single loop - no recursion, no matrix conversions, no allocation
+		struct NODE
+		{
+			const aiNode* pNode;
+			glm::mat4 global;						// transform relative to the model (the root node transform included)
+			int parent;								// parent node; -1 for the root
+			unsigned end;							// one past the last node of the subtree
+			unsigned firstMesh;						// meshes of the node: range of m_nodeMeshes
+			unsigned nMeshes;
+			glm::vec3 aabb[2];						// bounding box of the node's own meshes, relative to the model; empty (min > max) if none
+			glm::vec4 sphere;						// bounding sphere of the box: centre & radius
+			glm::vec3 subtreeAABB[2];				// as above, for the node and all its descendants
+			glm::vec4 subtreeSphere;
+		};
+		std::vector<NODE> m_nodes;
+		std::vector<unsigned> m_nodeMeshes;			// mesh indices of all nodes, in the node order
+		std::vector<unsigned> m_mainNodes;			// the main nodes (children of the root) - indices to m_nodes
+
+		// Instance cells: contiguous ranges of the instance buffer, each one with its own bounding box (see createInstanceCells)
+		struct CELL
+		{
+			glm::vec3 aabb[2];						// bounding box of all instances in the cell (world coordinates)
+			GLuint first;							// first instance
+			GLuint count;							// number of instances
+		};
+		std::vector<CELL> m_cells;
+		std::vector<glm::vec3> m_instances;			// instance positions, in the buffer order (grouped by cells)
+		std::vector<unsigned> m_cellOrder;			// order of rendering cells; empty if not sorted
+		mutable std::vector<GLuint> m_rangeFirst;	// ranges of visible instances, collected at render time
+		mutable std::vector<GLsizei> m_rangeCount;
+
+		// Multi-draw batch: one indirect command per mesh, commands sharing the same textures are issued together (see createBatch)
+		struct BATCH_RUN
+		{
+			GLuint first;							// first command
+			GLsizei count;							// number of commands
+			const C3dglMaterial* pMaterial;			// material (textures) of the run; NULL if none
+		};
+		std::vector<BATCH_RUN> m_batchRuns;
 #pragma warning(pop)
+		GLuint m_idCellIndirect = 0;				// indirect draw commands for visible cells; 0 if multi-draw not supported
+		GLint m_cellAttrLocation = -1;				// instance attribute location
+		glm::vec3 m_sortEye;						// eye position of the last sort (see sortInstances)
+		GLuint m_idBatchIndirect = 0;				// batch indirect commands; 0 if no batch created
+		GLuint m_idBatchDraws = 0;					// batch shader storage buffers: per draw, per material and per instance data
+		GLuint m_idBatchMaterials = 0;
+		GLuint m_idBatchInstances = 0;
 
 	public:
 		C3dglModel();
@@ -100,6 +157,37 @@ namespace _3dgl
 		bool getFBXImportPreservePivotsFlag() const	 { return m_bFBXImportPreservePivots; }
 		void setFBXImportPreservePivotsFlag(bool b)	 { m_bFBXImportPreservePivots = b; }
 
+		// Vertex buffer layout. If true, all vertex attributes of each mesh are stored in a single, interleaved buffer (one vertex after another),
+		// for better vertex fetch locality; otherwise a separate buffer is created for each attribute. By default set to false.
+		// Note: this flag should be set before calling load or create funcion!
+		bool getInterleavedFlag() const				 { return m_bInterleaved; }
+		void setInterleavedFlag(bool b)				 { m_bInterleaved = b; }
+
+		// Geometry pool. If set, the meshes are stored in the pool (interleaved) rather than in their own buffers, and share the pool's VAO
+		// with all other meshes of the same vertex format. Instance buffers (createVertexBuffers) are not available for pooled models.
+		// Note: the pool should be set before calling load or create funcion, and must outlive the model!
+		C3dglGeometryPool* getGeometryPool() const	 { return m_pPool; }
+		void setGeometryPool(C3dglGeometryPool* p)	 { m_pPool = p; }
+
+		// Quantized vertex formats. If true, normals and tangents are stored as GL_INT_2_10_10_10_REV (the tangent's w holding the handedness,
+		// bitangents are not stored and should be rebuilt in the vertex shader as cross(normal, tangent.xyz) * tangent.w), texture coords
+		// as half floats, colours, bone ids and weights as bytes. Vertex buffers are 2-3 times smaller. By default set to false.
+		// Note: this flag should be set before calling load or create funcion!
+		bool getQuantizedFlag() const				 { return m_bQuantized; }
+		void setQuantizedFlag(bool b)				 { m_bQuantized = b; }
+
+		// Frustum culling of nodes (see render and renderNode with the projection matrix): if true, the bounding sphere of each node
+		// is tested first, and the box only if the sphere crosses the frustum boundary. By default set to true.
+		bool getCullingSphereFlag() const			 { return m_bCullingSphere; }
+		void setCullingSphereFlag(bool b)			 { m_bCullingSphere = b; }
+
+		// Render queue. If set, render functions do not draw the meshes, but submit them to the queue, to be drawn (sorted by the state
+		// and depth) when the queue is flushed - see C3dglRenderQueue. The materials are not restored after rendering in this mode.
+		// Indirect and instance cell rendering always draw immediately. The queue must outlive the model (or be reset to NULL).
+		C3dglRenderQueue* getRenderQueue() const	 { return m_pQueue; }
+		unsigned getRenderQueuePass() const			 { return m_queuePass; }
+		void setRenderQueue(C3dglRenderQueue* p, unsigned pass = 0) { m_pQueue = p; m_queuePass = pass; }
+
 		// Rendering
 		// render the entire model
 		void render(glm::mat4 matrix, GLsizei instances = 1, C3dglProgram* pProgram = NULL) const;
@@ -107,6 +195,17 @@ namespace _3dgl
 		void render(unsigned iNode, glm::mat4 matrix, GLsizei instances = 1, C3dglProgram* pProgram = NULL) const;
 		// render a single node
 		void renderNode(aiNode* pNode, glm::mat4 m, GLsizei instances = 1, C3dglProgram* pProgram = NULL) const;
+		// render the entire model, or a single node, skipping the nodes outside of the view frustum. matrix is the model-view matrix.
+		// Node bounds are computed once, at load, from the meshes in their bind pose - animated meshes may stick out of them a little
+		void render(glm::mat4 matrix, glm::mat4 matrixProjection, C3dglProgram* pProgram = NULL) const;
+		void renderNode(aiNode* pNode, glm::mat4 m, glm::mat4 matrixProjection, C3dglProgram* pProgram = NULL) const;
+		// render the entire model, with frustum culling of the instance cells (if any). The frustum is in world coordinates
+		void render(glm::mat4 matrix, const C3dglFrustum& frustum, C3dglProgram* pProgram = NULL) const;
+		// render the entire model using indirect draws: mesh i reads its DRAW_ELEMENTS_INDIRECT_COMMAND from idIndirect at index i
+		void renderIndirect(glm::mat4 matrix, GLuint idIndirect, C3dglProgram* pProgram = NULL) const;
+		// record the draw commands of the entire model, to be submitted to a render queue later. No OpenGL calls are made,
+		// so it is safe to call from a worker thread (see C3dglCommandRecorder) - as long as the model is not modified meanwhile
+		void record(C3dglCommandList& list, glm::mat4 matrix, GLsizei instances = 1, C3dglProgram* pProgram = NULL, unsigned pass = 0) const;
 		// returns the count of main nodes
 		unsigned getMainNodeCount() const;
 
@@ -114,6 +213,46 @@ namespace _3dgl
 		void createVertexBuffers(GLint attrLocation, size_t instances, GLint size, float* data, GLsizei stride = 0, GLuint divisor = 0, GLenum usage = GL_STATIC_DRAW);
 		void createVertexBuffers(GLint attrLocation, size_t instances, GLint size, int* data, GLsizei stride = 0, GLuint divisor = 0, GLenum usage = GL_STATIC_DRAW);
 
+		// Ring buffer creation: creates persistently mapped, multi-region attribute buffers for each mesh - for per-frame dynamic data
+		void createRingVertexBuffers(GLint attrLocation, size_t instances, GLint size, float* data, GLsizei stride = 0, GLuint divisor = 0, unsigned nFrames = 3);
+		void createRingVertexBuffers(GLint attrLocation, size_t instances, GLint size, int* data, GLsizei stride = 0, GLuint divisor = 0, unsigned nFrames = 3);
+
+		// Cell-clustered instancing: creates the instance attribute buffer (vec3 offsets, added to the world position) with instances
+		// sorted into square cells of cellSize in the XZ plane. Each cell is a contiguous range of instances with its own bounding box,
+		// so that whole cells can be culled at render time - see render(matrix, frustum).
+		// matrixModel is the model matrix (without the view) the instances will be rendered with.
+		void createInstanceCells(GLint attrLocation, size_t instances, const glm::vec3* data, float cellSize, glm::mat4 matrixModel = glm::mat4(1), GLenum usage = GL_STATIC_DRAW);
+		bool hasInstanceCells() const				{ return m_cells.size() > 0; }
+		size_t getInstanceCellCount() const			{ return m_cells.size(); }
+		size_t getInstanceCount() const				{ return m_instances.size(); }
+		const glm::vec3* getInstances() const		{ return m_instances.data(); }
+
+		// Front to back sorting of instance cells: the cells are rendered in the order of distance from the eye,
+		// and the instances within each cell are sorted (bucketed sort) - to maximise early depth test rejection.
+		// Nothing happens unless the eye moved by at least minMove since the last sort. Returns true if sorted.
+		bool sortInstances(glm::vec3 eye, float minMove = 1.0f);
+
+		// Multi-draw batching: the entire model - all meshes and all instances - is rendered with a single glMultiDrawElementsIndirect
+		// (or one per set of textures, if the materials use different textures). All meshes must be stored in the same arena of a geometry pool
+		// (see setGeometryPool). Per-mesh data is read by the vertex shader from shader storage buffers, indexed with gl_BaseInstance
+		// (GL 4.6 or GL_ARB_shader_draw_parameters) - see shaders/batch.vert for the layouts:
+		//   binding BATCH_DRAWS:     { mat4 matrix; uint material; } per draw - node transform (relative to the model) and material index
+		//   binding BATCH_MATERIALS: { vec4 ambient, diffuse, specular, emissive; ivec4 layers; } per material; w = 1 if the colour is defined, shininess in specular.w,
+		//                            texture array layers of GL_TEXTURE0 and GL_TEXTURE1 in layers.xy (-1 if not pooled)
+		//   binding BATCH_INSTANCES: vec4 per instance (indexed with gl_InstanceID) - offset added to the world position
+		// Materials whose textures are pooled in texture arrays (see C3dglTexturePool) are merged into a single draw; the arrays
+		// are bound to texture units BATCH_TEXTURE_ARRAY0 (for GL_TEXTURE0) and BATCH_TEXTURE_ARRAY0 + 1 (for GL_TEXTURE1).
+		// Call after loading (and pooling) the materials. Returns false (and renderBatch falls back to render) if batching is not available.
+		enum BATCH_BINDING { BATCH_DRAWS = 3, BATCH_MATERIALS, BATCH_INSTANCES };
+		enum BATCH_TEXTURE { BATCH_TEXTURE_ARRAY0 = 2, BATCH_TEXTURE_ARRAYS = 2 };
+		bool createBatch(size_t instances = 1, const glm::vec3* instanceData = NULL);
+		bool hasBatch() const						{ return m_idBatchIndirect != 0; }
+		void renderBatch(glm::mat4 matrix, C3dglProgram* pProgram = NULL) const;
+		size_t getBatchDrawCalls() const			{ return m_batchRuns.size(); }
+
+		// Buffer update: updates count elements (typically instances) starting from first, for each mesh - without reallocation
+		void updateVertexBuffers(GLint attrLocation, size_t first, size_t count, const void* data);
+
 		// Additional pointers: add attrib pointers (with offset) to existing buffers, for each mesh
 		void addAttribPointers(GLint attrLocation, GLint attrFirstLocation, size_t instances, GLint size, GLsizei stride, size_t offset, GLuint divisor = 0, GLenum usage = GL_STATIC_DRAW);
 		void addAttribIPointers(GLint attrLocation, GLint attrFirstLocation, size_t instances, GLint size, GLsizei stride, size_t offset, GLuint divisor = 0, GLenum usage = GL_STATIC_DRAW);
@@ -129,7 +268,7 @@ namespace _3dgl
 		bool hasMaterials() const					{ return m_materials.size() > 0; }
 		size_t getMaterialCount() const				{ return m_materials.size(); }
 		C3dglMaterial *getMaterial(size_t i)		{ return (i < m_materials.size()) ? &m_materials[i] : NULL; }
-		size_t getMaterialIndex(C3dglMaterial* p) const { return p - &m_materials[0]; }
+		size_t getMaterialIndex(const C3dglMaterial* p) const { return p - &m_materials[0]; }
 		size_t createNewMaterial()					{ size_t nIndex = m_materials.size(); m_materials.push_back(C3dglMaterial(this)); return nIndex; }
 
 		// Animation functions
@@ -145,6 +284,10 @@ namespace _3dgl
 		// Advanced functions
 		// retrieves the transform associated with the given node. If (bRecursive) the transform is recursively combined with parental transform(s)
 		void getNodeTransform(aiNode *pNode, float pMatrix[16], bool bRecursive = true) const;
+		// flattened node hierarchy: depth-first, parents before children. The global transform is relative to the model, the root node transform included
+		size_t getNodeCount() const					{ return m_nodes.size(); }
+		glm::mat4 getNodeGlobal(size_t iNode) const	{ return m_nodes[iNode].global; }
+		const unsigned* getNodeMeshes(size_t iNode, unsigned& nMeshes) const	{ nMeshes = m_nodes[iNode].nMeshes; return m_nodeMeshes.data() + m_nodes[iNode].firstMesh; }
 	
 		// Bone system functions
 		bool hasBones() const						{ return m_vecBones.size() > 0; }		// true if any bones found in the model
@@ -158,16 +301,29 @@ namespace _3dgl
 		glm::mat4 getGlobalInvT() const				{ return m_globInvT; }
 
 		// Bounding Box Functions
+		// The bounds of all nodes and subtrees are computed once, at load (meshes in their bind pose), so these functions are cheap
+		// enough to be called every frame.
 		// BB for the entire model
 		void getAABB(glm::vec3 BB[2]) const;
+		// BB for the entire model, transformed with matrix (e.g. the model matrix, for world coordinates) - exact for all 8 corners
+		void getAABB(glm::vec3 BB[2], const glm::mat4& matrix) const;
 		// BB for one of the main nodes - see getMainNodeCount function
 		void getAABB(unsigned iNode, glm::vec3 BB[2]) const;
-		// BB for a single node (low-level, mostly for internal use)
+		// BB for a single node (low-level, mostly for internal use): the node's subtree, transformed by m (the parent's transform), is added to BB
 		void getAABB(aiNode* pNode, glm::vec3 BB[2], glm::mat4 m = glm::mat4(1)) const;
 
 		void stats(unsigned level = 0) const;
 
 		std::string getName() const { return "Model \"" + m_name + "\""; }
+
+	private:
+		void flattenNodes();
+		int findNode(const aiNode* pNode) const;
+		glm::mat4 getNodeBase(int iNode, glm::mat4 m) const;
+		C3dglFrustum::CLASS classifyBounds(const C3dglFrustum& frustum, const glm::vec3 aabb[2], glm::vec4 sphere) const;
+		void renderNodes(unsigned first, unsigned end, glm::mat4 matrix, GLsizei instances, C3dglProgram* pProgram, GLuint idIndirect, GLsizei nDraws,
+			const C3dglFrustum* pFrustum = NULL) const;
+		void destroyBatch();
 	};
 }; // namespace _3dgl
 
@@ -0,0 +1,128 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+GPU profiler: named, nested scopes timed with GL_TIMESTAMP queries. Queries are
+kept in a ring of several frames and read back only once available, so profiling
+never stalls the pipeline; results lag a few frames behind.
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+
+#ifndef __3dglProfiler_h_
+#define __3dglProfiler_h_
+
+#include "Object.h"
+#include "Tools.h"
+
+// standard libraries
+#include <map>
+#include <vector>
+
+namespace _3dgl
+{
+	class MY3DGL_API C3dglProfiler : public C3dglObject
+	{
+		// a scope recorded in a frame: timestamps taken at begin and end
+		struct SCOPE
+		{
+			unsigned iName;					// index to m_names
+			GLuint idBegin, idEnd;
+		};
+
+		// a frame in the ring: query objects are reused, grown as needed
+		struct FRAME
+		{
+			std::vector<GLuint> queries;
+			size_t nQueries = 0;			// queries issued in this frame
+			std::vector<SCOPE> scopes;
+		};
+
+		// a named scope, identified by its full path ("parent/child")
+		struct RESULT
+		{
+			std::string path;				// full path
+			std::string name;				// the last part of the path
+			unsigned depth;					// nesting level
+			double time = 0;				// in ms, the last frame read back
+			double average = 0;				// in ms, exponential moving average
+			bool valid = false;
+		};
+
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		std::vector<FRAME> m_frames;
+		std::vector<RESULT> m_names;
+		std::map<std::string, unsigned> m_paths;	// full path -> index to m_names
+		std::vector<unsigned> m_stack;				// open scopes: indices to the current frame's scopes
+		std::vector<unsigned> m_order;				// names in the order of the last frame read back
+#pragma warning(pop)
+		unsigned m_iFrame;
+		unsigned m_nDropped;				// frames not read back in time
+		bool m_bEnabled;
+
+	public:
+		C3dglProfiler(unsigned nFrames = 4);
+		~C3dglProfiler() { destroy(); }
+
+		bool create();
+		void destroy();
+
+		// call once per frame, before any scopes; results of the oldest frame in the ring are collected, if already available
+		void beginFrame();
+
+		// GPU scopes - may be nested, and the same name may be used more than once in a frame (times are then added up)
+		void begin(std::string name);
+		void end();
+
+		// results, in ms, in the order of the last frame collected; names are the last parts of their paths
+		size_t getScopeCount() const				{ return m_order.size(); }
+		std::string getScopeName(size_t i) const	{ return m_names[m_order[i]].name; }
+		unsigned getScopeDepth(size_t i) const		{ return m_names[m_order[i]].depth; }
+		double getTime(size_t i) const				{ return m_names[m_order[i]].time; }
+		double getAverageTime(size_t i) const		{ return m_names[m_order[i]].average; }
+		// the averaged time of a scope, by its full path, e.g. "shading/trees"; 0 if unknown
+		double getAverageTime(std::string path) const;
+		// frames that were recycled before their results became available - if it grows, use more frames in the ring
+		unsigned getDroppedFrames() const			{ return m_nDropped; }
+
+		// on-screen overlay: one line per scope, starting at (x, y), each next line below; see _3dgl::print
+		void print(int x, int y, glm::vec3 color = glm::vec3(1, 1, 1), enum FONT font = FONT_FIXED_13, int lineHeight = 15) const;
+
+		// RAII helper: { C3dglProfiler::SCOPED s(profiler, "terrain"); terrain.render(...); }
+		struct SCOPED
+		{
+			C3dglProfiler& profiler;
+			SCOPED(C3dglProfiler& profiler, std::string name) : profiler(profiler) { profiler.begin(name); }
+			~SCOPED() { profiler.end(); }
+		};
+
+		std::string getName() const { return "GPU Profiler"; }
+
+	private:
+		GLuint nextQuery(FRAME& frame);
+		void collect(FRAME& frame);
+	};
+}; // namespace _3dgl
+
+#endif
@@ -0,0 +1,112 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Render queue: draw items are collected during the frame, each with a 64-bit sort key
+(pass, program, material, VAO and depth), then sorted and executed at once - so that
+items sharing the state are drawn together and redundant state changes are skipped.
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+
+#ifndef __3dglRenderQueue_h_
+#define __3dglRenderQueue_h_
+
+#include "Object.h"
+
+// standard libraries
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "../glm/mat4x4.hpp"
+
+namespace _3dgl
+{
+	class C3dglProgram;
+	class C3dglMaterial;
+	class C3dglVertexAttrObject;
+	class C3dglCommandList;
+
+	class MY3DGL_API C3dglRenderQueue : public C3dglObject
+	{
+	public:
+		// Passes are executed in their numerical order (0..15). Within the transparent passes items are drawn back to front,
+		// within all other passes - grouped by the state, and front to back within each group
+		enum PASS { PASS_OPAQUE = 0, PASS_ALPHA_TESTED = 1, PASS_TRANSPARENT = 8 };
+
+	private:
+		struct ITEM
+		{
+			const C3dglVertexAttrObject* pVAO;
+			const C3dglMaterial* pMaterial;		// NULL if none
+			C3dglProgram* pProgram;				// NULL for the fixed pipeline
+			glm::mat4 matrix;					// model-view matrix
+			GLsizei instances;
+		};
+
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		std::vector<ITEM> m_items;
+		std::vector<std::pair<uint64_t, unsigned> > m_keys;		// sort key -> item
+		std::map<const C3dglMaterial*, unsigned> m_materialIds;	// materials are numbered in order of first submission
+#pragma warning(pop)
+
+		// statistics of the last flush
+		size_t m_nItems = 0;
+		size_t m_nProgramChanges = 0;
+		size_t m_nMaterialChanges = 0;
+		size_t m_nVAOChanges = 0;
+
+	public:
+		C3dglRenderQueue() : C3dglObject() { }
+
+		// Adds an item. depth is the distance from the eye (view space); if pProgram is NULL, the current program is used.
+		// The material state is not restored after rendering: each item should have its material, or depend on no material properties.
+		void submit(const C3dglVertexAttrObject* pVAO, const C3dglMaterial* pMaterial, glm::mat4 matrix, float depth, GLsizei instances = 1, C3dglProgram* pProgram = NULL, unsigned pass = PASS_OPAQUE);
+		// as above, the depth taken from the origin of the model-view matrix
+		void submit(const C3dglVertexAttrObject* pVAO, const C3dglMaterial* pMaterial, glm::mat4 matrix, GLsizei instances = 1, C3dglProgram* pProgram = NULL, unsigned pass = PASS_OPAQUE);
+		// adds all the commands of a list (typically recorded by a worker thread - see C3dglCommandRecorder)
+		void submit(const C3dglCommandList& list);
+
+		// sorts and renders all the items submitted, then empties the queue. Typically called once, at the end of the frame
+		void flush();
+		// empties the queue without rendering
+		void clear()								{ m_items.clear(); m_keys.clear(); }
+
+		size_t getSize() const						{ return m_items.size(); }
+
+		// statistics of the last flush: number of items, and number of the actual state changes
+		size_t getItemCount() const					{ return m_nItems; }
+		size_t getProgramChanges() const			{ return m_nProgramChanges; }
+		size_t getMaterialChanges() const			{ return m_nMaterialChanges; }
+		size_t getVAOChanges() const				{ return m_nVAOChanges; }
+
+		std::string getName() const { return "Render Queue"; }
+
+	private:
+		static uint64_t depthKey(float depth);
+	};
+}; // namespace _3dgl
+
+#endif
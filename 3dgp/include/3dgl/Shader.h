@@ -43,6 +43,7 @@ freely, subject to the following restrictions:
 #include <map>
 
 #include "../glm/mat4x4.hpp"
+#include "../glm/vec3.hpp"
 
 
 //////////////////////////////////////////////////////////
@@ -53,6 +54,30 @@ freely, subject to the following restrictions:
 
 namespace _3dgl
 {
+	class C3dglStreamBuffer;
+
+	// Standard uniform blocks, std140 layout. The matching GLSL declarations are:
+	//	layout(std140) uniform PerFrame { mat4 matrixProjection; mat4 matrixView; mat4 matrixInvView; vec3 lightDirection; vec3 lightDiffuse; };
+	//	layout(std140) uniform PerObject { mat4 matrixModelView; vec3 materialAmbient; vec3 materialDiffuse; vec3 materialSpecular; vec3 materialEmissive; float materialShininess; };
+	struct MY3DGL_API PER_FRAME_BLOCK
+	{
+		glm::mat4 matrixProjection = glm::mat4(1);
+		glm::mat4 matrixView = glm::mat4(1);
+		glm::mat4 matrixInvView = glm::mat4(1);
+		glm::vec3 lightDirection = glm::vec3(0, 1, 0);	float pad0 = 0;		// directional light, world coordinates
+		glm::vec3 lightDiffuse = glm::vec3(1);			float pad1 = 0;
+	};
+
+	struct MY3DGL_API PER_OBJECT_BLOCK
+	{
+		glm::mat4 matrixModelView = glm::mat4(1);
+		glm::vec3 materialAmbient = glm::vec3(0);		float pad0 = 0;
+		glm::vec3 materialDiffuse = glm::vec3(0);		float pad1 = 0;
+		glm::vec3 materialSpecular = glm::vec3(0);		float pad2 = 0;
+		glm::vec3 materialEmissive = glm::vec3(0);
+		float materialShininess = 0;
+	};
+
 	class MY3DGL_API C3dglShader : public C3dglObject
 	{
 		GLenum m_type;
@@ -79,6 +104,13 @@ namespace _3dgl
 	private:
 		static C3dglProgram *c_pCurrentProgram;
 
+		// standard uniform blocks: sub-allocated from a ring buffer shared by all programs
+		static C3dglStreamBuffer* c_pUniformStream;		// NULL if not created or persistent buffers not supported
+		static GLuint c_idUniformBuffer;				// fallback buffer, one slot per block, updated in place
+		static GLint c_uniformAlignment;				// GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+		static PER_OBJECT_BLOCK c_perObject;			// the current per-object data, written by sendUniform(UNI_STD)
+		static bool c_bPerObjectDirty;					// true if c_perObject changed since last uploaded
+
 		struct MY3DGL_API UNIFORM
 		{
 			GLint location;		// uniform location
@@ -121,6 +153,7 @@ namespace _3dgl
 		size_t m_stdAttrNum = ATTR_COUNT;				// number of standard attributes (8)
 		GLint m_stdAttr[ATTR_COUNT];					// array of standard attribute locations (see enum ATTRIB_STD in CommonDef.h)
 		GLint m_stdUni[UNI_COUNT];						// array of standard uniform locations (see enum UNI_STD in CommonDef.h)
+		bool m_stdBlock[UNI_BLOCK_COUNT];				// true for the standard uniform blocks declared in the program (see enum UNI_BLOCK_STD)
 
 	public:
 		C3dglProgram();
@@ -135,6 +168,16 @@ namespace _3dgl
 
 		static C3dglProgram *getCurrentProgram()			{ return c_pCurrentProgram; }
 
+		// Standard Uniform Blocks (see PER_FRAME_BLOCK for the GLSL declarations), shared by all programs.
+		// PerFrame is sent once per frame. If a program declares PerObject, sendUniform(UNI_STD) writes to the block instead of the uniforms,
+		// and the block is copied to a ring buffer and bound with a single call before the next draw.
+		// createUniformBlocks is optional: it is called with the default values when first needed
+		static bool createUniformBlocks(size_t maxObjects = 4096, unsigned nFrames = 3);
+		static void destroyUniformBlocks();
+		static void sendPerFrame(const PER_FRAME_BLOCK& block);		// call before rendering each frame - also moves the ring on
+		static void flushUniformBlocks();							// uploads the PerObject block if changed - called by the draw functions
+		bool hasUniformBlock(UNI_BLOCK_STD block) const		{ return m_stdBlock[block]; }
+
 		// numerical locations for attributes
 		GLint getAttribLocation(std::string idUniform) const;
 		GLint getAttribLocation(ATTRIB_STD attr) const		{ return m_stdAttr[attr]; }
@@ -352,6 +395,8 @@ namespace _3dgl
 		// private implementation helpers
 		template<class T> bool _sendUniform(std::string name, T*, size_t count, GLenum type);
 		template<class T> bool _sendUniform(enum UNI_STD stdloc, T v);
+		template<class T> bool _retrieveUniform(enum UNI_STD stdloc, T& v);
+		static void uploadUniformBlock(UNI_BLOCK_STD block, const void* data, size_t size);
 	};
 
 }; // namespace _3dgl
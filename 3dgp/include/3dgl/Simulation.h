@@ -0,0 +1,111 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Fixed time step simulation: the simulation advances in ticks of a constant length,
+independent of the frame rate, and the renderer interpolates between the last two
+ticks. The ticks may run on the rendering thread, or on a thread of their own.
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+
+#ifndef __3dglSimulation_h_
+#define __3dglSimulation_h_
+
+#include "Object.h"
+
+// standard libraries
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace _3dgl
+{
+	// The simulation state is kept by the application, in an array of STATES copies (e.g. SIM_STATE state[C3dglSimulation::STATES]);
+	// this class decides which copy is written by each tick, and which two are rendered. A tick never writes a copy being rendered,
+	// so the renderer does not wait for the simulation, even if it runs on a separate thread.
+	class MY3DGL_API C3dglSimulation : public C3dglObject
+	{
+	public:
+		static const unsigned STATES = 5;	// the last two ticks, the two being rendered, and the one being written
+
+		// Advances the simulation by dt seconds: state[iNext] must be entirely written, from state[iPrev] (which must not be changed).
+		// With a simulation thread, the tick runs on that thread - and must not call OpenGL
+		typedef std::function<void(unsigned iPrev, unsigned iNext, float dt)> TICK;
+
+	private:
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		TICK m_tick;
+		std::thread m_thread;
+		std::mutex m_mutex;
+		std::condition_variable m_cvQuit;
+		std::chrono::steady_clock::time_point m_timeCurr;	// when the last tick was due (threaded mode)
+		std::atomic<unsigned long long> m_nTicks;
+#pragma warning(pop)
+		double m_step;						// tick length, in seconds
+		unsigned m_maxTicks;				// the most ticks to catch up with at once - the excess time is dropped
+		double m_accumulator;				// time not simulated yet (single-threaded mode)
+		unsigned m_iPrev, m_iCurr;			// the last two ticks
+		unsigned m_iRenderPrev, m_iRenderCurr;	// the two being rendered
+		float m_alpha;						// interpolation factor between them
+		bool m_bQuit;
+
+	public:
+		C3dglSimulation(float tickRate = 60.0f, unsigned maxTicks = 8);
+		~C3dglSimulation() { destroy(); }
+
+		// state[0] must be initialised before: it is the initial state
+		void create(TICK tick);
+		void destroy();
+
+		// starts or stops the simulation thread; without it, the ticks run in update
+		void start();
+		void stop();
+		bool isRunning() const						{ return m_thread.joinable(); }
+
+		// Call once per frame, before rendering. Single-threaded: runs the ticks due since the last call (deltaTime in seconds).
+		// Threaded: takes the last two ticks, deltaTime is ignored. Returns the interpolation factor [0..1] between the states
+		// to render, see getRenderPrev and getRenderCurr - these are not changed by the simulation until the next call
+		float update(float deltaTime);
+
+		unsigned getRenderPrev() const				{ return m_iRenderPrev; }
+		unsigned getRenderCurr() const				{ return m_iRenderCurr; }
+		float getAlpha() const						{ return m_alpha; }
+
+		float getStep() const						{ return (float)m_step; }
+		unsigned long long getTickCount() const		{ return m_nTicks; }
+
+		std::string getName() const { return "Simulation"; }
+
+	private:
+		unsigned freeState() const;
+		void tick();
+		void run();
+	};
+}; // namespace _3dgl
+
+#endif
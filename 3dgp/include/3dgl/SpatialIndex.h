@@ -0,0 +1,96 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Static spatial index for proximity queries over a fixed set of points,
+such as instance positions: nearest neighbours, radius and box queries.
+Implemented as a packed uniform grid: points are sorted by cells and stored
+contiguously, with an offset table giving the range of each cell.
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+
+#ifndef __3dglSpatialIndex_h_
+#define __3dglSpatialIndex_h_
+
+// Include GLM core features
+#include "../glm/glm.hpp"
+
+#include "Object.h"
+
+// standard libraries
+#include <vector>
+#include <cfloat>
+
+namespace _3dgl
+{
+	class MY3DGL_API C3dglSpatialIndex : public C3dglObject
+	{
+		glm::vec3 m_min;					// grid origin
+		glm::vec3 m_cellSize;				// size of a single cell
+		glm::ivec3 m_dims;					// number of cells along each axis
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		std::vector<unsigned> m_cellStart;	// index of the first point in each cell; one extra entry at the end
+		std::vector<glm::vec3> m_points;	// point positions, sorted by cells
+		std::vector<size_t> m_ids;			// original indices of the points, in the same order
+#pragma warning(pop)
+
+	public:
+		C3dglSpatialIndex();
+
+		// Builds the index over count points. The cell size is chosen automatically if 0.
+		// Query results are indices into the original array of points.
+		void build(const glm::vec3* points, size_t count, float cellSize = 0);
+		void clear();
+
+		size_t getCount() const				{ return m_points.size(); }
+		size_t getCellCount() const			{ return m_cellStart.empty() ? 0 : m_cellStart.size() - 1; }
+
+		// k nearest points, closest first, not farther than maxDist. Returns the number of points found
+		size_t queryNearest(glm::vec3 p, size_t k, std::vector<size_t>& result, float maxDist = FLT_MAX) const;
+		// the nearest point; (size_t)-1 if the index is empty
+		size_t findNearest(glm::vec3 p) const;
+		// all points within the radius r, in no particular order. Returns the number of points found
+		size_t queryRadius(glm::vec3 p, float r, std::vector<size_t>& result) const;
+		// all points inside the box, in no particular order. Returns the number of points found
+		size_t queryBox(const glm::vec3 aabb[2], std::vector<size_t>& result) const;
+
+		// Batch queries - for n query points at once.
+		// queryNearest: result holds k entries per query point, padded with (size_t)-1 where fewer points found
+		void queryNearest(const glm::vec3* p, size_t n, size_t k, std::vector<size_t>& result, float maxDist = FLT_MAX) const;
+		// queryRadius & queryBox: results for the query i are result[offsets[i]] to result[offsets[i + 1] - 1]
+		void queryRadius(const glm::vec3* p, size_t n, float r, std::vector<size_t>& result, std::vector<size_t>& offsets) const;
+		void queryBox(const glm::vec3 (*aabb)[2], size_t n, std::vector<size_t>& result, std::vector<size_t>& offsets) const;
+
+		std::string getName() const { return "Spatial Index"; }
+
+	private:
+		glm::ivec3 getCell(glm::vec3 p) const;
+		size_t getCellIndex(int x, int y, int z) const	{ return ((size_t)z * m_dims.y + y) * m_dims.x + x; }
+		void appendRange(glm::ivec3 c0, glm::ivec3 c1, glm::vec3 p, float r2, const glm::vec3* aabb, std::vector<size_t>& result) const;
+	};
+
+}; // namespace _3dgl
+
+#endif
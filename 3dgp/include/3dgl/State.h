@@ -0,0 +1,123 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+OpenGL state shadow cache: the library binds VAOs, programs, buffers and textures,
+and changes the depth and blend state through this class. Redundant changes are
+skipped and the current state is known without glGet* queries.
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+
+#ifndef __3dglState_h_
+#define __3dglState_h_
+
+// Include 3DGL API import/export settings
+#include "3dglapi.h"
+
+namespace _3dgl
+{
+	// All members are static: there is one state per (current) OpenGL context.
+	// The cache is only valid as long as all state changes go through it. Application code calling OpenGL directly
+	// (glBindTexture, glUseProgram etc.) should call invalidate() afterwards - the state will then be re-queried, once, when needed.
+	class MY3DGL_API C3dglState
+	{
+		static const GLuint UNKNOWN = 0xFFFFFFFF;
+		static const unsigned TEXTURE_UNITS = 32;	// GL_TEXTURE0 .. GL_TEXTURE31
+		static const unsigned TEXTURE_TARGETS = 3;	// GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_2D_ARRAY
+		static const unsigned BUFFER_TARGETS = 8;	// see bufferIndex; GL_ELEMENT_ARRAY_BUFFER is a part of the VAO state and is never cached
+		static const unsigned CAPS = 4;				// GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE, GL_ALPHA_TEST
+
+		static GLuint c_idVAO;
+		static GLuint c_idProgram;
+		static GLuint c_idFramebuffer;
+		static GLenum c_activeTexture;
+		static GLuint c_idTextures[TEXTURE_UNITS][TEXTURE_TARGETS];
+		static GLuint c_idBuffers[BUFFER_TARGETS];
+		static GLint c_viewport[4];
+		static GLint c_caps[CAPS];					// 0, 1 or -1 (unknown)
+		static GLint c_depthMask;					// 0, 1 or -1 (unknown)
+		static GLenum c_depthFunc;
+		static GLenum c_blendSrc, c_blendDst;
+		static GLint c_dsa;							// 0, 1 or -1 (not checked yet)
+
+	public:
+		// forget the cached state, e.g. after application code has changed it directly or a new context has been made current
+		static void invalidate();
+
+		// vertex array object
+		static void bindVertexArray(GLuint id);
+		static GLuint getVertexArray();
+
+		// shader program
+		static void useProgram(GLuint id);
+		static GLuint getProgram();
+
+		// textures. bindTexture activates the texUnit if necessary
+		static void activeTexture(GLenum texUnit);
+		static GLenum getActiveTexture();
+		static void bindTexture(GLenum texUnit, GLenum target, GLuint id);
+		static GLuint getTexture(GLenum texUnit, GLenum target);
+
+		// buffers (non-indexed binding points). Indexed bindings also set the generic binding point, as in OpenGL
+		static void bindBuffer(GLenum target, GLuint id);
+		static void bindBufferBase(GLenum target, GLuint index, GLuint id);
+		static void bindBufferRange(GLenum target, GLuint index, GLuint id, GLintptr offset, GLsizeiptr size);
+		static GLuint getBuffer(GLenum target);
+
+		// framebuffer (both draw and read) and viewport
+		static void bindFramebuffer(GLuint id);
+		static GLuint getFramebuffer();
+		static void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+		static void getViewport(GLint viewport[4]);
+
+		// depth & blend state
+		static void enable(GLenum cap, bool bEnable = true);
+		static void disable(GLenum cap)				{ enable(cap, false); }
+		static bool isEnabled(GLenum cap);
+		static void depthMask(GLboolean flag);
+		static GLboolean getDepthMask();
+		static void depthFunc(GLenum func);
+		static GLenum getDepthFunc();
+		static void blendFunc(GLenum src, GLenum dst);
+
+		// Direct State Access (GL 4.5 or GL_ARB_direct_state_access): if available, the library creates and edits buffers, VAOs and textures
+		// by name, without binding them. enableDSA(false) forces the bind-to-edit path; it should be called before any objects are created
+		static bool isDSA();
+		static void enableDSA(bool bEnable);
+
+		// deleting objects through these functions keeps the cache consistent - OpenGL unbinds deleted objects and reuses their names
+		static void deleteVertexArrays(GLsizei n, const GLuint* ids);
+		static void deleteProgram(GLuint id);
+		static void deleteTextures(GLsizei n, const GLuint* ids);
+		static void deleteBuffers(GLsizei n, const GLuint* ids);
+		static void deleteFramebuffers(GLsizei n, const GLuint* ids);
+
+	private:
+		static int textureIndex(GLenum target);
+		static int bufferIndex(GLenum target);
+		static int capIndex(GLenum cap);
+	};
+}; // namespace _3dgl
+
+#endif
@@ -0,0 +1,100 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Static batch: non-moving copies of models (rocks, fences, props), pre-transformed
+to world coordinates at load time and merged into a few buffers - one per material
+and spatial cell - so that the whole set renders in a handful of draw calls.
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+
+#ifndef __3dglStaticBatch_h_
+#define __3dglStaticBatch_h_
+
+#include "Object.h"
+#include "Frustum.h"
+
+// standard libraries
+#include <map>
+#include <vector>
+
+#include "../glm/mat4x4.hpp"
+
+namespace _3dgl
+{
+	class C3dglModel;
+	class C3dglMaterial;
+	class C3dglProgram;
+	class C3dglVertexAttrObject;
+
+	class MY3DGL_API C3dglStaticBatch : public C3dglObject
+	{
+		// merged geometry of a single material within a single cell
+		struct GROUP
+		{
+			const C3dglMaterial* pMaterial = NULL;
+			glm::vec3 aabb[2] = { glm::vec3(1e10f), glm::vec3(-1e10f) };	// world coordinates
+			std::vector<glm::vec3> vertices, normals, tangents, bitangents;
+			std::vector<glm::vec2> texCoords;
+			std::vector<GLuint> indices;
+			bool bTexCoords = false, bTangents = false;		// true if provided by any of the meshes
+			C3dglVertexAttrObject* pVAO = NULL;				// created by build
+		};
+
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		std::map<std::pair<const C3dglMaterial*, std::pair<int, int> >, GROUP> m_groups;	// (material, cell) -> group
+#pragma warning(pop)
+		float m_cellSize;				// size of the cells in the XZ plane; 0 if not split into cells
+		size_t m_nObjects = 0;			// number of objects added
+
+	public:
+		C3dglStaticBatch(float cellSize = 0) : C3dglObject(), m_cellSize(cellSize) { }
+		~C3dglStaticBatch() { destroy(); }
+
+		void destroy();
+
+		// Adds a copy of the model, transformed with matrixWorld. Each mesh goes to the group of its material, in the cell of its centre.
+		// Skinned meshes are not added. The geometry is copied, but the materials are referenced: the model must outlive the batch
+		void add(C3dglModel& model, glm::mat4 matrixWorld);
+		// Creates the buffers (interleaved) for all the groups, and releases the CPU copy of the data. Objects cannot be added after that
+		void build(C3dglProgram* pProgram = NULL);
+
+		// Rendering: groups are rendered material by material; the frustum (world coordinates) culls whole cells
+		void render(glm::mat4 matrixView, C3dglProgram* pProgram = NULL) const;
+		void render(glm::mat4 matrixView, const C3dglFrustum& frustum, C3dglProgram* pProgram = NULL) const;
+
+		size_t getObjectCount() const					{ return m_nObjects; }
+		size_t getGroupCount() const					{ return m_groups.size(); }		// = number of draw calls, if nothing culled
+		float getCellSize() const						{ return m_cellSize; }
+
+		std::string getName() const { return "Static Batch"; }
+
+	private:
+		void addNode(C3dglModel& model, size_t iNode, glm::mat4 m);
+		void render(glm::mat4 matrixView, const C3dglFrustum* pFrustum, C3dglProgram* pProgram) const;
+	};
+}; // namespace _3dgl
+
+#endif
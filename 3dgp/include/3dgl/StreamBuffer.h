@@ -0,0 +1,92 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Streaming buffer: a persistently mapped buffer split into a ring of per-frame
+regions, guarded with fences. Dynamic data (instance data, uniforms, bones) are
+written with plain memcpy while the GPU still reads the regions of past frames.
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+
+#ifndef __3dglStreamBuffer_h_
+#define __3dglStreamBuffer_h_
+
+#include "Object.h"
+
+// standard libraries
+#include <vector>
+
+namespace _3dgl
+{
+	class MY3DGL_API C3dglStreamBuffer final : public C3dglObject
+	{
+		GLuint m_id = 0;				// buffer id
+		size_t m_regionSize = 0;		// size of a single region, in bytes (aligned)
+		unsigned m_nFrames = 0;			// number of regions in the ring
+		unsigned m_iFrame = 0;			// the region currently written
+		size_t m_used = 0;				// bytes allocated within the current region
+		char* m_pMapped = NULL;			// persistently mapped buffer memory
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		std::vector<GLsync> m_fences;	// one fence per region, set when the region is retired
+#pragma warning(pop)
+
+	public:
+		// regions start at multiples of this value - enough for any uniform or storage buffer offset alignment
+		static const size_t REGION_ALIGNMENT = 256;
+
+		C3dglStreamBuffer() : C3dglObject() { }
+		~C3dglStreamBuffer() { destroy(); }
+
+		// Creates the buffer: nFrames regions of (at least) regionSize bytes each. Three regions allow the CPU to run two frames ahead of the GPU.
+		// Fails if persistent mapped buffers (GL 4.4 or GL_ARB_buffer_storage) are not supported
+		bool create(size_t regionSize, unsigned nFrames = 3);
+		void destroy();
+
+		// Retires the current region (fences it) and moves on to the next one - waiting for the GPU to finish reading it, if necessary.
+		// Call once all the draws reading the current region have been issued, typically once per frame
+		void nextFrame();
+
+		// Sub-allocation within the current region: returns a pointer to write the data to, and its offset within the whole buffer
+		// (as used by glBindBufferRange or draw calls). Returns NULL if the region is full
+		void* alloc(size_t size, size_t& offset, size_t alignment = 16);
+
+		// the current region
+		char* getRegion() const						{ return m_pMapped + getRegionOffset(); }
+		size_t getRegionOffset() const				{ return m_iFrame * m_regionSize; }
+
+		// binds size bytes at offset to an indexed binding point (GL_UNIFORM_BUFFER, GL_SHADER_STORAGE_BUFFER)
+		void bindRange(GLenum target, GLuint index, size_t offset, size_t size) const;
+
+		GLuint getId() const						{ return m_id; }
+		size_t getRegionSize() const				{ return m_regionSize; }
+		unsigned getFrameCount() const				{ return m_nFrames; }
+		unsigned getFrame() const					{ return m_iFrame; }
+		bool isCreated() const						{ return m_pMapped != NULL; }
+
+		std::string getName() const { return "Stream Buffer"; }
+	};
+}; // namespace _3dgl
+
+#endif
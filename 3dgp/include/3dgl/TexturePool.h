@@ -0,0 +1,91 @@
+/*********************************************************************************
+3DGL 3D Graphics Library created by Jarek Francik for Kingston University students
+Version 3.0 - June 2022
+Copyright (C) 2013-22 by Jarek Francik, Kingston University, London, UK
+
+Texture pool: same-size textures packed into the layers of GL_TEXTURE_2D_ARRAY
+textures. Materials pooled together refer to the same texture object and differ
+only by the layer index - so meshes with different textures can share one draw.
+----------------------------------------------------------------------------------
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source distribution.
+
+   Jarek Francik
+   jarek@kingston.ac.uk
+*********************************************************************************/
+
+#ifndef __3dglTexturePool_h_
+#define __3dglTexturePool_h_
+
+#include "Object.h"
+
+// standard libraries
+#include <map>
+#include <vector>
+
+namespace _3dgl
+{
+	class C3dglModel;
+
+	class MY3DGL_API C3dglTexturePool : public C3dglObject
+	{
+		// a single texture array: all layers of the same size, RGBA8
+		struct ARRAY
+		{
+			GLuint id = 0;
+			GLsizei width = 0;
+			GLsizei height = 0;
+			GLsizei layers = 0;					// layers used
+		};
+
+#pragma warning(push)
+#pragma warning(disable: 4251)
+		std::vector<ARRAY> m_arrays;
+		std::map<GLuint, std::pair<GLuint, GLint> > m_pooled;	// source texture id -> (array id, layer): textures shared by materials are pooled once
+#pragma warning(pop)
+		GLsizei m_maxLayers;					// capacity of each array; a new array is created when full
+
+	public:
+		C3dglTexturePool(GLsizei maxLayers = 64) : C3dglObject(), m_maxLayers(maxLayers) { }
+		~C3dglTexturePool() { destroy(); }
+
+		void destroy();
+
+		// Adds a texture of width x height pixels of the given format (GL_RGBA, GL_BGR etc.), unsigned bytes. Returns the array and the layer
+		bool add(GLsizei width, GLsizei height, GLenum format, const void* pixels, GLuint& idArray, GLint& layer);
+		// Adds a copy of an existing GL_TEXTURE_2D (RGBA8, e.g. created with createTexture2D), which may be deleted afterwards
+		bool add(GLuint idTexture, GLuint& idArray, GLint& layer);
+		// Adds the textures the model's materials use on texUnit, and sets the materials' texture layers (see C3dglMaterial::setTextureLayer).
+		// The materials keep their own textures, too. Returns the number of materials pooled
+		size_t add(C3dglModel& model, GLenum texUnit = GL_TEXTURE0);
+
+		size_t getArrayCount() const					{ return m_arrays.size(); }
+		GLuint getArrayId(size_t i) const				{ return m_arrays[i].id; }
+		GLsizei getWidth(size_t i) const				{ return m_arrays[i].width; }
+		GLsizei getHeight(size_t i) const				{ return m_arrays[i].height; }
+		GLsizei getLayerCount(size_t i) const			{ return m_arrays[i].layers; }
+		GLsizei getMaxLayers() const					{ return m_maxLayers; }
+
+		std::string getName() const { return "Texture Pool"; }
+
+	private:
+		ARRAY& findOrAddArray(GLsizei width, GLsizei height);
+	};
+}; // namespace _3dgl
+
+#endif
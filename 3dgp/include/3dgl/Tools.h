@@ -68,6 +68,7 @@ namespace _3dgl
 	}
 
 	// prints text on-screen at (x, y) screen coordinates, using color, font and align mode (left, right or centre)
+	// GLUT bitmap fonts are used: nothing is printed in headless builds (M3DGL_HEADLESS defined)
 	// x: x coordinate; if x < 0 than |x| determines the distance from the right margin of the window. The text will be right-aligned regardless of the align setting
 	// y: y coordinate; if y < 0 than |y| determines the distance from the top margin of the window
 	// Examples: print(0, 0, "lower-left corner"); print(-1, -1, "upper-right corner"); 
@@ -82,6 +83,18 @@ namespace _3dgl
 	// calculates camera position from the view matrix and displays it on-screen;
 	void MY3DGL_API print(int x, int y, glm::mat4 matrixView, glm::vec3 color = glm::vec3(1, 1, 1), enum FONT = FONT_HELVETICA_18, enum ALIGN = LEFT);
 
+	// sorts count points front to back, i.e. by their distance from the eye, and writes the resulting order (indices of points) to order.
+	// Bucketed (counting) sort of nBuckets distance ranges - linear cost, points within the same bucket remain unsorted
+	void MY3DGL_API sortFrontToBack(const glm::vec3* points, size_t count, glm::vec3 eye, unsigned* order, unsigned nBuckets = 256);
+
+	// transforms an axis-aligned bounding box and returns the AABB of the result (Arvo's method: exact for all 8 corners, also under rotation).
+	// SSE where available; aabb and result may be the same array
+	void MY3DGL_API transformAABB(const glm::vec3 aabb[2], const glm::mat4& m, glm::vec3 result[2]);
+
+	// creates a 2D RGBA8 texture, with linear filtering and no mipmaps, from width x height pixels of the given format (GL_RGBA, GL_BGR etc.), unsigned bytes.
+	// With Direct State Access the texture is created by name and nothing gets bound; otherwise it is left bound to texUnit
+	GLuint MY3DGL_API createTexture2D(GLsizei width, GLsizei height, GLenum format, const void* pixels, GLenum wrap = GL_REPEAT, GLenum texUnit = GL_TEXTURE0);
+
 	// converts a height map provided as an image file (fileImage) to a terrain mesh using scaleHeight to scale the terrain height
 	// output stored either externally as an OBJ mesh file or internally in a C3dglMesh mesh file provided
 	bool MY3DGL_API convHeightmap2OBJ(const std::string fileImage, float scaleHeight, const std::string fileOBJ);
@@ -41,10 +41,38 @@ freely, subject to the following restrictions:
 
 // standard libraries
 #include <map>
+#include <vector>
 
 namespace _3dgl
 {
 	class C3dglProgram;
+	class C3dglGeometryPool;
+	class C3dglStreamBuffer;
+
+	// Indirect draw parameters, as defined by OpenGL for glDrawElementsIndirect
+	struct DRAW_ELEMENTS_INDIRECT_COMMAND
+	{
+		GLuint count;			// number of indices
+		GLuint instanceCount;	// number of instances
+		GLuint firstIndex;		// first index
+		GLint baseVertex;		// value added to the indices
+		GLuint baseInstance;	// first instance
+	};
+
+	// Layout of an interleaved vertex buffer: locations and offsets of the standard attributes (see ATTRIB_STD enum)
+	struct MY3DGL_API VERTEX_FORMAT
+	{
+		GLint location[ATTR_COUNT];		// attribute location; -1 if the attribute is not present
+		GLuint offset[ATTR_COUNT];		// attribute offset within a vertex, in bytes
+		GLuint bytes[ATTR_COUNT];		// attribute size, in bytes - identifies full precision or quantized format
+		GLsizei stride = 0;				// size of a single vertex, in bytes
+
+		bool operator==(const VERTEX_FORMAT& f) const;
+		// sets the attribute pointers up - expects the VAO and the buffer to be bound
+		void setAttribPointers() const;
+		// Direct State Access version: sets the attribute formats of the VAO up and attaches the buffer - nothing is bound
+		void setAttribFormat(GLuint idVAO, GLuint idBuffer) const;
+	};
 
 	class MY3DGL_API C3dglVertexAttrObject : public C3dglObject
 	{
@@ -55,18 +83,58 @@ namespace _3dgl
 		size_t m_attrCount;			// number of different vertex attributes (or: buffer number)
 		size_t m_nVertices = 0;		// number of vertices
 
+		struct ALIAS
+		{
+			GLint attrLocation = -1;		// attribute reading the buffer through addAttribPointer/addAttribIPointer (e.g. a column of a mat4)
+			size_t offset = 0;				// its offset within a ring region
+			GLint size = 0;					// its format: number of components,
+			bool integer = false;			// GL_INT rather than GL_FLOAT
+			GLsizei stride = 0;				// and element size, in bytes
+		};
+
+		struct BUFFER
+		{
+			GLuint id = 0;					// buffer id
+			GLenum type = GL_FLOAT;			// component type
+			GLboolean normalized = GL_FALSE;	// normalized fixed point data
+			bool integer = false;			// integer attribute (glVertexAttribIPointer)
+			GLint size = 0;					// number of components per element
+			GLsizei stride = 0;				// element size, in bytes
+			GLuint divisor = 0;				// attribute divisor (0 for per-vertex data)
+			size_t count = 0;				// number of elements (vertices or instances)
+			GLenum usage = GL_STATIC_DRAW;	// usage pattern
+
+			// ring buffers only (see createRingVertexBuffer)
+			C3dglStreamBuffer* pStream = NULL;	// the ring; NULL if not a ring buffer
+			unsigned long nDraws = 0;		// value of the draw counter when the current region was last written
+			std::vector<char> shadow;		// CPU-side copy of the data, used to refill the next region
+			std::vector<ALIAS> aliases;		// other attributes reading the ring - re-pointed together with this one
+		};
+
 #pragma warning(push)
 #pragma warning(disable: 4251)
-		std::map<GLint, GLuint> m_mapBuffers;	// maps attrib id to id buffer id
+		std::map<GLint, BUFFER> m_mapBuffers;	// maps attrib id to buffer information
 #pragma warning(pop)
 
+		// Interleaved layout: all standard attributes packed in a single buffer (see create)
+		GLuint m_idInterleaved = 0;	// interleaved buffer id; 0 if separate buffers used
+		GLsizei m_interleavedStride = 0;	// size of a single vertex, in bytes
+
+		// Geometry pool: vertices and indices stored in shared buffers, rendered with the pool's VAO (see create)
+		C3dglGeometryPool* m_pPool = NULL;	// the pool; NULL if the object owns its buffers
+		unsigned m_iArena = 0;				// pool arena (one per vertex format)
+		GLint m_baseVertex = 0;				// location of the first vertex within the pool
+		GLuint m_firstIndex = 0;			// location of the first index within the pool
+
 		// Index Buffer
 		size_t m_nIndices = 0;		// number of elements to draw (size of index buffer)
+		GLenum m_indexType = GL_UNSIGNED_INT;	// GL_UNSIGNED_SHORT whenever all vertices can be addressed with 16 bits
 		GLuint m_idIndex = 0;		// index buffer id
 
 		// rendering-related data
 		C3dglProgram* m_pProgram = NULL;					// program responsible for creating the VBO's and VAO; NULL if fixed pipeline or no VAO created
 		mutable C3dglProgram* m_pLastProgramUsed = NULL;	// the last program used for rendering; NULL if never rendered since loading the model
+		mutable unsigned long m_nDraws = 0;					// draw counter - used to detect when a ring buffer region has been submitted for rendering
 
 	public:
 		C3dglVertexAttrObject(size_t attrCount);
@@ -80,10 +148,26 @@ namespace _3dgl
 		bool getVertexBufferId(GLint attrLocation, GLuint& bufferId) const;
 
 		size_t getIndexCount() const					{ return m_nIndices; }
+		GLenum getIndexType() const						{ return m_indexType; }
+		static size_t getIndexSize(GLenum indexType)	{ return indexType == GL_UNSIGNED_SHORT ? 2 : indexType == GL_UNSIGNED_BYTE ? 1 : 4; }
 		GLuint getIndexBufferId() const					{ return m_idIndex; }
 
+		bool isInterleaved() const						{ return m_idInterleaved != 0; }
+		GLuint getInterleavedBufferId() const			{ return m_idInterleaved; }
+		GLsizei getInterleavedStride() const			{ return m_interleavedStride; }
+
+		C3dglGeometryPool* getGeometryPool() const		{ return m_pPool; }
+		GLint getBaseVertex() const						{ return m_baseVertex; }
+		GLuint getFirstIndex() const					{ return m_firstIndex; }
+
 		// The create & destroy all standard buffers. The latter, typically, doesn't need to be called
-		void create(size_t attrCount, size_t nVertices, void** attrData, size_t* attrSize, size_t nIndices, void* indexData, size_t indSize, C3dglProgram* pProgram = NULL);
+		// 32-bit indices (indSize == 4) are converted to 16-bit ones if nVertices <= 65536 - see getIndexType
+		// If bInterleaved, the standard attributes are packed, vertex by vertex, into a single buffer - rather than one buffer per attribute.
+		// If pPool is provided, the vertices (always interleaved) and indices are stored in the geometry pool, and the pool's VAO, shared with other
+		// objects of the same vertex format, is used for rendering. Vertex buffers (e.g. instance attributes) cannot be added to pooled objects.
+		// Interleaved layout and geometry pools are only available with the programmable pipeline
+		// Standard attributes may be quantized (see C3dglModel::setQuantizedFlag); the format is recognised by the element size (attrSize)
+		void create(size_t attrCount, size_t nVertices, void** attrData, size_t* attrSize, size_t nIndices, void* indexData, size_t indSize, C3dglProgram* pProgram = NULL, bool bInterleaved = false, C3dglGeometryPool* pPool = NULL);
 		virtual void destroy();
 
 		// Buffer creation and destroying
@@ -91,6 +175,17 @@ namespace _3dgl
 		GLuint createVertexBuffer(GLint attrLocation, size_t instances, GLint size, int* data, GLsizei stride = 0, GLuint divisor = 0, GLenum usage = GL_STATIC_DRAW);
 		GLuint createVertexBuffer(GLenum cap, size_t instances, float* data, GLsizei stride, GLenum usage = GL_STATIC_DRAW);
 
+		// Ring buffers: persistently mapped buffers, split into nFrames regions, for data that changes every frame.
+		// Each frame's updates go to a fresh region while the GPU may still be reading the previous ones, so updates never stall.
+		// Falls back to an orphaned GL_STREAM_DRAW buffer if GL_ARB_buffer_storage is not available.
+		GLuint createRingVertexBuffer(GLint attrLocation, size_t instances, GLint size, float* data, GLsizei stride = 0, GLuint divisor = 0, unsigned nFrames = 3);
+		GLuint createRingVertexBuffer(GLint attrLocation, size_t instances, GLint size, int* data, GLsizei stride = 0, GLuint divisor = 0, unsigned nFrames = 3);
+
+		// Buffer update: replaces count elements (vertices or instances), starting from first, with the data provided.
+		// No reallocation takes place. A full update of a dynamic (non GL_STATIC_DRAW) buffer orphans the old storage first.
+		bool updateVertexBuffer(GLint attrLocation, size_t first, size_t count, const void* data);
+
+		// Additional attributes reading an existing buffer, e.g. the columns of a mat4. If bufferId is a ring buffer, they follow its current region
 		void addAttribPointer(GLint attrLocation, GLuint bufferId, size_t instances, GLint size, GLsizei stride, size_t offset, GLuint divisor = 0, GLenum usage = GL_STATIC_DRAW);
 		void addAttribIPointer(GLint attrLocation, GLuint bufferId, size_t instances, GLint size, GLsizei stride, size_t offset, GLuint divisor = 0, GLenum usage = GL_STATIC_DRAW);
 
@@ -100,8 +195,23 @@ namespace _3dgl
 		// Rendering
 		void render(glm::mat4 matrix, GLsizei instances = 1, C3dglProgram* pProgram = NULL) const;
 		virtual void render(GLsizei instances = 1) const;
+		// Indirect rendering: drawCount sets of draw parameters (DRAW_ELEMENTS_INDIRECT_COMMAND) are read from the buffer idIndirect, at the given offset
+		void renderIndirect(glm::mat4 matrix, GLuint idIndirect, size_t offset = 0, GLsizei drawCount = 1, C3dglProgram* pProgram = NULL) const;
+		virtual void renderIndirect(GLuint idIndirect, size_t offset = 0, GLsizei drawCount = 1) const;
+		// Instance ranges: nRanges instanced draws, each one of count[i] instances starting from first[i]
+		void renderRanges(glm::mat4 matrix, const GLuint* first, const GLsizei* count, size_t nRanges, C3dglProgram* pProgram = NULL) const;
+		virtual void renderRanges(const GLuint* first, const GLsizei* count, size_t nRanges) const;
 
 		using C3dglObject::getName;
+
+	private:
+		GLuint createVertexBuffer(GLint attrLocation, size_t instances, GLint size, GLenum type, GLboolean normalized, bool integer, const void* data, GLsizei stride, GLuint divisor, GLenum usage, unsigned nFrames);
+		void setAttribPointer(GLint attrLocation, const BUFFER& buf, size_t offset) const;
+		void createInterleavedBuffer(size_t attrCount, const GLint* attrId, void** attrData, size_t* attrSize);
+		void packInterleaved(size_t attrCount, const GLint* attrId, void** attrData, size_t* attrSize, VERTEX_FORMAT& format, std::vector<char>& data) const;
+		void advanceRing(GLint attrLocation, BUFFER& buf);
+		size_t addRingAlias(GLint attrLocation, GLuint bufferId, GLint size, bool integer, GLsizei stride, size_t offset);
+		void prepareRender(glm::mat4 matrix, C3dglProgram* pProgram) const;
 	};
 
 }; // namespace _3dgl
@@ -9,21 +9,61 @@
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtc/random.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+
 #pragma comment (lib, "glew32.lib")
 
 using namespace std;
 using namespace _3dgl;
 using namespace glm;
 
-// Wolf Position and Velocity
-vec3 wolfPos = vec3(0, 0, 0);	// note: Y coordinate will be amended in run time
+// Simulation: the wolf moves in fixed time steps, rendering interpolates between the last two (T key: runs on a separate thread)
+struct SIM_STATE
+{
+	vec3 wolfPos;		// note: Y coordinate will be amended in run time
+	vec3 wolfVel;		// in m/s
+	float wolfTime;		// animation time: the wolf only walks while moving
+};
+SIM_STATE simState[C3dglSimulation::STATES];
+const float WOLF_SPEED = 0.6f;		// m/s
+vec3 simTarget = vec3(0, 0, 0);		// the wolf follows this point - set by the renderer, guarded by simMutex
+std::mutex simMutex;
+
+// Wolf Position and Velocity - interpolated, for rendering
+vec3 wolfPos = vec3(0, 0, 0);
 vec3 wolfVel = vec3(0, 0, 0);
+float wolfTime = 0;
 
 // 3D Models
+C3dglGeometryPool geometryPool;	// shared buffers for the non-instanced models - declared first, to outlive them
 C3dglSkyBox skybox;
 C3dglTerrain terrain;
 C3dglModel wolf, tree, stone;
 const size_t TREES = 2000;
+vec3 trees[TREES];				// tree positions
+C3dglHiZInstances treeInstances;
+C3dglSpatialIndex treeIndex;	// for proximity queries
+const size_t ROCKS = 300;
+C3dglStaticBatch rocks(32.0f);	// scattered rocks: pre-transformed and merged, in 32m cells
+
+// Hi-Z occlusion culling
+C3dglHiZ hiz;
+
+// Simulation ticks - declared after the models, so that its thread is stopped before they are destroyed
+C3dglSimulation simulation(60.0f);	// ticks per second
+
+// Front-to-back sorting of opaque objects and instances
+bool bSortOpaque = true;
+
+// Depth pre-pass: all opaque and alpha-tested geometry is first rendered depth-only, then shaded with GL_EQUAL depth test
+bool bDepthPrePass = true;
+
+// GPU profiler: times of the render passes and objects, shown on-screen (G key toggles the overlay)
+C3dglProfiler profiler;
+bool bProfilerOverlay = true;
 
 // Texture Ids
 GLuint idTexTerrain;
@@ -33,9 +73,18 @@ GLuint idTexNone;
 
 // GLSL Objects (Shader Program)
 C3dglProgram program;
+C3dglProgram programDepth;		// depth pre-pass: the same vertex shader, alpha test only
 
-// The View Matrix
+// The View and Projection Matrices
 mat4 matrixView;
+mat4 matrixProjection;
+
+// Per-frame uniform block: camera & light, sent once per frame
+PER_FRAME_BLOCK perFrame;
+
+// Headless mode (command line: -headless [frames]): no window, the scene is rendered offscreen for a number of frames, with a fixed time step
+C3dglHeadless headless;
+const float HEADLESS_TIME_STEP = 1.0f / 60.0f;
 
 // Camera & navigation
 float maxspeed = 4.f;	// camera max speed
@@ -43,20 +92,50 @@ float accel = 4.f;		// camera acceleration
 vec3 _acc(0), _vel(0);	// camera acceleration and velocity vectors
 float _fov = 60.f;		// field of view (zoom)
 
+// a simulation tick: simState[iNext] is simState[iPrev] advanced by dt seconds - may run on the simulation thread
+void simulate(unsigned iPrev, unsigned iNext, float dt)
+{
+	SIM_STATE& state = simState[iNext];
+	state = simState[iPrev];
+
+	vec3 target;
+	{
+		std::lock_guard<std::mutex> lock(simMutex);
+		target = simTarget;
+	}
+	if (length(target - state.wolfPos) <= 0.01f)
+		return;
+
+	state.wolfVel = normalize(target - state.wolfPos) * WOLF_SPEED;
+
+	// steer away from the trees nearby
+	std::vector<size_t> nearTrees;
+	treeIndex.queryRadius(state.wolfPos + vec3(0, terrain.getInterpolatedHeight(state.wolfPos.x, state.wolfPos.z), 0), 1.0f, nearTrees);
+	for (size_t i : nearTrees)
+	{
+		vec3 away = state.wolfPos - trees[i];
+		away.y = 0;
+		if (length(away) > 0.001f)
+			state.wolfVel += normalize(away) * WOLF_SPEED * (1 - length(away));
+	}
+	if (length(state.wolfVel) > 0.0001f)
+		state.wolfVel = normalize(state.wolfVel) * WOLF_SPEED;
+	state.wolfPos += state.wolfVel * dt;
+	state.wolfTime += dt;
+}
+
 bool init()
 {
 	// rendering states
-	glEnable(GL_DEPTH_TEST);	// depth test is necessary for most 3D scenes
+	C3dglState::enable(GL_DEPTH_TEST);	// depth test is necessary for most 3D scenes
 	glEnable(GL_NORMALIZE);		// normalization is needed by AssImp library models
 	glShadeModel(GL_SMOOTH);	// smooth shading mode is the default one; try GL_FLAT here!
 	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);	// this is the default one; try GL_LINE!
 
-	glEnable(GL_ALPHA_TEST);
-	glAlphaFunc(GL_GREATER, 0.5);
-
 	// Initialise Shaders
 	C3dglShader VertexShader;
 	C3dglShader FragmentShader;
+	C3dglShader DepthShader;
 
 	if (!VertexShader.create(GL_VERTEX_SHADER)) return false;
 	if (!VertexShader.loadFromFile("shaders/basic.vert")) return false;
@@ -72,24 +151,42 @@ bool init()
 	if (!program.link()) return false;
 	if (!program.use(true)) return false;
 
+	if (!DepthShader.create(GL_FRAGMENT_SHADER)) return false;
+	if (!DepthShader.loadFromFile("shaders/depth.frag")) return false;
+	if (!DepthShader.compile()) return false;
+
+	if (!programDepth.create()) return false;
+	if (!programDepth.attach(VertexShader)) return false;
+	if (!programDepth.attach(DepthShader)) return false;
+	if (!programDepth.link()) return false;
+	programDepth.sendUniform("texture0", 0);
+	if (!program.use(true)) return false;
+
 	// glut additional setup
-	glutSetVertexAttribCoord3(program.getAttribLocation("aVertex"));
-	glutSetVertexAttribNormal(program.getAttribLocation("aNormal"));
+	if (!headless.isCreated())
+	{
+		glutSetVertexAttribCoord3(program.getAttribLocation("aVertex"));
+		glutSetVertexAttribNormal(program.getAttribLocation("aNormal"));
+	}
 
 	// load your 3D models here!
-	if (!terrain.load("models\\heightmap.png", 50)) return false;
-	if (!wolf.load("models\\wolf.dae")) return false;
+	if (!terrain.load("models/heightmap.png", 50)) return false;
+	wolf.setGeometryPool(&geometryPool);	// pooled: shared, interleaved vertex buffers and a shared VAO
+	stone.setGeometryPool(&geometryPool);
+	wolf.setQuantizedFlag(true);		// compact normals, texture coords and bone data
+	stone.setQuantizedFlag(true);
+	tree.setInterleavedFlag(true);		// instanced - own, interleaved vertex buffer per mesh
+	if (!wolf.load("models/wolf.dae")) return false;
 	wolf.loadAnimations();
 
-	if (!stone.load("models\\stone.obj")) return false;
+	if (!stone.load("models/stone.obj")) return false;
 
-	if (!tree.load("models\\tree\\tree.3ds")) return false;
-	tree.loadMaterials("models\\tree");
-	tree.getMaterial(0)->loadTexture(GL_TEXTURE1, "models\\tree", "pine-trunk-norm.dds");
-	tree.getMaterial(1)->loadTexture(GL_TEXTURE1, "models\\tree", "pine-leaf-norm.dds");
-	tree.getMaterial(2)->loadTexture(GL_TEXTURE1, "models\\tree", "pine-branch-norm.dds");
+	if (!tree.load("models/tree/tree.3ds")) return false;
+	tree.loadMaterials("models/tree");
+	tree.getMaterial(0)->loadTexture(GL_TEXTURE1, "models/tree", "pine-trunk-norm.dds");
+	tree.getMaterial(1)->loadTexture(GL_TEXTURE1, "models/tree", "pine-leaf-norm.dds");
+	tree.getMaterial(2)->loadTexture(GL_TEXTURE1, "models/tree", "pine-branch-norm.dds");
 	
-	vec3 trees[TREES];
 	for (vec3& v : trees)
 	{
 		float x = linearRand(-128.f, 128.f);
@@ -102,62 +199,66 @@ bool init()
 	trees[1] = vec3(-5, terrain.getInterpolatedHeight(-5, -1), -1);
 	trees[2] = vec3(-4, terrain.getInterpolatedHeight(-4, -4), -4);
 
-	tree.createVertexBuffers(program.getAttribLocation("aOffset"), TREES, 3, (float*)&trees[0], 0, 1);
+	// trees are culled on the GPU, so the instance buffer is created by the culling object
+	treeInstances.create(&tree, program.getAttribLocation("aOffset"), TREES, trees);
+	treeIndex.build(trees, TREES);
+
+	// scattered rocks - copies of the stone, of random size and orientation
+	for (size_t i = 0; i < ROCKS; i++)
+	{
+		float x = linearRand(-128.f, 128.f);
+		float z = linearRand(-128.f, 128.f);
+		mat4 m = translate(mat4(1), vec3(x, terrain.getInterpolatedHeight(x, z), z));
+		m = rotate(m, linearRand(0.f, two_pi<float>()), vec3(0, 1, 0));
+		m = scale(m, vec3(linearRand(0.002f, 0.006f)));
+		rocks.add(stone, m);
+	}
+	rocks.build();
+	hiz.setReadback(true);
+	profiler.create();		// a warning only, if timer queries are not supported
+
+	// the initial state of the simulation
+	simState[0] = { vec3(0, 0, 0), vec3(0, 0, 0), 0 };
+	simulation.create(simulate);
 
 	if (!skybox.load(
-		"models\\mountain\\mft.tga",
-		"models\\mountain\\mlf.tga",
-		"models\\mountain\\mbk.tga",
-		"models\\mountain\\mrt.tga",
-		"models\\mountain\\mup.tga",
-		"models\\mountain\\mdn.tga")) return false;
+		"models/mountain/mft.tga",
+		"models/mountain/mlf.tga",
+		"models/mountain/mbk.tga",
+		"models/mountain/mrt.tga",
+		"models/mountain/mup.tga",
+		"models/mountain/mdn.tga")) return false;
 
 	// setup lights
-	program.sendUniform("lightDir.direction", vec3(- 1.0f, 1.0f, 1.0f));
-	program.sendUniform("lightDir.diffuse", vec3(1.0f, 1.0f, 1.0f));
+	perFrame.lightDirection = vec3(-1.0f, 1.0f, 1.0f);
+	perFrame.lightDiffuse = vec3(1.0f, 1.0f, 1.0f);
 
 	// load additional textures
 	C3dglBitmap bm;
-	glActiveTexture(GL_TEXTURE0);
 
 	// Terrain texture
 	bm.load("models/grass.jpg", GL_RGBA);
 	if (!bm.getBits()) return false;
-	glGenTextures(1, &idTexTerrain);
-	glBindTexture(GL_TEXTURE_2D, idTexTerrain);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, bm.getWidth(), bm.getHeight(), 0, GL_RGBA, GL_UNSIGNED_BYTE, bm.getBits());
+	idTexTerrain = createTexture2D(bm.getWidth(), abs(bm.getHeight()), GL_RGBA, bm.getBits());
 
 	// Wolf texture
 	bm.load("models/wolf.jpg", GL_RGBA);
 	if (!bm.getBits()) return false;
-	glGenTextures(1, &idTexWolf);
-	glBindTexture(GL_TEXTURE_2D, idTexWolf);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, bm.getWidth(), bm.getHeight(), 0, GL_RGBA, GL_UNSIGNED_BYTE, bm.getBits());
+	idTexWolf = createTexture2D(bm.getWidth(), abs(bm.getHeight()), GL_RGBA, bm.getBits());
 
 	// Stone texture
 	bm.load("models/stone.png", GL_RGBA);
 	if (!bm.getBits()) return false;
-	glGenTextures(1, &idTexStone);
-	glBindTexture(GL_TEXTURE_2D, idTexStone);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, bm.getWidth(), bm.getHeight(), 0, GL_RGBA, GL_UNSIGNED_BYTE, bm.getBits());
+	idTexStone = createTexture2D(bm.getWidth(), abs(bm.getHeight()), GL_RGBA, bm.getBits());
 
 	// Stone normal map
 	bm.load("models/stoneNormal.png", GL_RGBA);
 	if (!bm.getBits()) return false;
-	glGenTextures(1, &idTexStoneNormal);
-	glBindTexture(GL_TEXTURE_2D, idTexStoneNormal);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, bm.getWidth(), bm.getHeight(), 0, GL_RGBA, GL_UNSIGNED_BYTE, bm.getBits());
+	idTexStoneNormal = createTexture2D(bm.getWidth(), abs(bm.getHeight()), GL_RGBA, bm.getBits());
 
 	// none (simple-white) texture
-	glGenTextures(1, &idTexNone);
-	glBindTexture(GL_TEXTURE_2D, idTexNone);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	BYTE bytes[] = { 255, 255, 255 };
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, &bytes);
+	GLubyte bytes[] = { 255, 255, 255, 255 };
+	idTexNone = createTexture2D(1, 1, GL_RGBA, bytes);
 
 	program.sendUniform("texture0", 0);
 	program.sendUniform("textureNormal", 1);
@@ -177,85 +278,137 @@ bool init()
 	cout << "  WASD or arrow key to navigate" << endl;
 	cout << "  QE or PgUp/Dn to move the camera up and down" << endl;
 	cout << "  Drag the mouse to look around" << endl;
+	cout << "  P to toggle the depth pre-pass" << endl;
 	cout << endl;
 
 	return true;
 }
 
-void renderScene(mat4& matrixView, float time, float deltaTime)
+void animateScene(mat4& matrixView, float deltaTime)
 {
-	mat4 m;
+	// the wolf follows a point in front of the camera
+	mat4 inv = inverse(translate(matrixView, vec3(-1, 0, 1)));
+	{
+		std::lock_guard<std::mutex> lock(simMutex);
+		simTarget = vec3(inv[3].x, 0, inv[3].z);
+	}
 
-	// render skybox
-	program.sendUniform("materialDiffuse", vec3(0.0f, 0.0f, 0.0f));	// white
-	program.sendUniform("materialAmbient", vec3(1.0f, 1.0f, 1.0f));
-	glActiveTexture(GL_TEXTURE0);
+	// run the simulation ticks due (or take the last ticks of the simulation thread), and interpolate between them
+	float alpha = simulation.update(deltaTime);
+	const SIM_STATE& prev = simState[simulation.getRenderPrev()];
+	const SIM_STATE& curr = simState[simulation.getRenderCurr()];
+	wolfPos = mix(prev.wolfPos, curr.wolfPos, alpha);
+	wolfVel = mix(prev.wolfVel, curr.wolfVel, alpha);
+	wolfTime = mix(prev.wolfTime, curr.wolfTime, alpha);
+
+	// calculate and send bone transforms - to both programs
+	std::vector<mat4> transforms;
+	wolf.getAnimData(0, wolfTime * 1.45f, transforms);// choose animation cycle & speed of animation
+	programDepth.sendUniform("bones", &transforms[0], transforms.size());
+	program.sendUniform("bones", &transforms[0], transforms.size());// amount of vertexes 
+
+	// sort and cull the trees - once per frame, for both passes
+	mat4 m = scale(mat4(1), vec3(0.01f, 0.01f, 0.01f));
+	if (bSortOpaque)
+		treeInstances.sort(vec3(inverse(matrixView)[3]));	// only re-sorted after the camera has moved by a metre or so
+	treeInstances.cull(hiz, m, matrixProjection * matrixView);
+}
 
-	m = matrixView;
-	skybox.render(m);
+// renders all opaque and alpha-tested objects; with bDepthOnly, only the uniforms known to the depth pre-pass program are sent
+void renderScene(mat4& matrixView, C3dglProgram& prog, bool bDepthOnly)
+{
+	mat4 m;
+
+	// the models are rendered with the current program: make prog current for the whole pass, not only as a side effect of sendUniform
+	prog.use();
 
 	// setup materials for the terrain
-	program.sendUniform("materialDiffuse", vec3(1.0f, 1.0f, 1.0f));	// white
-	program.sendUniform("materialAmbient", vec3(0.1f, 0.1f, 0.1f));
-	glBindTexture(GL_TEXTURE_2D, idTexTerrain);
+	prog.sendUniform(UNI_MAT_DIFFUSE, vec3(1.0f, 1.0f, 1.0f));	// white
+	prog.sendUniform(UNI_MAT_AMBIENT, vec3(0.1f, 0.1f, 0.1f));
+	C3dglState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, idTexTerrain);
 
 	// render the terrain
+	profiler.begin("terrain");
 	m = matrixView;
 	terrain.render(m);
+	profiler.end();
 
-	// setup materials for the wolf
-	program.sendUniform("materialDiffuse", vec3(1.0f, 1.0f, 1.0f));	// white background for textures
-	program.sendUniform("materialAmbient", vec3(0.1f, 0.1f, 0.1f));
-	glBindTexture(GL_TEXTURE_2D, idTexWolf);
-
-	// Position of the moving wolf
-	mat4 inv = inverse(translate(matrixView, vec3(-1, 0, 1)));
-	vec3 myPos = vec3(inv[3].x, 0, inv[3].z);
-
-	if (length(myPos - wolfPos) > 0.01f)
+	// the wolf
+	vec3 wolfWorldPos = wolfPos + vec3(0, terrain.getInterpolatedHeight(wolfPos.x, wolfPos.z), 0);
+	auto renderWolf = [&]()
 	{
-		wolfVel = normalize(myPos - wolfPos) * 0.01f;
-		wolfPos = wolfPos + wolfVel;
-
-		// calculate and send bone transforms
-		std::vector<mat4> transforms;
-		wolf.getAnimData(0, time * 1.45f, transforms);// choose animation cycle & speed of animation
-		program.sendUniform("bones", &transforms[0], transforms.size());// amount of vertexes 
+		prog.sendUniform(UNI_MAT_DIFFUSE, vec3(1.0f, 1.0f, 1.0f));	// white background for textures
+		prog.sendUniform(UNI_MAT_AMBIENT, vec3(0.1f, 0.1f, 0.1f));
+		C3dglState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, idTexWolf);
+		mat4 m = translate(matrixView, wolfWorldPos);
+		m = rotate(m, atan2(wolfVel.z, -wolfVel.x) - half_pi<float>(), vec3(0, 1, 0));
+		C3dglProfiler::SCOPED scope(profiler, "wolf (skinned)");
+		wolf.render(m, matrixProjection);	// culled per node
+	};
+
+	// the stone
+	vec3 stonePos = vec3(-3, terrain.getInterpolatedHeight(-3, -1), -1);
+	auto renderStone = [&]()
+	{
+		prog.sendUniform(UNI_MAT_DIFFUSE, vec3(1.0f, 1.0f, 1.0f));
+		prog.sendUniform(UNI_MAT_AMBIENT, vec3(0.1f, 0.1f, 0.1f));
+		C3dglState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, idTexStone);
+		C3dglState::bindTexture(GL_TEXTURE1, GL_TEXTURE_2D, idTexStoneNormal);
+		if (!bDepthOnly) prog.sendUniform("bNormalMap", true);
+		mat4 m = translate(mat4(1), stonePos);
+		m = scale(m, vec3(0.01f, 0.01f, 0.01f));
+		vec3 bb[2];
+		stone.getAABB(bb);
+		if (hiz.isVisible(bb, m))
+		{
+			C3dglProfiler::SCOPED scope(profiler, "stone");
+			stone.render(matrixView * m, matrixProjection);
+		}
+		if (!bDepthOnly) prog.sendUniform("bNormalMap", false);
+	};
+
+	// render the wolf and the stone - front to back, so that the nearer one occludes the other in the depth test
+	vec3 eye = vec3(inverse(matrixView)[3]);
+	if (bSortOpaque && distance(eye, stonePos) < distance(eye, wolfWorldPos))
+	{
+		renderStone();
+		renderWolf();
+	}
+	else
+	{
+		renderWolf();
+		renderStone();
 	}
 
-	// render the wolf
-	m = matrixView;
-	vec3 amendY = vec3(vec3(0, terrain.getInterpolatedHeight(wolfPos.x, wolfPos.z), 0));
-	m = translate(m, wolfPos + amendY);
-	m = rotate(m, atan2(wolfVel.z, -wolfVel.x) - half_pi<float>(), vec3(0, 1, 0));
-	wolf.render(m);
-
-	// render the stone
-	glBindTexture(GL_TEXTURE_2D, idTexStone);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, idTexStoneNormal);
-	program.sendUniform("bNormalMap", true);
-	m = matrixView;
-	m = translate(m, vec3(-3, terrain.getInterpolatedHeight(-3, -1), -1));
-	m = scale(m, vec3(0.01f, 0.01f, 0.01f));
-	stone.render(m);
-	program.sendUniform("bNormalMap", false);
-
-	// render the trees
-	program.sendUniform("bNormalMap", true);
-	program.sendUniform("instancing", true);
-	m = matrixView;
-	m = scale(m, vec3(0.01f, 0.01f, 0.01f));
-	tree.render(m, TREES);
-	program.sendUniform("bNormalMap", false);
-	program.sendUniform("instancing", false);
+	// render the rocks - a few draw calls for all of them
+	prog.sendUniform(UNI_MAT_DIFFUSE, vec3(1.0f, 1.0f, 1.0f));
+	prog.sendUniform(UNI_MAT_AMBIENT, vec3(0.1f, 0.1f, 0.1f));
+	C3dglState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, idTexStone);
+	C3dglState::bindTexture(GL_TEXTURE1, GL_TEXTURE_2D, idTexStoneNormal);
+	if (!bDepthOnly) prog.sendUniform("bNormalMap", true);
+	profiler.begin("rocks");
+	rocks.render(matrixView, C3dglFrustum(matrixProjection * matrixView));
+	profiler.end();
+	if (!bDepthOnly) prog.sendUniform("bNormalMap", false);
+
+	// render the trees - sorted and culled in animateScene
+	if (!bDepthOnly) prog.sendUniform("bNormalMap", true);
+	prog.sendUniform("instancing", true);
+	m = scale(mat4(1), vec3(0.01f, 0.01f, 0.01f));
+	profiler.begin("trees");
+	treeInstances.render(matrixView * m);
+	profiler.end();
+	if (!bDepthOnly) prog.sendUniform("bNormalMap", false);
+	prog.sendUniform("instancing", false);
 }
 
 void onRender()
 {
 	// these variables control time & animation
 	static float prev = 0;
-	float time = glutGet(GLUT_ELAPSED_TIME) * 0.001f;	// time since start in secs
+	static unsigned frame = 0;
+	float time = headless.isCreated() ? frame++ * HEADLESS_TIME_STEP	// repeatable animation in headless runs
+		: glutGet(GLUT_ELAPSED_TIME) * 0.001f;			// time since start in secs
 	float deltaTime = time - prev;						// time since last frame
 	prev = time;										// framerate is 1/deltaTime
 
@@ -268,6 +421,9 @@ void onRender()
 		-pitch, vec3(1, 0, 0))	// switch the pitch on
 		* matrixView;
 
+	// GPU times of the frame before last (or earlier) become available here
+	profiler.beginFrame();
+
 	// clear screen and buffers
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -275,16 +431,69 @@ void onRender()
 	float terrainY = -terrain.getInterpolatedHeight(inverse(matrixView)[3][0], inverse(matrixView)[3][2]);
 	matrixView = translate(matrixView, vec3(0, terrainY, 0));
 
-	// setup View Matrix
-	program.sendUniform("matrixView", matrixView);
-	program.sendUniform("matrixInvView", glm::inverse(matrixView));
-
-	// render the scene objects
-	renderScene(matrixView, time, deltaTime);
+	// setup View Matrix - a single upload for all programs
+	perFrame.matrixView = matrixView;
+	perFrame.matrixInvView = glm::inverse(matrixView);
+	C3dglProgram::sendPerFrame(perFrame);
+
+	// occluder pre-pass: the terrain hides objects behind ridges
+	profiler.begin("hi-z");
+	hiz.beginOccluders();
+	terrain.render(matrixView);
+	hiz.endOccluders();
+	hiz.build(matrixProjection * matrixView);
+	profiler.end();
+
+	// animate the scene objects
+	animateScene(matrixView, deltaTime);
+
+	// render skybox - first, with no depth write, so that it cannot obscure anything
+	program.sendUniform(UNI_MAT_DIFFUSE, vec3(0.0f, 0.0f, 0.0f));
+	program.sendUniform(UNI_MAT_AMBIENT, vec3(1.0f, 1.0f, 1.0f));
+	profiler.begin("skybox");
+	skybox.render(matrixView);
+	profiler.end();
+
+	if (bDepthPrePass)
+	{
+		// depth pre-pass: no colour writes, cheap fragment shader (alpha test only)
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		profiler.begin("depth pre-pass");
+		renderScene(matrixView, programDepth, true);
+		profiler.end();
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+		// shading pass: only the visible fragments pass the depth test, so each pixel is shaded once.
+		// The alpha test is switched off - the discarded fragments are already missing from the depth buffer
+		C3dglState::depthFunc(GL_EQUAL);
+		C3dglState::depthMask(GL_FALSE);
+		program.sendUniform("alphaRef", 0.0f);
+		profiler.begin("shading");
+		renderScene(matrixView, program, false);
+		profiler.end();
+		program.sendUniform("alphaRef", 0.5f);
+		C3dglState::depthMask(GL_TRUE);
+		C3dglState::depthFunc(GL_LESS);
+	}
+	else
+	{
+		profiler.begin("shading");
+		renderScene(matrixView, program, false);
+		profiler.end();
+	}
 
 	// the camera must be moved down by terrainY to avoid unwanted effects
 	matrixView = translate(matrixView, vec3(0, -terrainY, 0));
 
+	if (headless.isCreated())
+	{
+		headless.finish();
+		return;
+	}
+
+	if (bProfilerOverlay)
+		profiler.print(10, -10);
+
 	// essential for double-buffering technique
 	glutSwapBuffers();
 
@@ -296,8 +505,13 @@ void onRender()
 void onReshape(int w, int h)
 {
 	float ratio = w * 1.0f / h;      // we hope that h is not zero
-	glViewport(0, 0, w, h);
-	program.sendUniform("matrixProjection", perspective(radians(_fov), ratio, 0.02f, 1000.f));
+	C3dglState::viewport(0, 0, w, h);
+	matrixProjection = perspective(radians(_fov), ratio, 0.02f, 1000.f);
+	perFrame.matrixProjection = matrixProjection;	// sent with the next frame
+
+	// Hi-Z pyramid matches the size of the window
+	if (w != hiz.getWidth() || h != hiz.getHeight())
+		hiz.create(w, h);
 }
 
 // Handle WASDQE keys
@@ -311,6 +525,9 @@ void onKeyDown(unsigned char key, int x, int y)
 	case 'd': _acc.x = -accel; break;
 	case 'e': _acc.y = accel; break;
 	case 'q': _acc.y = -accel; break;
+	case 'p': bDepthPrePass = !bDepthPrePass; break;
+	case 'g': bProfilerOverlay = !bProfilerOverlay; break;
+	case 't': if (simulation.isRunning()) simulation.stop(); else simulation.start(); break;
 	}
 }
 
@@ -401,8 +618,179 @@ void onMouseWheel(int button, int dir, int x, int y)
 	onReshape(glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT));
 }
 
+// Headless check of the Hi-Z mapping for a depth buffer of a non-power-of-two size, where the pyramid levels are rounded down.
+// The depth is near everywhere but in a narrow far strip, and a box is tested across it and away from it - on the CPU and on the GPU
+bool checkHiZ()
+{
+	const int width = 1100, height = 700;		// level 4 (the readback level) is 68 x 43 - 1100 and 700 do not halve evenly
+	C3dglHiZ pyramid;
+	if (!pyramid.create(width, height)) return false;
+	pyramid.setReadback(true);
+
+	// the strip: pixels 996..1003 lie in level 4 texel 62, a box at 990..1000 covers texels 61..62
+	pyramid.beginOccluders();
+	glClearDepth(0);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	glClearDepth(1);
+	C3dglState::enable(GL_SCISSOR_TEST);
+	glScissor(996, 0, 8, height);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	C3dglState::disable(GL_SCISSOR_TEST);
+	pyramid.endOccluders();
+
+	// identity view-projection: the boxes are given in NDC; the second build collects the readback scheduled by the first one
+	pyramid.build(mat4(1));
+	glFinish();
+	pyramid.build(mat4(1));
+
+	// a box covering pixels x0..x1, 300..310, at the depth of 0.5
+	auto box = [&](float x0, float x1, vec3 bb[2])
+	{
+		bb[0] = vec3((x0 + 0.5f) / width * 2 - 1, 300.5f / height * 2 - 1, 0);
+		bb[1] = vec3((x1 + 0.5f) / width * 2 - 1, 310.5f / height * 2 - 1, 0);
+	};
+
+	// GPU culling of a single instance at the origin: visible if its indirect instance count stays 1
+	GLuint ids[3];
+	glGenBuffers(3, ids);
+	vec3 origin(0);
+	DRAW_ELEMENTS_INDIRECT_COMMAND cmd = { 0, 1, 0, 0, 0 };
+	C3dglState::bindBuffer(GL_ARRAY_BUFFER, ids[0]);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(vec3), &origin, GL_STATIC_DRAW);
+	C3dglState::bindBuffer(GL_ARRAY_BUFFER, ids[1]);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(vec3), NULL, GL_DYNAMIC_COPY);
+	C3dglState::bindBuffer(GL_ARRAY_BUFFER, ids[2]);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(cmd), &cmd, GL_DYNAMIC_DRAW);
+	C3dglState::bindBuffer(GL_ARRAY_BUFFER, 0);
+	auto isVisibleGPU = [&](const vec3 bb[2])
+	{
+		pyramid.cullInstances(ids[0], ids[1], 1, ids[2], 1, bb, mat4(1));
+		GLuint count = 0;
+		C3dglState::bindBuffer(GL_COPY_READ_BUFFER, ids[2]);
+		glGetBufferSubData(GL_COPY_READ_BUFFER, offsetof(DRAW_ELEMENTS_INDIRECT_COMMAND, instanceCount), sizeof(GLuint), &count);
+		C3dglState::bindBuffer(GL_COPY_READ_BUFFER, 0);
+		return count != 0;
+	};
+
+	vec3 bbStrip[2], bbNear[2];
+	box(990, 1000, bbStrip);
+	box(100, 110, bbNear);
+	bool bPassed = pyramid.isVisible(bbStrip) && !pyramid.isVisible(bbNear);
+	if (pyramid.isComputeAvailable())
+		bPassed = bPassed && isVisibleGPU(bbStrip) && !isVisibleGPU(bbNear);
+	C3dglState::deleteBuffers(3, ids);
+
+	C3dglLogger::log("Check: Hi-Z, non-power-of-two size: {}", bPassed ? "passed" : "FAILED");
+	return bPassed;
+}
+
+// Headless check of the multi-draw batch (C3dglModel::createBatch): a copy of the stone, rendered through shaders/batch.vert with
+// glMultiDrawElementsIndirect - per-draw data indexed with gl_BaseInstance - must cover the same pixels as the stone rendered with the basic shader
+bool checkBatch()
+{
+	if (!GLEW_VERSION_4_6)
+	{
+		C3dglLogger::log("Check: multi-draw batch: skipped (shaders/batch.vert requires GL 4.6)");
+		return true;
+	}
+
+	C3dglShader vert, frag;
+	C3dglProgram progBatch;
+	if (!vert.create(GL_VERTEX_SHADER) || !vert.loadFromFile("shaders/batch.vert") || !vert.compile()) return false;
+	if (!frag.create(GL_FRAGMENT_SHADER) || !frag.loadFromFile("shaders/batch.frag") || !frag.compile()) return false;
+	if (!progBatch.create() || !progBatch.attach(vert) || !progBatch.attach(frag) || !progBatch.link()) return false;
+
+	// the copy is loaded with the batch program current, into a pool of its own
+	C3dglGeometryPool pool;
+	C3dglModel model;
+	model.setGeometryPool(&pool);
+	model.setQuantizedFlag(true);
+	progBatch.use();
+	bool bPassed = model.load("models/stone.obj") && model.createBatch();
+
+	// both models framed by the same camera
+	vec3 bb[2];
+	stone.getAABB(bb);
+	vec3 centre = (bb[0] + bb[1]) * 0.5f;
+	float radius = length(bb[1] - bb[0]) * 0.5f;
+	PER_FRAME_BLOCK frame = perFrame;
+	frame.matrixView = lookAt(vec3(0, 0, 3 * radius), vec3(0), vec3(0, 1, 0));
+	frame.matrixInvView = inverse(frame.matrixView);
+	frame.matrixProjection = perspective(radians(60.f), headless.getWidth() / (float)headless.getHeight(), 0.1f * radius, 10 * radius);
+	C3dglProgram::sendPerFrame(frame);
+	mat4 m = translate(frame.matrixView, -centre);
+
+	// number of pixels covered, read from the depth buffer
+	std::vector<float> depth(headless.getWidth() * headless.getHeight());
+	auto coverage = [&](C3dglProgram& prog, auto render)
+	{
+		prog.use();
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		render();
+		C3dglState::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		glReadPixels(0, 0, headless.getWidth(), headless.getHeight(), GL_DEPTH_COMPONENT, GL_FLOAT, depth.data());
+		return (size_t)std::count_if(depth.begin(), depth.end(), [](float d) { return d < 1; });
+	};
+	if (bPassed)
+	{
+		size_t nBatch = coverage(progBatch, [&]() { model.renderBatch(m); });
+		size_t nRef = coverage(program, [&]() { stone.render(m); });
+		bPassed = nRef > 0 && (nBatch > nRef ? nBatch - nRef : nRef - nBatch) <= nRef / 100;
+	}
+
+	program.use();
+	C3dglProgram::sendPerFrame(perFrame);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	C3dglLogger::log("Check: multi-draw batch: {}", bPassed ? "passed" : "FAILED");
+	return bPassed;
+}
+
+// renders the given number of frames offscreen, and reports the average frame time.
+// Returns EXIT_FAILURE if the context or the scene cannot be created, or a check fails - for scripts running the benchmark unattended
+int runHeadless(int frames)
+{
+	const int width = 1280, height = 720;
+	if (!headless.create(width, height))
+		return EXIT_FAILURE;
+
+	C3dglLogger::log("Vendor: {}", (const char*)glGetString(GL_VENDOR));
+	C3dglLogger::log("Renderer: {}", (const char*)glGetString(GL_RENDERER));
+	C3dglLogger::log("Version: {}", (const char*)glGetString(GL_VERSION));
+	C3dglLogger::log("");
+
+	if (!checkHiZ())
+		return EXIT_FAILURE;
+
+	if (!init())
+	{
+		C3dglLogger::log("Application failed to initialise\r\n");
+		return EXIT_FAILURE;
+	}
+	onReshape(width, height);
+	if (!checkBatch())
+		return EXIT_FAILURE;
+
+	// the first frame is not timed: it includes shader warm-up and the first uploads
+	onRender();
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 1; i < frames; i++)
+		onRender();
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	if (frames > 1)
+		C3dglLogger::log("Headless: {} frames, {:.3f} ms per frame", frames - 1, elapsed.count() / (frames - 1));
+
+	// GPU times, averaged over the last frames
+	for (size_t i = 0; i < profiler.getScopeCount(); i++)
+		C3dglLogger::log("{}{}: {:.3f} ms", std::string(2 * profiler.getScopeDepth(i), ' '), profiler.getScopeName(i), profiler.getAverageTime(i));
+	return EXIT_SUCCESS;
+}
+
 int main(int argc, char **argv)
 {
+	if (argc > 1 && std::string(argv[1]) == "-headless")
+		return runHeadless(argc > 2 ? atoi(argv[2]) : 600);
+
 	// init GLUT and create Window
 	glutInit(&argc, argv);
 	glutInitDisplayMode(GLUT_DEPTH | GLUT_DOUBLE | GLUT_RGBA);
@@ -1,8 +1,25 @@
 #version 330
 
-uniform mat4 matrixView;
-uniform vec3 materialAmbient;
-uniform vec3 materialDiffuse;
+// Uniform Block: Per-Frame Data - camera and light (see C3dglProgram::sendPerFrame)
+layout(std140) uniform PerFrame
+{
+	mat4 matrixProjection;
+	mat4 matrixView;
+	mat4 matrixInvView;
+	vec3 lightDirection;
+	vec3 lightDiffuse;
+};
+
+// Uniform Block: Per-Object Data - model-view matrix and material colours
+layout(std140) uniform PerObject
+{
+	mat4 matrixModelView;
+	vec3 materialAmbient;
+	vec3 materialDiffuse;
+	vec3 materialSpecular;
+	vec3 materialEmissive;
+	float materialShininess;
+};
 
 // Texture
 uniform sampler2D texture0;
@@ -13,6 +30,9 @@ uniform vec3 fogColour = vec3(0.40, 0.40, 0.5);
 
 uniform bool bNormalMap = false;
 
+// Alpha Test: fragments with lower alpha are discarded (0 - no alpha test, e.g. after a depth pre-pass)
+uniform float alphaRef = 0.5;
+
 in vec4 color;
 in vec4 position;
 in vec3 normal;
@@ -29,7 +49,6 @@ struct DIRECTIONAL
 	vec3 direction;
 	vec3 diffuse;
 };
-uniform DIRECTIONAL lightDir;
 
 vec4 DirectionalLight(DIRECTIONAL light)
 {
@@ -44,6 +63,10 @@ vec4 DirectionalLight(DIRECTIONAL light)
 
 void main(void) 
 {
+	vec4 texel = texture(texture0, texCoord0);
+	if (texel.a < alphaRef)
+		discard;
+
 	if (bNormalMap)
 	{
 		normalNew = 2.0 * texture(textureNormal, texCoord0).xyz - vec3(1.0, 1.0, 1.0);
@@ -53,7 +76,7 @@ void main(void)
 		normalNew = normal;
 
 	outColor = color;
-	outColor += DirectionalLight(lightDir);
-	outColor *= texture(texture0, texCoord0);
+	outColor += DirectionalLight(DIRECTIONAL(lightDirection, lightDiffuse));
+	outColor *= texel;
 	outColor = mix(vec4(fogColour, 1), outColor, fogFactor);
 }
@@ -2,15 +2,26 @@
 
 #version 330
 
-// Uniforms: Transformation Matrices
-uniform mat4 matrixProjection;
-uniform mat4 matrixView;
-uniform mat4 matrixModelView;
-uniform mat4 matrixInvView;
-
-// Uniforms: Material Colours
-uniform vec3 materialAmbient;
-uniform vec3 materialDiffuse;
+// Uniform Block: Per-Frame Data - camera and light (see C3dglProgram::sendPerFrame)
+layout(std140) uniform PerFrame
+{
+	mat4 matrixProjection;
+	mat4 matrixView;
+	mat4 matrixInvView;
+	vec3 lightDirection;
+	vec3 lightDiffuse;
+};
+
+// Uniform Block: Per-Object Data - model-view matrix and material colours
+layout(std140) uniform PerObject
+{
+	mat4 matrixModelView;
+	vec3 materialAmbient;
+	vec3 materialDiffuse;
+	vec3 materialSpecular;
+	vec3 materialEmissive;
+	float materialShininess;
+};
 
 // Uniform: Fog Density
 uniform float fogDensity = 0.02;
@@ -25,8 +36,8 @@ uniform bool instancing = false;
 in vec3 aVertex;
 in vec3 aNormal;
 in vec2 aTexCoord;
-in vec3 aTangent;
-in vec3 aBiTangent;
+in vec4 aTangent;		// w: handedness (1 if not provided)
+in vec3 aBiTangent;		// not provided with quantized formats - see below
 in ivec4 aBoneId;		// Bone Ids
 in  vec4 aBoneWeight;	// Bone Weights
 in vec3 aOffset;
@@ -38,6 +49,9 @@ out vec2 texCoord0;
 out float fogFactor;
 out mat3 matrixTangent;
 
+// the depth pre-pass and the shading pass must produce identical depth values (see shaders/depth.frag)
+invariant gl_Position;
+
 mat4 rotationMatrix(vec3 axis, float angle)
 {
     float s = sin(angle);
@@ -75,8 +89,11 @@ void main(void)
 	texCoord0 = aTexCoord;
 
 	// calculate tangent local system transformation
-	vec3 tangent = normalize(mat3(matrixModelView) * aTangent);
-	vec3 biTangent = normalize(mat3(matrixModelView) * aBiTangent);
+	vec3 tangent = normalize(mat3(matrixModelView) * aTangent.xyz);
+	vec3 biTangent = aBiTangent;
+	if (biTangent == vec3(0))
+		biTangent = cross(aNormal, aTangent.xyz) * aTangent.w;	// quantized formats: rebuild from the normal and handedness
+	biTangent = normalize(mat3(matrixModelView) * biTangent);
 	matrixTangent = mat3(tangent, biTangent, normal);
 
 	// calculate the fog factor
@@ -0,0 +1,84 @@
+// FRAGMENT SHADER - multi-draw batches (see C3dglModel::createBatch)
+
+#version 460
+
+// Uniform Block: Per-Frame Data - camera and light (see C3dglProgram::sendPerFrame)
+layout(std140) uniform PerFrame
+{
+	mat4 matrixProjection;
+	mat4 matrixView;
+	mat4 matrixInvView;
+	vec3 lightDirection;
+	vec3 lightDiffuse;
+};
+
+// Uniform Block: Per-Object Data - model-view matrix and material colours
+layout(std140) uniform PerObject
+{
+	mat4 matrixModelView;
+	vec3 materialAmbient;
+	vec3 materialDiffuse;
+	vec3 materialSpecular;
+	vec3 materialEmissive;
+	float materialShininess;
+};
+
+// Texture
+uniform sampler2D texture0;
+uniform sampler2D textureNormal;
+
+// Texture Arrays - pooled textures (see C3dglTexturePool)
+layout(binding = 2) uniform sampler2DArray textureArray0;
+layout(binding = 3) uniform sampler2DArray textureNormalArray;
+
+// Fog Colour
+uniform vec3 fogColour = vec3(0.40, 0.40, 0.5);
+
+uniform bool bNormalMap = false;
+
+in vec4 color;
+in vec4 position;
+in vec3 normal;
+in vec2 texCoord0;
+in float fogFactor;
+in mat3 matrixTangent;
+flat in vec3 diffuse;		// material diffuse colour
+flat in ivec2 layers;		// texture array layers, -1 if not pooled
+
+out vec4 outColor;
+
+vec3 normalNew;
+
+struct DIRECTIONAL
+{	
+	vec3 direction;
+	vec3 diffuse;
+};
+
+vec4 DirectionalLight(DIRECTIONAL light)
+{
+	// Calculate Directional Light
+	vec4 color = vec4(0, 0, 0, 0);
+	vec3 L = normalize(mat3(matrixView) * light.direction);
+	float NdotL = dot(normalNew, L);
+	if (NdotL > 0)
+		color += vec4(diffuse * light.diffuse, 1) * NdotL;
+	return color;
+}
+
+void main(void) 
+{
+	if (bNormalMap)
+	{
+		vec3 texel = layers.y >= 0 ? texture(textureNormalArray, vec3(texCoord0, layers.y)).xyz : texture(textureNormal, texCoord0).xyz;
+		normalNew = 2.0 * texel - vec3(1.0, 1.0, 1.0);
+		normalNew = normalize(matrixTangent * normalNew);
+	}
+	else
+		normalNew = normal;
+
+	outColor = color;
+	outColor += DirectionalLight(DIRECTIONAL(lightDirection, lightDiffuse));
+	outColor *= layers.x >= 0 ? texture(textureArray0, vec3(texCoord0, layers.x)) : texture(texture0, texCoord0);
+	outColor = mix(vec4(fogColour, 1), outColor, fogFactor);
+}
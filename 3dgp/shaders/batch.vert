@@ -0,0 +1,108 @@
+// VERTEX SHADER - multi-draw batches (see C3dglModel::createBatch)
+
+#version 460
+
+// Uniform Block: Per-Frame Data - camera and light (see C3dglProgram::sendPerFrame)
+layout(std140) uniform PerFrame
+{
+	mat4 matrixProjection;
+	mat4 matrixView;
+	mat4 matrixInvView;
+	vec3 lightDirection;
+	vec3 lightDiffuse;
+};
+
+// Uniform Block: Per-Object Data - model-view matrix and material colours - used if not defined by the model's materials
+layout(std140) uniform PerObject
+{
+	mat4 matrixModelView;
+	vec3 materialAmbient;
+	vec3 materialDiffuse;
+	vec3 materialSpecular;
+	vec3 materialEmissive;
+	float materialShininess;
+};
+
+// Uniform: Fog Density
+uniform float fogDensity = 0.02;
+
+// Per-draw data: node transform and material index
+struct DRAW
+{
+	mat4 matrix;
+	uint material;		// 0xFFFFFFFF if none
+};
+layout(std430, binding = 3) readonly buffer Draws { DRAW draws[]; };
+
+// Material data: w = 1 if the colour is defined by the material
+struct MATERIAL
+{
+	vec4 ambient, diffuse, specular, emissive;
+	ivec4 layers;		// texture array layers (see C3dglTexturePool): x - texture0, y - normal map; -1 if not pooled
+};
+layout(std430, binding = 4) readonly buffer Materials { MATERIAL materials[]; };
+
+// Instance offsets, added to the world position
+layout(std430, binding = 5) readonly buffer Instances { vec4 offsets[]; };
+
+in vec3 aVertex;
+in vec3 aNormal;
+in vec2 aTexCoord;
+in vec4 aTangent;		// w: handedness (1 if not provided)
+in vec3 aBiTangent;		// not provided with quantized formats - see below
+
+out vec4 color;
+out vec4 position;
+out vec3 normal;
+out vec2 texCoord0;
+out float fogFactor;
+out mat3 matrixTangent;
+flat out vec3 diffuse;
+flat out ivec2 layers;
+
+void main(void) 
+{
+	// the draw is identified by its base instance
+	DRAW draw = draws[gl_BaseInstance];
+	mat4 matrix = matrixModelView * draw.matrix;
+
+	// calculate position
+	position = matrix * vec4(aVertex, 1.0);
+	position += matrixView * offsets[gl_InstanceID];
+	gl_Position = matrixProjection * position;
+
+	// calculate normal
+	normal = normalize(mat3(matrix) * aNormal);
+
+	// calculate UV
+	texCoord0 = aTexCoord;
+
+	// calculate tangent local system transformation
+	vec3 tangent = normalize(mat3(matrix) * aTangent.xyz);
+	vec3 biTangent = aBiTangent;
+	if (biTangent == vec3(0))
+		biTangent = cross(aNormal, aTangent.xyz) * aTangent.w;	// quantized formats: rebuild from the normal and handedness
+	biTangent = normalize(mat3(matrix) * biTangent);
+	matrixTangent = mat3(tangent, biTangent, normal);
+
+	// calculate the fog factor
+	fogFactor = exp2(-fogDensity * length(position));
+
+	// material colours
+	vec3 ambient = materialAmbient;
+	diffuse = materialDiffuse;
+	layers = ivec2(-1);
+	if (draw.material != 0xFFFFFFFFu)
+	{
+		MATERIAL m = materials[draw.material];
+		if (m.ambient.w > 0) ambient = m.ambient.rgb;
+		if (m.diffuse.w > 0) diffuse = m.diffuse.rgb;
+		layers = m.layers.xy;
+	}
+
+	// calculate light - start with pitch black
+	color = vec4(0);
+
+	// ambient light
+	color += vec4(ambient, 1);
+}
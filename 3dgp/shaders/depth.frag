@@ -0,0 +1,17 @@
+// FRAGMENT SHADER - depth pre-pass: no shading, alpha test only (used with basic.vert)
+
+#version 330
+
+// Texture
+uniform sampler2D texture0;
+
+// Alpha Test: fragments with lower alpha are discarded
+uniform float alphaRef = 0.5;
+
+in vec2 texCoord0;
+
+void main(void) 
+{
+	if (texture(texture0, texCoord0).a < alphaRef)
+		discard;
+}